@@ -0,0 +1,582 @@
+/* Replays adapter traffic captured with usb:gc StartCapture/StopCapture (sd:/usb_mitm_capture.bin) through the driver's */
+/* packet delivery logic, so changes to it can be checked for latency and dropped inputs against real play sessions */
+/* This is a host-side tool, build it with: */
+/*     g++ -std=c++20 -O2 -pthread -o capture_replay tools/capture_replay/capture_replay.cpp usb_mitm/source/packet_processing.cpp */
+/* Usage: */
+/*     capture_replay <capture> [options] */
+/*         --mode latest|latch              Delivery mode, as set with usb:gc SetAdapterDeliveryMode (default latest) */
+/*         --filter none|mean|median|ema    Analog filter on every port, as set with usb:gc SetAdapterAnalogFilter (default none) */
+/*         --poll-us <us>                   Interval at which the simulated HID fetches packets (default 8000) */
+/*         --speed <factor>                 Replay on real threads, at factor times the original speed. Without it the replay runs */
+/*                                          in virtual time, which gives the exact same numbers on every run */
+/*         --max-dropped <n>                Exit with 2 if more than n presses were dropped, for use in regression checks */
+/*         --print-states <adapter>         Print the decoded controller state of an adapter slot whenever a controller, button */
+/*                                          or the type of controller changes */
+/* Every successful read also gets decoded the way the driver does for usb:gc GetAdapterControllerStates, and checked against */
+/* the raw packet. Any mismatch makes the tool exit with 3 */
+#include "../../usb_mitm/source/capture_format.hpp"
+#include "../../usb_mitm/source/packet_processing.hpp"
+#include "../../usb_mitm/source/controller_state.hpp"
+#include "../../usb_mitm/source/latency_stats.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace usb::capture;
+    using namespace usb::gc;
+
+    static constexpr size_t MaxAdapters = 256;
+    static constexpr size_t ButtonBits = 64;
+
+    enum class DeliveryMode
+    {
+        Latest,
+        LatchPresses
+    };
+
+    struct Options
+    {
+        DeliveryMode mMode = DeliveryMode::Latest;
+        packet::AnalogFilterMode mFilter = packet::AnalogFilterMode::None;
+        uint64_t mPollUs = 8000;
+        double mSpeed = 0.0;
+        int64_t mMaxDropped = -1;
+        int mPrintStatesAdapter = -1;
+    };
+
+    /* The records the replay acts on, everything else in the capture is only counted */
+    struct Event
+    {
+        uint64_t mTick;
+        RecordKind mKind;
+        uint8_t mAdapter;
+        uint32_t mResult;
+        /* Reads that failed or came up short are recorded without a packet */
+        bool mIsPacket;
+        uint8_t mData[packet::PacketSize];
+    };
+
+    struct Capture
+    {
+        FileHeader mHeader;
+        std::vector<Event> mEvents;
+        uint64_t mKindCounts[static_cast<size_t>(RecordKind::Count)] = {};
+    };
+
+    bool ReadCapture(const char* pPath, Capture* pCapture)
+    {
+        FILE* pFile = std::fopen(pPath, "rb");
+        if (pFile == nullptr)
+        {
+            std::fprintf(stderr, "Unable to open %s\n", pPath);
+            return false;
+        }
+
+        FileHeader* pHeader = &pCapture->mHeader;
+        bool IsValid = std::fread(pHeader, sizeof(FileHeader), 1, pFile) == 1
+            && std::memcmp(pHeader->mMagic, FileMagic, sizeof(FileMagic)) == 0
+            && pHeader->mVersion == FileVersion
+            && pHeader->mRecordHeaderSize == sizeof(RecordHeader)
+            && pHeader->mTickFrequency != 0;
+
+        for (uint32_t i = 0; IsValid && i < pHeader->mRecordCount; i++)
+        {
+            RecordHeader Record;
+            uint8_t Payload[UINT16_MAX];
+            IsValid = std::fread(&Record, sizeof(Record), 1, pFile) == 1
+                && std::fread(Payload, 1, Record.mPayloadSize, pFile) == Record.mPayloadSize
+                && Record.mKind < static_cast<uint8_t>(RecordKind::Count);
+            if (!IsValid)
+                break;
+
+            pCapture->mKindCounts[Record.mKind]++;
+
+            const RecordKind Kind = static_cast<RecordKind>(Record.mKind);
+            if (Kind != RecordKind::Read && Kind != RecordKind::AdapterOpened)
+                continue;
+
+            Event Entry = {
+                .mTick = Record.mTick,
+                .mKind = Kind,
+                .mAdapter = Record.mAdapter,
+                .mResult = Record.mResult,
+                .mIsPacket = Record.mResult == 0 && Record.mPayloadSize >= packet::PacketSize,
+                .mData = {}
+            };
+            std::memcpy(Entry.mData, Payload, std::min<size_t>(Record.mPayloadSize, sizeof(Entry.mData)));
+            pCapture->mEvents.push_back(Entry);
+        }
+
+        std::fclose(pFile);
+        if (!IsValid)
+        {
+            std::fprintf(stderr, "%s is not a valid capture\n", pPath);
+        }
+        return IsValid;
+    }
+
+    /* Mirror of what the driver does for an adapter between a read completing and HID fetching a packet */
+    /* (PublishReadPacket and ReadPacket in driver_thread.cpp), minus the cross-thread publication */
+    struct AdapterDelivery
+    {
+        packet::AnalogFilterState mFilter;
+        packet::ButtonLatch mLatched;
+        bool mHasPacket;
+        uint8_t mLatest[packet::PacketSize];
+        uint64_t mLatestTick;
+
+        void Reset()
+        {
+            packet::ResetAnalogFilter(&mFilter);
+            mLatched.Clear();
+            mHasPacket = false;
+            mLatestTick = 0;
+        }
+
+        /* Failed and short reads don't get here, the driver keeps the last packet that arrived for those */
+        void Publish(const Options& Opts, const uint8_t* pData, uint64_t Tick)
+        {
+            std::memcpy(mLatest, pData, packet::PacketSize);
+            if (Opts.mMode == DeliveryMode::LatchPresses)
+            {
+                mLatched.Accumulate(mLatest);
+            }
+
+            packet::PushAnalogSample(&mFilter, mLatest);
+            if (Opts.mFilter != packet::AnalogFilterMode::None)
+            {
+                const packet::AnalogFilterMode Modes[packet::PortCount] = { Opts.mFilter, Opts.mFilter, Opts.mFilter, Opts.mFilter };
+                packet::ApplyAnalogFilter(&mFilter, Modes, mLatest);
+            }
+            mHasPacket = true;
+            mLatestTick = Tick;
+        }
+
+        bool Fetch(const Options& Opts, uint8_t* pOut)
+        {
+            if (!mHasPacket)
+                return false;
+
+            std::memcpy(pOut, mLatest, packet::PacketSize);
+            if (Opts.mMode == DeliveryMode::LatchPresses)
+            {
+                packet::ApplyLatchedButtons(pOut, mLatched.Take());
+            }
+            return true;
+        }
+    };
+
+    /* Follows every button press on the wire and whether HID ever got to see it */
+    /* A press is delivered once a fetched packet has its button down. It is dropped if the button was released again before */
+    /* that happened, or if it got merged with another press of the same button in a single fetch */
+    struct PressTracker
+    {
+        uint64_t mRawButtons;
+        uint32_t mPending[ButtonBits];
+        uint64_t mPendingSince[ButtonBits];
+
+        void Reset()
+        {
+            mRawButtons = 0;
+            std::memset(mPending, 0, sizeof(mPending));
+        }
+    };
+
+    struct Results
+    {
+        uint64_t mReads = 0;
+        uint64_t mFailedReads = 0;
+        uint64_t mFetches = 0;
+        uint64_t mPresses = 0;
+        uint64_t mDelivered = 0;
+        uint64_t mDropped = 0;
+        stats::LatencyHistogram mSampleAge;
+        stats::LatencyHistogram mPressToDelivery;
+    };
+
+    class Replayer
+    {
+    private:
+        const Options& mOptions;
+        const uint64_t mTickFrequency;
+        AdapterDelivery mDelivery[MaxAdapters];
+        PressTracker mPresses[MaxAdapters];
+        bool mIsOpen[MaxAdapters];
+
+    public:
+        Results mResults;
+
+        Replayer(const Options& Opts, uint64_t TickFrequency) : mOptions(Opts), mTickFrequency(TickFrequency), mIsOpen()
+        {
+            mResults.mSampleAge.Reset();
+            mResults.mPressToDelivery.Reset();
+        }
+
+        uint64_t TicksToNs(uint64_t Ticks) const
+        {
+            return static_cast<uint64_t>(static_cast<double>(Ticks) * 1'000'000'000.0 / static_cast<double>(mTickFrequency));
+        }
+
+        uint64_t NsToTicks(uint64_t Ns) const
+        {
+            return static_cast<uint64_t>(static_cast<double>(Ns) * static_cast<double>(mTickFrequency) / 1'000'000'000.0);
+        }
+
+        /* Applies a captured event as if the driver thread saw it at Tick */
+        void OnEvent(const Event& Entry, uint64_t Tick)
+        {
+            if (Entry.mKind == RecordKind::AdapterOpened)
+            {
+                mDelivery[Entry.mAdapter].Reset();
+                mPresses[Entry.mAdapter].Reset();
+                mIsOpen[Entry.mAdapter] = true;
+                return;
+            }
+
+            /* Captures started after the adapter was opened never saw it happen */
+            if (!mIsOpen[Entry.mAdapter])
+            {
+                mDelivery[Entry.mAdapter].Reset();
+                mPresses[Entry.mAdapter].Reset();
+                mIsOpen[Entry.mAdapter] = true;
+            }
+
+            mResults.mReads++;
+            if (!Entry.mIsPacket)
+            {
+                mResults.mFailedReads++;
+                return;
+            }
+            mDelivery[Entry.mAdapter].Publish(mOptions, Entry.mData, Tick);
+
+            PressTracker* pTracker = &mPresses[Entry.mAdapter];
+            const uint64_t Buttons = packet::GatherButtons(Entry.mData);
+            const uint64_t Rising = Buttons & ~pTracker->mRawButtons;
+            for (size_t bit = 0; bit < ButtonBits; bit++)
+            {
+                if ((Rising & (1ull << bit)) == 0)
+                    continue;
+
+                if (pTracker->mPending[bit] == 0)
+                    pTracker->mPendingSince[bit] = Tick;
+                pTracker->mPending[bit]++;
+                mResults.mPresses++;
+            }
+            pTracker->mRawButtons = Buttons;
+        }
+
+        /* HID fetches a packet from every open adapter at Tick */
+        void Poll(uint64_t Tick)
+        {
+            for (size_t adapter = 0; adapter < MaxAdapters; adapter++)
+            {
+                uint8_t Packet[packet::PacketSize];
+                if (!mIsOpen[adapter] || !mDelivery[adapter].Fetch(mOptions, Packet))
+                    continue;
+
+                mResults.mFetches++;
+                mResults.mSampleAge.Record(TicksToNs(Tick - mDelivery[adapter].mLatestTick));
+
+                PressTracker* pTracker = &mPresses[adapter];
+                const uint64_t Delivered = packet::GatherButtons(Packet);
+                for (size_t bit = 0; bit < ButtonBits; bit++)
+                {
+                    if (pTracker->mPending[bit] == 0)
+                        continue;
+
+                    if ((Delivered & (1ull << bit)) != 0)
+                    {
+                        mResults.mDelivered++;
+                        mResults.mDropped += pTracker->mPending[bit] - 1;
+                        mResults.mPressToDelivery.Record(TicksToNs(Tick - pTracker->mPendingSince[bit]));
+                        pTracker->mPending[bit] = 0;
+                    }
+                    else if ((pTracker->mRawButtons & (1ull << bit)) == 0)
+                    {
+                        mResults.mDropped += pTracker->mPending[bit];
+                        pTracker->mPending[bit] = 0;
+                    }
+                }
+            }
+        }
+    };
+
+    /* Every event is applied at its captured tick and HID polls on an exact schedule, so the results only depend on the capture */
+    void ReplayVirtual(const Capture& Input, Replayer* pReplayer, const Options& Opts)
+    {
+        const uint64_t PollTicks = std::max<uint64_t>(pReplayer->NsToTicks(Opts.mPollUs * 1000), 1);
+        uint64_t NextPoll = Input.mEvents.front().mTick + PollTicks;
+
+        for (const Event& Entry : Input.mEvents)
+        {
+            while (Entry.mTick > NextPoll)
+            {
+                pReplayer->Poll(NextPoll);
+                NextPoll += PollTicks;
+            }
+            pReplayer->OnEvent(Entry, Entry.mTick);
+        }
+        pReplayer->Poll(NextPoll);
+    }
+
+    /* Events are fed from one thread and HID polls from another, both on the wall clock scaled by the speed factor */
+    /* Every timestamp comes from the replay clock, so scheduling delays on the host show up in the numbers */
+    void ReplayRealTime(const Capture& Input, Replayer* pReplayer, const Options& Opts)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::mutex Lock;
+        bool IsDone = false;
+        const uint64_t FirstTick = Input.mEvents.front().mTick;
+        const Clock::time_point Start = Clock::now();
+
+        const auto ReplayTick = [&]() -> uint64_t {
+            const double ElapsedNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - Start).count());
+            return FirstTick + pReplayer->NsToTicks(static_cast<uint64_t>(ElapsedNs * Opts.mSpeed));
+        };
+
+        std::thread Producer([&]() {
+            for (const Event& Entry : Input.mEvents)
+            {
+                const double OffsetNs = static_cast<double>(pReplayer->TicksToNs(Entry.mTick - FirstTick)) / Opts.mSpeed;
+                std::this_thread::sleep_until(Start + std::chrono::nanoseconds(static_cast<int64_t>(OffsetNs)));
+
+                std::lock_guard Guard(Lock);
+                pReplayer->OnEvent(Entry, ReplayTick());
+            }
+
+            std::lock_guard Guard(Lock);
+            IsDone = true;
+        });
+
+        const auto PollInterval = std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(Opts.mPollUs * 1000) / Opts.mSpeed));
+        Clock::time_point NextPoll = Start + PollInterval;
+        while (true)
+        {
+            std::this_thread::sleep_until(NextPoll);
+            NextPoll += PollInterval;
+
+            std::lock_guard Guard(Lock);
+            pReplayer->Poll(ReplayTick());
+            if (IsDone)
+                break;
+        }
+
+        Producer.join();
+    }
+
+    void PrintSummary(const char* pName, const stats::LatencyHistogram& Histogram)
+    {
+        stats::LatencySummary Summary;
+        Histogram.Summarize(&Summary);
+        std::printf(
+            "%-18s count=%" PRIu64 "  p50=%.3fms  p99=%.3fms  max=%.3fms\n",
+            pName, Summary.mCount, Summary.mP50Ns / 1e6, Summary.mP99Ns / 1e6, Summary.mMaxNs / 1e6
+        );
+    }
+
+    /* Checks a decoded packet against the raw bytes, going by the port block layout documented in packet_processing.hpp */
+    /* rather than the decoder's own constants */
+    bool MatchesRawPacket(const packet::ControllerState& State, const uint8_t* pData)
+    {
+        uint8_t ConnectedPorts = 0;
+        for (size_t port = 0; port < packet::PortCount; port++)
+        {
+            const uint8_t* pPort = pData + 1 + port * 9;
+            const packet::PortState& Port = State.mPorts[port];
+            if (Port.mStatus != pPort[0] || Port.mType != (pPort[0] >> 4) || Port.mButtons != (pPort[1] | (pPort[2] << 8))
+                || Port.mStickX != pPort[3] || Port.mStickY != pPort[4] || Port.mCStickX != pPort[5] || Port.mCStickY != pPort[6]
+                || Port.mTriggerL != pPort[7] || Port.mTriggerR != pPort[8])
+                return false;
+
+            if ((pPort[0] >> 4) != 0)
+                ConnectedPorts |= static_cast<uint8_t>(1 << port);
+        }
+        return State.mConnectedPorts == ConnectedPorts;
+    }
+
+    void PrintState(uint64_t Tick, uint64_t TickFrequency, const packet::ControllerState& State)
+    {
+        static constexpr char TypeNames[] = { '-', 'W', 'R' };
+
+        std::printf("%10.3fms  adapter %u:", Tick * 1000.0 / TickFrequency, State.mAdapter);
+        for (const packet::PortState& Port : State.mPorts)
+        {
+            std::printf(
+                "  [%c %03x %02x,%02x %02x,%02x %02x,%02x]", Port.mType < sizeof(TypeNames) ? TypeNames[Port.mType] : '?', Port.mButtons,
+                Port.mStickX, Port.mStickY, Port.mCStickX, Port.mCStickY, Port.mTriggerL, Port.mTriggerR
+            );
+        }
+        std::printf("\n");
+    }
+
+    /* Decodes every successful read, returns the number that didn't match the raw packet */
+    uint64_t CheckDecoding(const Capture& Input, const Options& Opts, uint64_t* pDecoded)
+    {
+        uint64_t Mismatches = 0;
+        *pDecoded = 0;
+
+        packet::ControllerState Previous = {};
+        bool HasPrevious = false;
+        for (const Event& Entry : Input.mEvents)
+        {
+            if (Entry.mKind != RecordKind::Read || !Entry.mIsPacket)
+                continue;
+
+            packet::ControllerState State = {};
+            packet::DecodePacket(Entry.mData, &State);
+            State.mAdapter = Entry.mAdapter;
+            (*pDecoded)++;
+
+            if (!MatchesRawPacket(State, Entry.mData))
+            {
+                Mismatches++;
+                std::fprintf(stderr, "Decoded packet doesn't match the raw packet at tick %" PRIu64 "\n", Entry.mTick);
+            }
+
+            if (Entry.mAdapter != Opts.mPrintStatesAdapter)
+                continue;
+
+            /* Only changes worth reading through get printed, the analog values move on nearly every packet */
+            bool HasChanged = !HasPrevious || State.mConnectedPorts != Previous.mConnectedPorts;
+            for (size_t port = 0; port < packet::PortCount && !HasChanged; port++)
+            {
+                HasChanged = State.mPorts[port].mType != Previous.mPorts[port].mType || State.mPorts[port].mButtons != Previous.mPorts[port].mButtons;
+            }
+
+            if (HasChanged)
+                PrintState(Entry.mTick - Input.mEvents.front().mTick, Input.mHeader.mTickFrequency, State);
+
+            Previous = State;
+            HasPrevious = true;
+        }
+
+        return Mismatches;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options* pOpts)
+    {
+        for (int i = 2; i < argc; i++)
+        {
+            const char* pArg = argv[i];
+            const char* pValue = i + 1 < argc ? argv[i + 1] : nullptr;
+            if (pValue == nullptr)
+                return false;
+            i++;
+
+            if (std::strcmp(pArg, "--mode") == 0)
+            {
+                if (std::strcmp(pValue, "latest") == 0)
+                    pOpts->mMode = DeliveryMode::Latest;
+                else if (std::strcmp(pValue, "latch") == 0)
+                    pOpts->mMode = DeliveryMode::LatchPresses;
+                else
+                    return false;
+            }
+            else if (std::strcmp(pArg, "--filter") == 0)
+            {
+                if (std::strcmp(pValue, "none") == 0)
+                    pOpts->mFilter = packet::AnalogFilterMode::None;
+                else if (std::strcmp(pValue, "mean") == 0)
+                    pOpts->mFilter = packet::AnalogFilterMode::Mean;
+                else if (std::strcmp(pValue, "median") == 0)
+                    pOpts->mFilter = packet::AnalogFilterMode::Median;
+                else if (std::strcmp(pValue, "ema") == 0)
+                    pOpts->mFilter = packet::AnalogFilterMode::Exponential;
+                else
+                    return false;
+            }
+            else if (std::strcmp(pArg, "--poll-us") == 0)
+            {
+                pOpts->mPollUs = std::strtoull(pValue, nullptr, 10);
+                if (pOpts->mPollUs == 0)
+                    return false;
+            }
+            else if (std::strcmp(pArg, "--speed") == 0)
+            {
+                pOpts->mSpeed = std::strtod(pValue, nullptr);
+                if (pOpts->mSpeed <= 0.0)
+                    return false;
+            }
+            else if (std::strcmp(pArg, "--max-dropped") == 0)
+            {
+                pOpts->mMaxDropped = std::strtoll(pValue, nullptr, 10);
+            }
+            else if (std::strcmp(pArg, "--print-states") == 0)
+            {
+                pOpts->mPrintStatesAdapter = std::atoi(pValue);
+                if (pOpts->mPrintStatesAdapter < 0 || pOpts->mPrintStatesAdapter >= static_cast<int>(MaxAdapters))
+                    return false;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options Opts;
+    if (argc < 2 || !ParseOptions(argc, argv, &Opts))
+    {
+        std::fprintf(
+            stderr,
+            "Usage: %s <capture> [--mode latest|latch] [--filter none|mean|median|ema] [--poll-us <us>] [--speed <factor>] [--max-dropped <n>] [--print-states <adapter>]\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    Capture Input;
+    if (!ReadCapture(argv[1], &Input))
+        return 1;
+
+    std::printf("# %u records, %u dropped while capturing, tick frequency %" PRIu64 "hz\n", Input.mHeader.mRecordCount, Input.mHeader.mDroppedCount, Input.mHeader.mTickFrequency);
+    for (uint8_t kind = 1; kind < static_cast<uint8_t>(RecordKind::Count); kind++)
+    {
+        std::printf("#   %-14s %" PRIu64 "\n", GetRecordKindName(kind), Input.mKindCounts[kind]);
+    }
+
+    if (Input.mEvents.empty())
+    {
+        std::printf("Nothing to replay\n");
+        return 0;
+    }
+
+    uint64_t Decoded;
+    const uint64_t DecodeMismatches = CheckDecoding(Input, Opts, &Decoded);
+    std::printf("decoded=%" PRIu64 "  mismatches=%" PRIu64 "\n", Decoded, DecodeMismatches);
+
+    /* The replayer is too large for the stack */
+    auto pReplayer = std::make_unique<Replayer>(Opts, Input.mHeader.mTickFrequency);
+    if (Opts.mSpeed > 0.0)
+        ReplayRealTime(Input, pReplayer.get(), Opts);
+    else
+        ReplayVirtual(Input, pReplayer.get(), Opts);
+
+    const Results& Out = pReplayer->mResults;
+    std::printf("reads=%" PRIu64 " (failed %" PRIu64 ")  fetches=%" PRIu64 "\n", Out.mReads, Out.mFailedReads, Out.mFetches);
+    std::printf("presses=%" PRIu64 "  delivered=%" PRIu64 "  dropped=%" PRIu64 "\n", Out.mPresses, Out.mDelivered, Out.mDropped);
+    PrintSummary("sample age", Out.mSampleAge);
+    PrintSummary("press to delivery", Out.mPressToDelivery);
+
+    if (Opts.mMaxDropped >= 0 && Out.mDropped > static_cast<uint64_t>(Opts.mMaxDropped))
+    {
+        std::fprintf(stderr, "%" PRIu64 " presses dropped, more than the allowed %" PRId64 "\n", Out.mDropped, Opts.mMaxDropped);
+        return 2;
+    }
+
+    return DecodeMismatches == 0 ? 0 : 3;
+}
@@ -0,0 +1,253 @@
+/* Derives a signature for the usb sysmodule hook site from a dump of the USB service's .text in which the site is at the */
+/* known offset (g_EndpointDescriptorHook in interval_patch.hpp), and checks that it still finds exactly one hook site in */
+/* the dumps of other builds. The sysmodule only patches the known offset until such a signature has been checked */
+/* The signature is a window of words around the hooked instruction that grows from MinSignatureWords until it matches */
+/* only there, with branch and adrp immediates masked out since they move between builds. The hooked instruction alone is */
+/* no signature, it is what the sysmodule compares the site against anyway. Also reports how long a scan of .text takes */
+/* and the room left for the patch in the padding at the end of .text */
+/* This is a host-side tool, build it with: */
+/*     g++ -std=c++20 -O2 -o hook_locator tools/hook_locator/hook_locator.cpp usb_mitm/source/signature_scan.cpp */
+/* Usage: */
+/*     hook_locator <text dump> [options]      The dump is the raw, decompressed .text segment of the USB service's main module, */
+/*                                             as mapped (rounded up to a page), for the padding to show up */
+/*         --against <text dump>               Dump of another build to scan with the derived signature, can be repeated */
+/*         --iterations <n>                    Times the scan gets repeated for the timing (default 100) */
+/*         --chunk <bytes>                     Scan in chunks of this size, the way a sysmodule reading .text would (default: */
+/*                                             the whole dump at once) */
+/* Exits with 2 if no unique signature could be derived, or if it doesn't find exactly one hook site in every other dump */
+#include "../../usb_mitm/source/interval_patch.hpp"
+#include "../../usb_mitm/source/signature_scan.hpp"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    using namespace usb::patch;
+
+    static constexpr size_t MaxReportedMatches = 16;
+
+    /* The derived signature starts out at this many words and stops growing at MaxDerivedWords */
+    static constexpr size_t MinSignatureWords = 4;
+    static constexpr size_t MaxDerivedWords = 32;
+
+    static constexpr size_t MaxOtherDumps = 16;
+
+    struct Options
+    {
+        uint64_t mIterations = 100;
+        size_t mChunkSize = 0;
+        const char* pOtherDumps[MaxOtherDumps];
+        size_t mNumOtherDumps = 0;
+    };
+
+    bool ParseOptions(int argc, char** argv, Options* pOptions)
+    {
+        for (int i = 2; i < argc; i++)
+        {
+            if (i + 1 >= argc)
+                return false;
+
+            if (std::strcmp(argv[i], "--iterations") == 0)
+                pOptions->mIterations = std::strtoull(argv[++i], nullptr, 0);
+            else if (std::strcmp(argv[i], "--chunk") == 0)
+                pOptions->mChunkSize = std::strtoull(argv[++i], nullptr, 0);
+            else if (std::strcmp(argv[i], "--against") == 0 && pOptions->mNumOtherDumps < MaxOtherDumps)
+                pOptions->pOtherDumps[pOptions->mNumOtherDumps++] = argv[++i];
+            else
+                return false;
+        }
+
+        return pOptions->mIterations != 0
+            && (pOptions->mChunkSize == 0 || (pOptions->mChunkSize % sizeof(uint32_t) == 0 && pOptions->mChunkSize > MaxDerivedWords * sizeof(uint32_t)));
+    }
+
+    bool ReadDump(const char* pPath, std::vector<uint8_t>* pOut)
+    {
+        FILE* pFile = std::fopen(pPath, "rb");
+        if (pFile == nullptr)
+        {
+            std::fprintf(stderr, "Unable to open %s\n", pPath);
+            return false;
+        }
+
+        uint8_t Buffer[64 * 1024];
+        size_t Read;
+        while ((Read = std::fread(Buffer, 1, sizeof(Buffer), pFile)) != 0)
+        {
+            pOut->insert(pOut->end(), Buffer, Buffer + Read);
+        }
+        std::fclose(pFile);
+        return true;
+    }
+
+    uint32_t LoadWord(const std::vector<uint8_t>& Text, size_t Offset)
+    {
+        uint32_t Word;
+        std::memcpy(&Word, Text.data() + Offset, sizeof(Word));
+        return Word;
+    }
+
+    /* Consecutive chunks overlap by all but one word of the signature, so no match is lost or reported twice */
+    size_t Scan(const std::vector<uint8_t>& Text, const Signature& signature, size_t ChunkSize, uint32_t* pMatches, size_t MaxMatches)
+    {
+        if (ChunkSize == 0)
+            return FindSignature(Text.data(), Text.size(), 0, signature, pMatches, MaxMatches);
+
+        const size_t Overlap = (signature.mNumWords - 1) * sizeof(uint32_t);
+        size_t NumMatches = 0;
+        for (size_t Position = 0; Position + Overlap < Text.size(); Position += ChunkSize - Overlap)
+        {
+            const size_t Size = std::min(ChunkSize, Text.size() - Position);
+            const size_t Remaining = NumMatches < MaxMatches ? MaxMatches - NumMatches : 0;
+            NumMatches += FindSignature(Text.data() + Position, Size, static_cast<uint32_t>(Position), signature, pMatches + (MaxMatches - Remaining), Remaining);
+        }
+        return NumMatches;
+    }
+
+    /* Fields of an instruction that change whenever code moves, everything else has to match */
+    uint32_t GetStableMask(uint32_t Instruction)
+    {
+        /* b and bl, imm26 */
+        if ((Instruction & 0x7C000000) == 0x14000000)
+            return 0xFC000000;
+        /* adrp, immlo and immhi */
+        if ((Instruction & 0x9F000000) == 0x90000000)
+            return 0x9F00001F;
+        return 0xFFFFFFFF;
+    }
+
+    /* Grows a window of words around Offset, alternating between the next word after and before it, until the window */
+    /* matches only at Offset. Returns the number of words written to pWords, 0 if no window up to MaxDerivedWords is unique */
+    size_t DeriveSignature(const std::vector<uint8_t>& Text, uint32_t Offset, SignatureWord* pWords, size_t* pTargetIndex)
+    {
+        const size_t TextWords = Text.size() / sizeof(uint32_t);
+        const size_t Target = Offset / sizeof(uint32_t);
+        size_t First = Target;
+        size_t End = Target + 1;
+
+        while (End - First <= MaxDerivedWords)
+        {
+            if (End - First >= MinSignatureWords)
+            {
+                for (size_t i = First; i < End; i++)
+                {
+                    const uint32_t Word = LoadWord(Text, i * sizeof(uint32_t));
+                    const uint32_t Mask = i == Target ? 0xFFFFFFFF : GetStableMask(Word);
+                    pWords[i - First] = (SignatureWord){ .mValue = Word & Mask, .mMask = Mask };
+                }
+
+                const Signature Candidate = { .mWords = pWords, .mNumWords = End - First, .mTargetIndex = Target - First };
+                uint32_t Match;
+                if (FindSignature(Text.data(), Text.size(), 0, Candidate, &Match, 1) == 1)
+                {
+                    *pTargetIndex = Candidate.mTargetIndex;
+                    return Candidate.mNumWords;
+                }
+            }
+
+            /* Prefer words after the hook, they are the rest of the same basic block */
+            if (End < TextWords && (End - Target - 1 <= Target - First || First == 0))
+                End++;
+            else if (First != 0)
+                First--;
+            else
+                break;
+        }
+        return 0;
+    }
+
+    void PrintSignature(const Signature& signature)
+    {
+        std::printf("signature, %zu words, mTargetIndex = %zu:\n", signature.mNumWords, signature.mTargetIndex);
+        for (size_t i = 0; i < signature.mNumWords; i++)
+        {
+            std::printf(
+                "        { .mValue = 0x%08" PRIX32 ", .mMask = 0x%08" PRIX32 " },%s\n",
+                signature.mWords[i].mValue, signature.mWords[i].mMask, i == signature.mTargetIndex ? "  /* hooked instruction */" : ""
+            );
+        }
+    }
+
+    /* Returns true if the signature finds exactly one site in the dump and that site holds the displaced instruction */
+    bool CheckAgainst(const char* pPath, const Signature& signature, size_t ChunkSize)
+    {
+        std::vector<uint8_t> Text;
+        if (!ReadDump(pPath, &Text))
+            return false;
+
+        uint32_t Matches[MaxReportedMatches];
+        const size_t NumMatches = Scan(Text, signature, ChunkSize, Matches, MaxReportedMatches);
+        std::printf("%s: %zu match(es) in %zu bytes\n", pPath, NumMatches, Text.size());
+
+        bool IsHookSite = false;
+        for (size_t i = 0; i < std::min(NumMatches, MaxReportedMatches); i++)
+        {
+            IsHookSite = LoadWord(Text, Matches[i]) == g_EndpointDescriptorHook.mDisplacedInstruction;
+            std::printf("  %08" PRIx32 "%s\n", Matches[i], Matches[i] == g_EndpointDescriptorHook.mOffset ? "  (known offset)" : "");
+        }
+        return NumMatches == 1 && IsHookSite;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options Opts;
+    if (argc < 2 || !ParseOptions(argc, argv, &Opts))
+    {
+        std::fprintf(stderr, "Usage: %s <text dump> [--against <text dump>]... [--iterations <n>] [--chunk <bytes>]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> Text;
+    if (!ReadDump(argv[1], &Text))
+        return 1;
+
+    /* The sysmodule places the patch after a guard, aligned, so this slightly overstates the room, see FindCodeCave */
+    const size_t Padding = GetTrailingPadding(Text.data(), Text.size());
+    const size_t MaxPatchSize = MaxPatchInstructions * sizeof(uint32_t);
+    std::printf("%zx bytes of trailing padding, the largest patch takes %zx%s\n", Padding, MaxPatchSize, Padding >= MaxPatchSize ? "" : ", the sysmodule won't patch this build");
+
+    const uint32_t Offset = g_EndpointDescriptorHook.mOffset;
+    if (Offset + sizeof(uint32_t) > Text.size() || LoadWord(Text, Offset) != g_EndpointDescriptorHook.mDisplacedInstruction)
+    {
+        std::printf("known offset %08" PRIx32 " doesn't hold the displaced instruction, this dump isn't of a build we know of\n", Offset);
+        return 2;
+    }
+
+    SignatureWord Words[MaxDerivedWords];
+    size_t TargetIndex = 0;
+    const size_t NumWords = DeriveSignature(Text, Offset, Words, &TargetIndex);
+    if (NumWords == 0)
+    {
+        std::printf("no window of up to %zu words around the known offset is unique\n", MaxDerivedWords);
+        return 2;
+    }
+
+    const Signature Derived = { .mWords = Words, .mNumWords = NumWords, .mTargetIndex = TargetIndex };
+    PrintSignature(Derived);
+
+    bool Passed = true;
+    for (size_t i = 0; i < Opts.mNumOtherDumps; i++)
+    {
+        Passed &= CheckAgainst(Opts.pOtherDumps[i], Derived, Opts.mChunkSize);
+    }
+
+    uint32_t Matches[MaxReportedMatches];
+    const auto Start = std::chrono::steady_clock::now();
+    size_t Total = 0;
+    for (uint64_t i = 0; i < Opts.mIterations; i++)
+    {
+        Total += Scan(Text, Derived, Opts.mChunkSize, Matches, MaxReportedMatches);
+    }
+    const double ElapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - Start).count();
+    std::printf(
+        "scan: %.1fus per pass, %.2f GB/s over %" PRIu64 " passes (%zu)\n",
+        ElapsedUs / Opts.mIterations, (Text.size() * Opts.mIterations) / (ElapsedUs * 1000.0), Opts.mIterations, Total
+    );
+
+    return Passed ? 0 : 2;
+}
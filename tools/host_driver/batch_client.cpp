@@ -0,0 +1,220 @@
+/* Stand-in for a client that uses BatchBufferAsync on the adapter's endpoints (ReadPacketBatch and WritePacketBatch in */
+/* driver_thread.cpp). The URB size of a batch is a guess taken from an unnamed argument, so this checks that batches */
+/* that don't fit that reading get refused without touching the client's memory, and that every URB of a write batch */
+/* reaches the adapter, in order. Single writes that the adapter can't take in full get refused as well */
+/* This is a host-side tool, build and run it with: */
+/*     make -C tools/host_driver run-batch_client */
+/* Exits with 2 if any check failed */
+#include <stratosphere.hpp>
+#include "../../usb_mitm/source/driver_thread.hpp"
+#include "../../usb_mitm/source/usb_backend.hpp"
+#include "../../usb_mitm/source/trace.hpp"
+#include "../../usb_mitm/source/capture.hpp"
+#include "shim/host_process.hpp"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace usb::gc;
+
+    static constexpr u64 ClientBase = 0x80000000;
+    static constexpr size_t ClientSize = 4 * ams::os::MemoryPageSize;
+    static constexpr u64 BatchBuffer = ClientBase + 0x100;
+
+    /* What HID opens the adapter's endpoints with */
+    static constexpr EndpointLimits Limits = { .mMaxUrbCount = 8, .mMaxXferSize = 0x40 };
+
+    static constexpr size_t RumblePacketSize = 5;
+    static constexpr u8 SentinelByte = 0xCD;
+
+    u64 g_Failures;
+
+    void Check(bool Condition, const char* pWhat)
+    {
+        if (!Condition)
+        {
+            std::fprintf(stderr, "FAILED: %s\n", pWhat);
+            g_Failures++;
+        }
+    }
+
+    void FillSentinel(Handle Client)
+    {
+        std::vector<u8> Sentinel(ams::os::MemoryPageSize, SentinelByte);
+        usb::host::WriteClientMemory(Client, BatchBuffer, Sentinel.data(), Sentinel.size());
+    }
+
+    bool IsSentinelIntact(Handle Client)
+    {
+        std::vector<u8> Data(ams::os::MemoryPageSize);
+        usb::host::ReadClientMemory(Client, BatchBuffer, Data.data(), Data.size());
+        for (u8 Byte : Data)
+        {
+            if (Byte != SentinelByte)
+                return false;
+        }
+        return true;
+    }
+
+    /* Waits for the driver thread to put Count packets on the wire, the adapter's initialization packet doesn't count */
+    std::vector<backend::SimulatedWrite> TakeWrites(size_t Count)
+    {
+        std::vector<backend::SimulatedWrite> Writes;
+        const auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (Writes.size() < Count && std::chrono::steady_clock::now() < Deadline)
+        {
+            backend::SimulatedWrite Taken[backend::SimulatedWriteLogLength];
+            const u32 NumTaken = backend::TakeSimulatedWrites(0, Taken, std::size(Taken));
+            for (u32 i = 0; i < NumTaken; i++)
+            {
+                if (Taken[i].mSize != 1)
+                    Writes.push_back(Taken[i]);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        /* Anything past what was expected would show up here */
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        backend::SimulatedWrite Extra[backend::SimulatedWriteLogLength];
+        const u32 NumExtra = backend::TakeSimulatedWrites(0, Extra, std::size(Extra));
+        for (u32 i = 0; i < NumExtra; i++)
+        {
+            if (Extra[i].mSize != 1)
+                Writes.push_back(Extra[i]);
+        }
+        return Writes;
+    }
+
+    void CheckReads(Handle Client)
+    {
+        UsbHsXferReport Reports[g_MaxBatchUrbs];
+        u64 Cursor = 0;
+
+        FillSentinel(Client);
+        Check(ReadPacketBatch(0, Limits, BatchBuffer, 4, AdapterPacketSize, &Cursor, Reports), "read batch of 4 packet sized URBs");
+        u8 Data[4 * AdapterPacketSize];
+        usb::host::ReadClientMemory(Client, BatchBuffer, Data, sizeof(Data));
+        bool AllPackets = true;
+        for (u32 i = 0; i < 4; i++)
+        {
+            AllPackets &= Data[i * AdapterPacketSize] == 0x21 && Reports[i].transferredSize == AdapterPacketSize;
+        }
+        Check(AllPackets, "every URB of the read batch holds a packet");
+
+        /* Batches that don't fit the URB size reading of unk1 */
+        const struct
+        {
+            u64 mBuffer;
+            u32 mUrbCount;
+            u32 mUrbSize;
+            const char* pWhat;
+        } Invalid[] = {
+            { BatchBuffer, 4, 0, "read batch with a URB size of 0 is refused" },
+            { BatchBuffer, 4, 8, "read batch with URBs smaller than a packet is refused" },
+            { BatchBuffer, 4, Limits.mMaxXferSize + 1, "read batch with URBs larger than the endpoint's transfer size is refused" },
+            { BatchBuffer, 0, AdapterPacketSize, "read batch without URBs is refused" },
+            { BatchBuffer, Limits.mMaxUrbCount + 1u, AdapterPacketSize, "read batch with more URBs than the endpoint was opened for is refused" },
+            { ClientBase + ClientSize - AdapterPacketSize, 2, AdapterPacketSize, "read batch running past the client's memory is refused" },
+            { ClientBase - 0x1000, 1, AdapterPacketSize, "read batch outside the client's memory is refused" },
+        };
+
+        for (const auto& Batch : Invalid)
+        {
+            FillSentinel(Client);
+            const bool Accepted = ReadPacketBatch(0, Limits, Batch.mBuffer, Batch.mUrbCount, Batch.mUrbSize, &Cursor, Reports);
+            Check(!Accepted && IsSentinelIntact(Client), Batch.pWhat);
+        }
+    }
+
+    void CheckWrites(Handle Client)
+    {
+        UsbHsXferReport Reports[g_MaxBatchUrbs];
+
+        /* Rumble port 1 on, then every port, then back to port 1 only, each of them has to reach the adapter */
+        const u8 Packets[3][RumblePacketSize] = {
+            { 0x11, 1, 0, 0, 0 },
+            { 0x11, 1, 1, 1, 1 },
+            { 0x11, 1, 0, 0, 0 },
+        };
+        usb::host::WriteClientMemory(Client, BatchBuffer, Packets, sizeof(Packets));
+        Check(WritePacketBatch(0, Limits, BatchBuffer, 3, RumblePacketSize, Reports), "write batch of 3 rumble packets");
+        Check(Reports[2].requestedSize == RumblePacketSize && Reports[2].transferredSize == RumblePacketSize, "write batch reports the URB size");
+
+        const std::vector<backend::SimulatedWrite> Writes = TakeWrites(3);
+        bool InOrder = Writes.size() == 3;
+        for (size_t i = 0; InOrder && i < 3; i++)
+        {
+            InOrder = Writes[i].mSize == RumblePacketSize && std::memcmp(Writes[i].mData, Packets[i], RumblePacketSize) == 0;
+        }
+        Check(InOrder, "every URB of the write batch reaches the adapter, in order");
+
+        /* A single write after the batch goes out after all of it */
+        const u8 Off[RumblePacketSize] = { 0x11, 0, 0, 0, 0 };
+        usb::host::WriteClientMemory(Client, BatchBuffer, Off, sizeof(Off));
+        UsbHsXferReport Report;
+        WritePacket(0, BatchBuffer, sizeof(Off), &Report);
+        const std::vector<backend::SimulatedWrite> After = TakeWrites(1);
+        Check(After.size() == 1 && std::memcmp(After[0].mData, Off, sizeof(Off)) == 0, "single write after a batch reaches the adapter");
+        Check(Report.requestedSize == sizeof(Off) && Report.transferredSize == sizeof(Off), "single write reports its own size");
+
+        /* A packet larger than the adapter takes is refused rather than cut short */
+        u8 Oversized[17] = { 0x11, 1, 1, 1, 1 };
+        usb::host::WriteClientMemory(Client, BatchBuffer, Oversized, sizeof(Oversized));
+        Check(!WritePacket(0, BatchBuffer, sizeof(Oversized), &Report), "single write larger than the adapter takes is refused");
+
+        const struct
+        {
+            u32 mUrbCount;
+            u32 mUrbSize;
+            const char* pWhat;
+        } Invalid[] = {
+            { 2, 0, "write batch with a URB size of 0 is refused" },
+            { 2, 17, "write batch with packets larger than the adapter takes is refused" },
+            { 0, RumblePacketSize, "write batch without URBs is refused" },
+            { Limits.mMaxUrbCount + 1u, RumblePacketSize, "write batch with more URBs than the endpoint was opened for is refused" },
+        };
+
+        for (const auto& Batch : Invalid)
+        {
+            Check(!WritePacketBatch(0, Limits, BatchBuffer, Batch.mUrbCount, Batch.mUrbSize, Reports), Batch.pWhat);
+        }
+        Check(!WritePacketBatch(0, Limits, ClientBase + ClientSize, 1, RumblePacketSize, Reports), "write batch outside the client's memory is refused");
+        Check(TakeWrites(0).empty(), "refused write batches put nothing on the wire");
+    }
+}
+
+int main()
+{
+    usb::trace::Initialize();
+    usb::capture::Initialize();
+    Initialize();
+
+    const Handle Client = usb::host::CreateClientProcess(ClientBase, ClientSize);
+    const UsbHsInterface Interface = {};
+    ProxyInterface Proxy;
+    AMS_ABORT_UNLESS(OpenInterface(Client, usb::host::CreateInterfaceSession(), &Interface, &Proxy));
+
+    /* Wait for the generator to produce a few packets, which can take a while on a busy host */
+    const auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    AdapterPacketHistoryEntry Entries[4];
+    u64 Cursor;
+    while (GetAdapterPacketHistoryForUsbGc(0, 0, Entries, std::size(Entries), &Cursor) < std::size(Entries) && std::chrono::steady_clock::now() < Deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    CheckReads(Client);
+    CheckWrites(Client);
+    std::printf("batch client checks: %s\n", g_Failures == 0 ? "passed" : "FAILED");
+
+    /* The driver thread never returns, so leave without running any destructors under it */
+    std::fflush(stdout);
+    std::fflush(stderr);
+    std::_Exit(g_Failures == 0 ? 0 : 2);
+}
@@ -0,0 +1,118 @@
+/* Checks the cursors handed out by PacketHistoryRing (adapter_packet.hpp), in particular that a cursor a client kept from */
+/* the adapter that used to be in a slot never picks up where it left off in the stream of the adapter now in that slot */
+/* This is a host-side tool, build and run it with: */
+/*     make -C tools/host_driver run-history_ring_test */
+/* Exits with 2 if any check failed */
+#include <stratosphere.hpp>
+#include "../../usb_mitm/source/adapter_packet.hpp"
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+namespace
+{
+    using namespace usb::gc;
+
+    static constexpr size_t Capacity = 8;
+    using Ring = PacketHistoryRing<Capacity>;
+
+    u64 g_Failures;
+
+    void Check(bool Condition, const char* pWhat)
+    {
+        if (!Condition)
+        {
+            std::fprintf(stderr, "FAILED: %s\n", pWhat);
+            g_Failures++;
+        }
+    }
+
+    /* The first data byte tells which adapter a sample came from */
+    void PushSamples(Ring* pRing, u8 Adapter, size_t Count)
+    {
+        u8 Data[AdapterPacketSize] = { Adapter };
+        for (size_t i = 0; i < Count; i++)
+        {
+            pRing->Push(i, (UsbHsXferReport){ .transferredSize = AdapterPacketSize }, Data);
+        }
+    }
+
+    bool AllFrom(const AdapterPacketHistoryEntry* pEntries, size_t Count, u8 Adapter)
+    {
+        for (size_t i = 0; i < Count; i++)
+        {
+            if (pEntries[i].mData[0] != Adapter)
+                return false;
+        }
+        return true;
+    }
+
+    void CheckCursors()
+    {
+        auto pRing = std::make_unique<Ring>();
+        AdapterPacketHistoryEntry Entries[Capacity];
+        u64 Cursor;
+
+        /* A client follows the first adapter for a while */
+        pRing->Reset();
+        PushSamples(pRing.get(), 1, 5);
+        size_t Count = pRing->ReadSince(0, Entries, Capacity, &Cursor);
+        Check(Count == 5 && Entries[0].mSequence == 1 && Entries[4].mSequence == 5, "read every sample from the start");
+        Check(Cursor != 0, "cursor after a read is never 0");
+        Check(pRing->ReadSince(Cursor, Entries, Capacity, &Cursor) == 0, "nothing new after catching up");
+
+        /* The adapter is unplugged and another one takes the slot. It has produced fewer samples than the client had seen, */
+        /* so a bare sequence number would read as "nothing new yet" */
+        const u64 StaleCursor = Cursor;
+        pRing->Reset();
+        PushSamples(pRing.get(), 2, 3);
+        Count = pRing->ReadSince(StaleCursor, Entries, Capacity, &Cursor);
+        Check(Count == 3 && Entries[0].mSequence == 1 && AllFrom(Entries, Count, 2), "stale cursor restarts from the new adapter's oldest sample");
+
+        /* Once it has produced more samples than that, a bare sequence number would skip some and mix in nothing of the old */
+        /* adapter, but the newest ones must still come back in full */
+        pRing->Reset();
+        PushSamples(pRing.get(), 3, 7);
+        Count = pRing->ReadSince(StaleCursor, Entries, Capacity, &Cursor);
+        Check(Count == 7 && Entries[0].mSequence == 1 && AllFrom(Entries, Count, 3), "stale cursor with a longer new stream reads all of it");
+
+        /* A batched read only wants the newest few, whatever the cursor belonged to */
+        pRing->Reset();
+        PushSamples(pRing.get(), 4, 6);
+        Cursor = pRing->LimitBacklog(StaleCursor, 2);
+        Count = pRing->ReadSince(Cursor, Entries, Capacity, &Cursor);
+        Check(Count == 2 && Entries[0].mSequence == 5 && Entries[1].mSequence == 6 && AllFrom(Entries, Count, 4), "stale cursor limited to the newest samples");
+
+        /* A current cursor is left alone when it is within the backlog, and moved up when it is not */
+        const u64 Current = Cursor;
+        PushSamples(pRing.get(), 4, 1);
+        Check(pRing->LimitBacklog(Current, 2) == Current, "current cursor within the backlog is kept");
+        PushSamples(pRing.get(), 4, 4);
+        Cursor = pRing->LimitBacklog(Current, 2);
+        Count = pRing->ReadSince(Cursor, Entries, Capacity, &Cursor);
+        Check(Count == 2 && Entries[0].mSequence == 10 && Entries[1].mSequence == 11, "current cursor behind the backlog is moved up");
+
+        /* The ring laps the client, the samples it missed show up as a gap */
+        PushSamples(pRing.get(), 4, Capacity + 3);
+        Count = pRing->ReadSince(Cursor, Entries, Capacity, &Cursor);
+        Check(Count == Capacity && Entries[0].mSequence == 11 + 4, "lapped client gets the oldest sample still in the ring");
+
+        /* The generation wraps around without ever producing cursor 0 */
+        for (u32 i = 0; i < UINT16_MAX + 2; i++)
+        {
+            pRing->Reset();
+            pRing->ReadSince(0, Entries, Capacity, &Cursor);
+            if (Cursor == 0)
+                break;
+        }
+        Check(Cursor != 0, "generation wraps around without handing out cursor 0");
+    }
+}
+
+int main()
+{
+    CheckCursors();
+    std::printf("history ring checks: %s\n", g_Failures == 0 ? "passed" : "FAILED");
+    return g_Failures == 0 ? 0 : 2;
+}
@@ -0,0 +1,363 @@
+/* Runs the driver core (driver_thread.cpp) on a Linux machine against the simulated adapter backend, with a stand-in for HID */
+/* polling it the way it does on the console, so throughput, wake latency and the behaviour of the driver under concurrent */
+/* usb:gc readers can be measured without a Switch. The libnx and stratosphere calls are served by the shims in shim/ */
+/* This is a host-side tool, build and run it with: */
+/*     make -C tools/host_driver run ARGS="<options>" */
+/* Usage: */
+/*     host_driver [options] */
+/*         --adapters <n>          Number of simulated adapters to open (default 1) */
+/*         --duration-ms <ms>      How long to run for (default 3000) */
+/*         --hid-poll-us <us>      Interval at which the stand-in for HID fetches packets from each adapter (default 1000) */
+/*         --readers <n>           Number of threads reading the packet history the way usb:gc clients do (default 1) */
+/*         --mode latest|latch     Delivery mode, as set with usb:gc SetAdapterDeliveryMode (default latest) */
+/*         --one-core              Run every thread on a single core, like the sysmodule does on the console */
+/* Exits with 2 if HID was handed a broken packet, a history reader saw samples out of order, or an adapter stopped producing */
+#include <stratosphere.hpp>
+#include "../../usb_mitm/source/driver_thread.hpp"
+#include "../../usb_mitm/source/usb_backend.hpp"
+#include "../../usb_mitm/source/trace.hpp"
+#include "../../usb_mitm/source/capture.hpp"
+#include "shim/host_process.hpp"
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <sched.h>
+
+namespace
+{
+    using namespace usb::gc;
+
+    struct Options
+    {
+        u32 mAdapters = 1;
+        u64 mDurationMs = 3000;
+        u64 mHidPollUs = 1000;
+        u32 mReaders = 1;
+        DeliveryMode mMode = DeliveryMode::Latest;
+        bool mOneCore = false;
+    };
+
+    /* Where the stand-in for HID keeps its transfer buffers, one page per adapter */
+    static constexpr u64 ClientBase = 0x80000000;
+    static constexpr size_t ClientSize = 16 * ams::os::MemoryPageSize;
+    static constexpr u64 ReadBufferOffset = 0x000;
+    static constexpr u64 WriteBufferOffset = 0x800;
+
+    /* Packets HID writes, the rumble packet with every port off or on */
+    static constexpr size_t RumblePacketSize = 5;
+
+    struct HidResults
+    {
+        u64 mFetches = 0;
+        u64 mFetchesWithPacket = 0;
+        u64 mBrokenPackets = 0;
+        u64 mPresses = 0;
+        u64 mWrites = 0;
+        u64 mFailedWrites = 0;
+    };
+
+    struct ReaderResults
+    {
+        u64 mEntries = 0;
+        u64 mSkipped = 0;
+        u64 mOutOfOrder = 0;
+        u64 mBrokenPackets = 0;
+    };
+
+    std::atomic<bool> g_Stop;
+
+    void RunHid(const Options& Opts, Handle Client, u32 id, HidResults* pOut)
+    {
+        const u64 ReadBuffer = ClientBase + id * ams::os::MemoryPageSize + ReadBufferOffset;
+        const u64 WriteBuffer = ClientBase + id * ams::os::MemoryPageSize + WriteBufferOffset;
+        const size_t ButtonsOffset = packet::PortOffset(0) + packet::PortButtonsOffset;
+
+        bool WasPressed = false;
+        auto Next = std::chrono::steady_clock::now();
+        while (!g_Stop.load(std::memory_order_relaxed))
+        {
+            Next += std::chrono::microseconds(Opts.mHidPollUs);
+            std::this_thread::sleep_until(Next);
+
+            UsbHsXferReport Report;
+            u8 Packet[AdapterPacketSize];
+            ReadPacket(id, ReadBuffer, AdapterPacketSize, &Report);
+            usb::host::ReadClientMemory(Client, ReadBuffer, Packet, sizeof(Packet));
+            pOut->mFetches++;
+
+            /* Until the first read completes HID is handed zeroes, after that every packet must be a full input report */
+            if (Packet[0] == 0 && pOut->mFetchesWithPacket == 0)
+                continue;
+
+            pOut->mFetchesWithPacket++;
+            if (Packet[0] != 0x21 || Report.res != 0 || Report.transferredSize != AdapterPacketSize)
+            {
+                pOut->mBrokenPackets++;
+                continue;
+            }
+
+            const bool IsPressed = (Packet[ButtonsOffset] & 0x01) != 0;
+            if (IsPressed && !WasPressed)
+                pOut->mPresses++;
+            WasPressed = IsPressed;
+
+            /* HID resends the same rumble state far more often than it changes it */
+            if (pOut->mFetches % 16 == 0)
+            {
+                const u8 Rumble = static_cast<u8>((pOut->mFetches / 256) & 1);
+                const u8 RumblePacket[RumblePacketSize] = { 0x11, Rumble, Rumble, Rumble, Rumble };
+                usb::host::WriteClientMemory(Client, WriteBuffer, RumblePacket, sizeof(RumblePacket));
+
+                WritePacket(id, WriteBuffer, sizeof(RumblePacket), &Report);
+                pOut->mWrites++;
+                if (Report.res != 0)
+                    pOut->mFailedWrites++;
+            }
+        }
+    }
+
+    void RunHistoryReader(const Options& Opts, ReaderResults* pOut)
+    {
+        std::vector<u64> Cursors(Opts.mAdapters, 0);
+        std::vector<u64> LastSequences(Opts.mAdapters, 0);
+        AdapterPacketHistoryEntry Entries[16];
+
+        while (!g_Stop.load(std::memory_order_relaxed))
+        {
+            for (u32 id = 0; id < Opts.mAdapters; id++)
+            {
+                const size_t NumEntries = GetAdapterPacketHistoryForUsbGc(id, Cursors[id], Entries, std::size(Entries), &Cursors[id]);
+                for (size_t i = 0; i < NumEntries; i++)
+                {
+                    const AdapterPacketHistoryEntry& Entry = Entries[i];
+                    pOut->mEntries++;
+                    if (Entry.mSequence <= LastSequences[id])
+                        pOut->mOutOfOrder++;
+                    else
+                        pOut->mSkipped += Entry.mSequence - LastSequences[id] - 1;
+                    LastSequences[id] = Entry.mSequence;
+
+                    if (Entry.mData[0] != 0x21)
+                        pOut->mBrokenPackets++;
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    void PrintSummary(const char* pName, const stats::LatencySummary& Summary)
+    {
+        std::printf(
+            "  %-18s count=%" PRIu64 "  p50=%.3fms  p99=%.3fms  max=%.3fms\n",
+            pName, Summary.mCount, Summary.mP50Ns / 1e6, Summary.mP99Ns / 1e6, Summary.mMaxNs / 1e6
+        );
+    }
+
+    bool ParseOptions(int argc, char** argv, Options* pOpts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char* pArg = argv[i];
+            if (std::strcmp(pArg, "--one-core") == 0)
+            {
+                pOpts->mOneCore = true;
+                continue;
+            }
+
+            const char* pValue = i + 1 < argc ? argv[i + 1] : nullptr;
+            if (pValue == nullptr)
+                return false;
+            i++;
+
+            if (std::strcmp(pArg, "--adapters") == 0)
+            {
+                pOpts->mAdapters = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+                if (pOpts->mAdapters == 0 || pOpts->mAdapters > ClientSize / ams::os::MemoryPageSize)
+                    return false;
+            }
+            else if (std::strcmp(pArg, "--duration-ms") == 0)
+            {
+                pOpts->mDurationMs = std::strtoull(pValue, nullptr, 10);
+                if (pOpts->mDurationMs == 0)
+                    return false;
+            }
+            else if (std::strcmp(pArg, "--hid-poll-us") == 0)
+            {
+                pOpts->mHidPollUs = std::strtoull(pValue, nullptr, 10);
+                if (pOpts->mHidPollUs == 0)
+                    return false;
+            }
+            else if (std::strcmp(pArg, "--readers") == 0)
+            {
+                pOpts->mReaders = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+            }
+            else if (std::strcmp(pArg, "--mode") == 0)
+            {
+                if (std::strcmp(pValue, "latest") == 0)
+                    pOpts->mMode = DeliveryMode::Latest;
+                else if (std::strcmp(pValue, "latch") == 0)
+                    pOpts->mMode = DeliveryMode::LatchPresses;
+                else
+                    return false;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int Run(const Options& Opts)
+    {
+        if (Opts.mOneCore)
+        {
+            cpu_set_t Set;
+            CPU_ZERO(&Set);
+            CPU_SET(sched_getcpu(), &Set);
+            if (sched_setaffinity(0, sizeof(Set), &Set) != 0)
+                std::fprintf(stderr, "Unable to pin to a single core, running unpinned\n");
+        }
+
+        usb::trace::Initialize();
+        usb::capture::Initialize();
+        Initialize();
+
+        const Handle Client = usb::host::CreateClientProcess(ClientBase, ClientSize);
+        for (u32 id = 0; id < Opts.mAdapters; id++)
+        {
+            const UsbHsInterface Interface = {};
+            ProxyInterface Proxy;
+            if (!OpenInterface(Client, usb::host::CreateInterfaceSession(), &Interface, &Proxy))
+            {
+                std::fprintf(stderr, "Unable to open adapter %u\n", id);
+                return 1;
+            }
+            AMS_ABORT_UNLESS(Proxy.mId == id);
+            AMS_ABORT_UNLESS(SetAdapterDeliveryMode(id, Opts.mMode));
+        }
+
+        std::vector<HidResults> Hid(Opts.mAdapters);
+        std::vector<ReaderResults> Readers(Opts.mReaders);
+        std::vector<std::thread> Threads;
+        for (u32 id = 0; id < Opts.mAdapters; id++)
+        {
+            Threads.emplace_back(RunHid, std::cref(Opts), Client, id, &Hid[id]);
+        }
+        for (u32 i = 0; i < Opts.mReaders; i++)
+        {
+            Threads.emplace_back(RunHistoryReader, std::cref(Opts), &Readers[i]);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(Opts.mDurationMs));
+        g_Stop.store(true, std::memory_order_relaxed);
+        for (std::thread& Thread : Threads)
+        {
+            Thread.join();
+        }
+
+        bool Failed = false;
+        /* The generator holds A for 100ms of every second, so HID should see about one press per second whatever the mode */
+        const u64 ExpectedPresses = Opts.mDurationMs / 1000;
+        for (u32 id = 0; id < Opts.mAdapters; id++)
+        {
+            AdapterDriverStats Driver;
+            AdapterLatencyStats Latency;
+            AdapterPollingStats Polling;
+            AMS_ABORT_UNLESS(GetAdapterDriverStats(id, &Driver));
+            AMS_ABORT_UNLESS(GetAdapterLatencyStats(id, &Latency));
+            AMS_ABORT_UNLESS(GetAdapterPollingStats(id, &Polling));
+
+            const HidResults& Out = Hid[id];
+            std::printf("adapter %u\n", id);
+            std::printf(
+                "  hid                fetches=%" PRIu64 " (with packet %" PRIu64 ", broken %" PRIu64 ")  presses=%" PRIu64 "  writes=%" PRIu64 " (failed %" PRIu64 ")\n",
+                Out.mFetches, Out.mFetchesWithPacket, Out.mBrokenPackets, Out.mPresses, Out.mWrites, Out.mFailedWrites
+            );
+            std::printf(
+                "  driver             reads=%" PRIu64 " (failed %" PRIu64 ", starved %" PRIu64 ")  writes=%" PRIu64 " (avoided %" PRIu64 ")  write latency max=%.3fms\n",
+                Driver.mReadsCompleted, Driver.mReadsFailed, Driver.mReadStarvedPolls, Driver.mWritesSubmitted, Driver.mWritesAvoided, Driver.mWriteLatencyMaxNs / 1e6
+            );
+            std::printf(
+                "  polling            intervals=%" PRIu64 "  mean=%.3fms  stddev=%.3fms  rate=%.3fhz  longest gap=%.3fms  gaps over 2ms=%" PRIu64 "\n",
+                Polling.mIntervals, Polling.mMeanIntervalNs / 1e6, Polling.mStdDevIntervalNs / 1e6, Polling.mMeanRateMilliHz / 1e3,
+                Polling.mLongestGapNs / 1e6, Polling.mGapsOver2Ms
+            );
+            PrintSummary("wake to publish", Latency.mWakeToPublish);
+            PrintSummary("publish to fetch", Latency.mPublishToFetch);
+            PrintSummary("sample age", Latency.mSampleAge);
+
+            if (Out.mFetchesWithPacket == 0 || Driver.mReadsCompleted == 0)
+            {
+                std::fprintf(stderr, "Adapter %u never produced a packet\n", id);
+                Failed = true;
+            }
+            if (Out.mBrokenPackets != 0 || Out.mFailedWrites != 0 || Driver.mReadsFailed != 0)
+            {
+                std::fprintf(stderr, "Adapter %u handed HID broken packets or failed transfers\n", id);
+                Failed = true;
+            }
+            if (Out.mPresses + 1 < ExpectedPresses)
+            {
+                std::fprintf(stderr, "Adapter %u delivered %" PRIu64 " presses, expected about %" PRIu64 "\n", id, Out.mPresses, ExpectedPresses);
+                Failed = true;
+            }
+        }
+
+        for (u32 i = 0; i < Opts.mReaders; i++)
+        {
+            const ReaderResults& Out = Readers[i];
+            std::printf(
+                "history reader %u    entries=%" PRIu64 "  skipped=%" PRIu64 "  out of order=%" PRIu64 "  broken=%" PRIu64 "\n",
+                i, Out.mEntries, Out.mSkipped, Out.mOutOfOrder, Out.mBrokenPackets
+            );
+            if (Out.mOutOfOrder != 0 || Out.mBrokenPackets != 0)
+            {
+                std::fprintf(stderr, "History reader %u saw samples out of order or broken packets\n", i);
+                Failed = true;
+            }
+        }
+
+        backend::SimulatedStats Simulated;
+        backend::GetSimulatedStats(&Simulated);
+        std::printf("generator          polls=%" PRIu64 "  missed=%" PRIu64 "\n", Simulated.mPolls, Simulated.mMissedPolls);
+        PrintSummary("complete to fetch", Simulated.mCompleteToFetch);
+
+        DriverStats Stats;
+        GetDriverStats(&Stats);
+        usb::host::SvcCounters Svc;
+        usb::host::GetSvcCounters(&Svc);
+        std::printf(
+            "driver             waiter syncs=%" PRIu64 " (max %.3fms)  MapProcessMemory=%" PRIu64 "  UnmapProcessMemory=%" PRIu64 "  cache maintenance=%" PRIu64 "\n",
+            Stats.mWaiterSyncCount, Stats.mWaiterSyncMaxNs / 1e6, Svc.mMapProcessMemory, Svc.mUnmapProcessMemory, Svc.mProcessDataCacheOperations
+        );
+
+        return Failed ? 2 : 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options Opts;
+    if (!ParseOptions(argc, argv, &Opts))
+    {
+        std::fprintf(
+            stderr,
+            "Usage: %s [--adapters <n>] [--duration-ms <ms>] [--hid-poll-us <us>] [--readers <n>] [--mode latest|latch] [--one-core]\n",
+            argv[0]
+        );
+        return 1;
+    }
+
+    /* The driver and generator threads never return, so leave without running any destructors under them */
+    const int ExitCode = Run(Opts);
+    std::fflush(stdout);
+    std::fflush(stderr);
+    std::_Exit(ExitCode);
+}
@@ -0,0 +1,15 @@
+/* Handle table shared by the host shims, see host_os.cpp */
+#pragma once
+#include "switch.h"
+
+namespace usb::host::kernel
+{
+    /* Creates an event object and returns a handle to it, the event stays alive until every handle to it is closed */
+    Handle CreateEvent();
+
+    /* Returns a second handle to the same object, the way a handle copied over IPC is */
+    Handle DuplicateHandle(Handle handle);
+
+    /* Signals an event object, returns false if the handle isn't one */
+    bool SignalEvent(Handle handle);
+}
@@ -0,0 +1,833 @@
+/* Host implementation of the libnx and libstratosphere calls the driver core makes, see host_driver.cpp */
+/* Every kernel object lives in one handle table guarded by a single lock, which is also what waits sleep on. That is far */
+/* coarser than the real kernel, but it keeps the semantics the driver relies on (manual reset, WaitAny not clearing, */
+/* handles being separate references to an object) easy to check */
+#include <stratosphere.hpp>
+#include "host_kernel.hpp"
+#include "host_process.hpp"
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <cerrno>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    using namespace ams::literals;
+
+    struct KObject
+    {
+        virtual ~KObject() = default;
+    };
+
+    struct KEvent : KObject
+    {
+        bool mSignaled = false;
+    };
+
+    /* Client memory is a memfd, each page of the process points at a page sized slice of it */
+    struct KProcess : KObject
+    {
+        int mFd = -1;
+        u64 mBaseAddress = 0;
+        size_t mSize = 0;
+        std::vector<off_t> mPageOffsets;
+        off_t mFileSize = 0;
+
+        ~KProcess() override
+        {
+            close(mFd);
+        }
+
+        bool Contains(u64 Address, size_t Size) const
+        {
+            return Address >= mBaseAddress && Size <= mSize && Address - mBaseAddress <= mSize - Size;
+        }
+
+        off_t PageOffset(u64 Address) const
+        {
+            return mPageOffsets[(Address - mBaseAddress) / ams::os::MemoryPageSize];
+        }
+    };
+
+    struct KSharedMemory : KObject
+    {
+        void* mpMemory = nullptr;
+
+        ~KSharedMemory() override
+        {
+            std::free(mpMemory);
+        }
+    };
+
+    std::mutex g_KernelMutex;
+    std::condition_variable g_KernelCondition;
+    std::unordered_map<Handle, std::shared_ptr<KObject>> g_Handles;
+    Handle g_NextHandle = 0x100;
+
+    /* Address space the driver's transfer window gets placed in. It is reported as free to QueryMemory and never reused */
+    static constexpr size_t g_TransferReserveSize = 1_MB;
+    uintptr_t g_TransferReserve;
+
+    struct MappedPage
+    {
+        std::shared_ptr<KProcess> mProcess;
+        u64 mSourcePage;
+        off_t mOffset;
+    };
+
+    std::map<uintptr_t, MappedPage> g_MappedPages;
+    usb::host::SvcCounters g_SvcCounters;
+
+    /* Must be called with g_KernelMutex held */
+    Handle InsertHandle(std::shared_ptr<KObject> object)
+    {
+        const Handle handle = g_NextHandle++;
+        g_Handles.emplace(handle, std::move(object));
+        return handle;
+    }
+
+    /* Must be called with g_KernelMutex held */
+    template<typename T>
+    std::shared_ptr<T> LookupHandle(Handle handle)
+    {
+        auto it = g_Handles.find(handle);
+        return it == g_Handles.end() ? nullptr : std::dynamic_pointer_cast<T>(it->second);
+    }
+
+    s64 GetSteadyNanoSeconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::chrono::steady_clock::time_point ToTimePoint(s64 ns)
+    {
+        return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(ns));
+    }
+
+    uintptr_t GetTransferReserve()
+    {
+        if (g_TransferReserve == 0)
+        {
+            void* pReserve = mmap(nullptr, g_TransferReserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            AMS_ABORT_UNLESS(pReserve != MAP_FAILED, "Unable to reserve the transfer window");
+            g_TransferReserve = reinterpret_cast<uintptr_t>(pReserve);
+        }
+        return g_TransferReserve;
+    }
+
+    void ReleasePages(uintptr_t Address, size_t Size)
+    {
+        void* pResult = mmap(reinterpret_cast<void*>(Address), Size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        AMS_ABORT_UNLESS(pResult != MAP_FAILED);
+    }
+
+    bool IsHolderSignaled(const ams::os::MultiWaitHolderType* pHolder)
+    {
+        if (pHolder->mpEvent != nullptr)
+            return pHolder->mpEvent->mSignaled;
+
+        std::shared_ptr<KEvent> pEvent = LookupHandle<KEvent>(pHolder->mHandle);
+        return pEvent != nullptr && pEvent->mSignaled;
+    }
+
+    thread_local ams::os::ThreadType* t_pCurrentThread;
+    ams::os::ThreadType g_MainThread = { nullptr, nullptr, "main", nullptr };
+
+    std::string ResolvePath(const char* pPath)
+    {
+        static constexpr char SdPrefix[] = "sd:/";
+        AMS_ABORT_UNLESS(std::strncmp(pPath, SdPrefix, sizeof(SdPrefix) - 1) == 0, "Only paths on the SD card are supported");
+
+        const char* pRoot = std::getenv("USB_MITM_HOST_SD");
+        return std::string(pRoot != nullptr ? pRoot : ".") + "/" + (pPath + sizeof(SdPrefix) - 1);
+    }
+}
+
+namespace ams::impl
+{
+    void AbortImpl(const char* pFile, int Line, const char* pWhat, const char* pFormat, ...)
+    {
+        std::fprintf(stderr, "%s:%d: abort: %s", pFile, Line, pWhat);
+        if (pFormat != nullptr)
+        {
+            std::va_list args;
+            va_start(args, pFormat);
+            std::fputs(" (", stderr);
+            std::vfprintf(stderr, pFormat, args);
+            std::fputs(")", stderr);
+            va_end(args);
+        }
+        std::fputc('\n', stderr);
+        std::abort();
+    }
+}
+
+/* libnx */
+Result eventCreate(Event* t, bool autoclear)
+{
+    std::scoped_lock lk(g_KernelMutex);
+    std::shared_ptr<KEvent> pEvent = std::make_shared<KEvent>();
+    t->wevent = InsertHandle(pEvent);
+    t->revent = InsertHandle(pEvent);
+    t->autoclear = autoclear;
+    return 0;
+}
+
+void eventClose(Event* t)
+{
+    svcCloseHandle(t->revent);
+    svcCloseHandle(t->wevent);
+    t->revent = INVALID_HANDLE;
+    t->wevent = INVALID_HANDLE;
+}
+
+Result eventFire(Event* t)
+{
+    return usb::host::kernel::SignalEvent(t->wevent) ? 0 : static_cast<u32>(ams::svc::ResultInvalidHandle());
+}
+
+Result eventClear(Event* t)
+{
+    std::scoped_lock lk(g_KernelMutex);
+    std::shared_ptr<KEvent> pEvent = LookupHandle<KEvent>(t->revent);
+    if (pEvent == nullptr)
+        return ams::svc::ResultInvalidHandle();
+
+    pEvent->mSignaled = false;
+    return 0;
+}
+
+Result svcCloseHandle(Handle handle)
+{
+    std::scoped_lock lk(g_KernelMutex);
+    return g_Handles.erase(handle) != 0 ? 0 : static_cast<u32>(ams::svc::ResultInvalidHandle());
+}
+
+void armDCacheClean(void* addr, size_t size)
+{
+    AMS_UNUSED(addr, size);
+}
+
+void armDCacheFlush(void* addr, size_t size)
+{
+    AMS_UNUSED(addr, size);
+}
+
+namespace usb::host::kernel
+{
+    Handle CreateEvent()
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        return InsertHandle(std::make_shared<KEvent>());
+    }
+
+    Handle DuplicateHandle(Handle handle)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        auto it = g_Handles.find(handle);
+        AMS_ABORT_UNLESS(it != g_Handles.end());
+        return InsertHandle(it->second);
+    }
+
+    bool SignalEvent(Handle handle)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KEvent> pEvent = LookupHandle<KEvent>(handle);
+        if (pEvent == nullptr)
+            return false;
+
+        pEvent->mSignaled = true;
+        g_KernelCondition.notify_all();
+        return true;
+    }
+}
+
+namespace usb::host
+{
+    Handle CreateClientProcess(u64 BaseAddress, size_t Size)
+    {
+        AMS_ABORT_UNLESS(BaseAddress % ams::os::MemoryPageSize == 0 && Size % ams::os::MemoryPageSize == 0 && Size != 0);
+
+        std::shared_ptr<KProcess> pProcess = std::make_shared<KProcess>();
+        pProcess->mFd = memfd_create("usb_mitm_client", 0);
+        AMS_ABORT_UNLESS(pProcess->mFd >= 0, "Unable to create the client memory");
+        AMS_ABORT_UNLESS(ftruncate(pProcess->mFd, static_cast<off_t>(Size)) == 0);
+
+        pProcess->mBaseAddress = BaseAddress;
+        pProcess->mSize = Size;
+        pProcess->mFileSize = static_cast<off_t>(Size);
+        for (size_t i = 0; i < Size / ams::os::MemoryPageSize; i++)
+        {
+            pProcess->mPageOffsets.push_back(static_cast<off_t>(i * ams::os::MemoryPageSize));
+        }
+
+        std::scoped_lock lk(g_KernelMutex);
+        return InsertHandle(std::move(pProcess));
+    }
+
+    void ReadClientMemory(Handle process, u64 Address, void* pOut, size_t Size)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KProcess> pProcess = LookupHandle<KProcess>(process);
+        AMS_ABORT_UNLESS(pProcess != nullptr && pProcess->Contains(Address, Size));
+
+        u8* pDst = static_cast<u8*>(pOut);
+        while (Size != 0)
+        {
+            const size_t InPage = ams::os::MemoryPageSize - Address % ams::os::MemoryPageSize;
+            const size_t Chunk = std::min(Size, InPage);
+            AMS_ABORT_UNLESS(pread(pProcess->mFd, pDst, Chunk, pProcess->PageOffset(Address) + static_cast<off_t>(Address % ams::os::MemoryPageSize)) == static_cast<ssize_t>(Chunk));
+            pDst += Chunk;
+            Address += Chunk;
+            Size -= Chunk;
+        }
+    }
+
+    void WriteClientMemory(Handle process, u64 Address, const void* pData, size_t Size)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KProcess> pProcess = LookupHandle<KProcess>(process);
+        AMS_ABORT_UNLESS(pProcess != nullptr && pProcess->Contains(Address, Size));
+
+        const u8* pSrc = static_cast<const u8*>(pData);
+        while (Size != 0)
+        {
+            const size_t InPage = ams::os::MemoryPageSize - Address % ams::os::MemoryPageSize;
+            const size_t Chunk = std::min(Size, InPage);
+            AMS_ABORT_UNLESS(pwrite(pProcess->mFd, pSrc, Chunk, pProcess->PageOffset(Address) + static_cast<off_t>(Address % ams::os::MemoryPageSize)) == static_cast<ssize_t>(Chunk));
+            pSrc += Chunk;
+            Address += Chunk;
+            Size -= Chunk;
+        }
+    }
+
+    void ReplaceClientPages(Handle process, u64 Address, size_t Size)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KProcess> pProcess = LookupHandle<KProcess>(process);
+        AMS_ABORT_UNLESS(pProcess != nullptr && pProcess->Contains(Address, Size));
+
+        const u64 FirstPage = Address & ~(ams::os::MemoryPageSize - 1);
+        for (u64 Page = FirstPage; Page < Address + Size; Page += ams::os::MemoryPageSize)
+        {
+            /* The contents move over, only the backing changes */
+            u8 Contents[ams::os::MemoryPageSize];
+            const off_t OldOffset = pProcess->PageOffset(Page);
+            const off_t NewOffset = pProcess->mFileSize;
+            AMS_ABORT_UNLESS(pread(pProcess->mFd, Contents, sizeof(Contents), OldOffset) == static_cast<ssize_t>(sizeof(Contents)));
+
+            pProcess->mFileSize += static_cast<off_t>(ams::os::MemoryPageSize);
+            AMS_ABORT_UNLESS(ftruncate(pProcess->mFd, pProcess->mFileSize) == 0);
+            AMS_ABORT_UNLESS(pwrite(pProcess->mFd, Contents, sizeof(Contents), NewOffset) == static_cast<ssize_t>(sizeof(Contents)));
+            pProcess->mPageOffsets[(Page - pProcess->mBaseAddress) / ams::os::MemoryPageSize] = NewOffset;
+        }
+    }
+
+    void GetSvcCounters(SvcCounters* pOut)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        *pOut = g_SvcCounters;
+    }
+}
+
+namespace ams::os
+{
+    Tick GetSystemTick()
+    {
+        return Tick(GetSteadyNanoSeconds() * 12 / 625);
+    }
+
+    s64 GetSystemTickFrequency()
+    {
+        return 19'200'000;
+    }
+
+    TimeSpan ConvertToTimeSpan(Tick tick)
+    {
+        return TimeSpan::FromNanoSeconds(tick.GetInt64Value() * 625 / 12);
+    }
+
+    Tick ConvertToTick(TimeSpan ts)
+    {
+        return Tick(ts.GetNanoSeconds() * 12 / 625);
+    }
+
+    void InitializeMutex(MutexType* pMutex, bool IsRecursive, int LockLevel)
+    {
+        AMS_UNUSED(pMutex, IsRecursive, LockLevel);
+    }
+
+    void FinalizeMutex(MutexType* pMutex)
+    {
+        AMS_UNUSED(pMutex);
+    }
+
+    void LockMutex(MutexType* pMutex)
+    {
+        pMutex->mMutex.lock();
+    }
+
+    void UnlockMutex(MutexType* pMutex)
+    {
+        pMutex->mMutex.unlock();
+    }
+
+    void InitializeConditionVariable(ConditionVariableType* pCv)
+    {
+        AMS_UNUSED(pCv);
+    }
+
+    void FinalizeConditionVariable(ConditionVariableType* pCv)
+    {
+        AMS_UNUSED(pCv);
+    }
+
+    void SignalConditionVariable(ConditionVariableType* pCv)
+    {
+        pCv->mConditionVariable.notify_one();
+    }
+
+    void BroadcastConditionVariable(ConditionVariableType* pCv)
+    {
+        pCv->mConditionVariable.notify_all();
+    }
+
+    void WaitConditionVariable(ConditionVariableType* pCv, MutexType* pMutex)
+    {
+        pCv->mConditionVariable.wait(pMutex->mMutex);
+    }
+
+    ConditionVariableStatus TimedWaitConditionVariable(ConditionVariableType* pCv, MutexType* pMutex, TimeSpan timeout)
+    {
+        const std::cv_status status = pCv->mConditionVariable.wait_for(pMutex->mMutex, std::chrono::nanoseconds(timeout.GetNanoSeconds()));
+        return status == std::cv_status::timeout ? ConditionVariableStatus::TimedOut : ConditionVariableStatus::Success;
+    }
+
+    void InitializeEvent(EventType* pEvent, bool Signaled, EventClearMode mode)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        pEvent->mSignaled = Signaled;
+        pEvent->mClearMode = mode;
+    }
+
+    void FinalizeEvent(EventType* pEvent)
+    {
+        AMS_UNUSED(pEvent);
+    }
+
+    void SignalEvent(EventType* pEvent)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        pEvent->mSignaled = true;
+        g_KernelCondition.notify_all();
+    }
+
+    void ClearEvent(EventType* pEvent)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        pEvent->mSignaled = false;
+    }
+
+    void WaitEvent(EventType* pEvent)
+    {
+        std::unique_lock lk(g_KernelMutex);
+        g_KernelCondition.wait(lk, [pEvent] { return pEvent->mSignaled; });
+        if (pEvent->mClearMode == EventClearMode_AutoClear)
+            pEvent->mSignaled = false;
+    }
+
+    bool TryWaitEvent(EventType* pEvent)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        const bool Signaled = pEvent->mSignaled;
+        if (Signaled && pEvent->mClearMode == EventClearMode_AutoClear)
+            pEvent->mSignaled = false;
+        return Signaled;
+    }
+
+    bool TimedWaitEvent(EventType* pEvent, TimeSpan timeout)
+    {
+        std::unique_lock lk(g_KernelMutex);
+        if (!g_KernelCondition.wait_for(lk, std::chrono::nanoseconds(timeout.GetNanoSeconds()), [pEvent] { return pEvent->mSignaled; }))
+            return false;
+
+        if (pEvent->mClearMode == EventClearMode_AutoClear)
+            pEvent->mSignaled = false;
+        return true;
+    }
+
+    void InitializeTimerEvent(TimerEventType* pTimer, EventClearMode mode)
+    {
+        pTimer->mClearMode = mode;
+        pTimer->mNextNs = 0;
+        pTimer->mIntervalNs = 0;
+    }
+
+    void FinalizeTimerEvent(TimerEventType* pTimer)
+    {
+        AMS_UNUSED(pTimer);
+    }
+
+    void StartPeriodicTimerEvent(TimerEventType* pTimer, TimeSpan first, TimeSpan interval)
+    {
+        pTimer->mIntervalNs = interval.GetNanoSeconds();
+        pTimer->mNextNs = GetSteadyNanoSeconds() + first.GetNanoSeconds();
+    }
+
+    void WaitTimerEvent(TimerEventType* pTimer)
+    {
+        /* Periods that passed while nobody waited collapse into one, like a timer event that was already signaled */
+        std::this_thread::sleep_until(ToTimePoint(pTimer->mNextNs));
+        const s64 Now = GetSteadyNanoSeconds();
+        while (pTimer->mNextNs <= Now)
+        {
+            pTimer->mNextNs += pTimer->mIntervalNs;
+        }
+    }
+
+    Result CreateThread(ThreadType* pThread, ThreadFunction function, void* pArgument, void* pStack, size_t StackSize, s32 Priority)
+    {
+        AMS_UNUSED(pStack, StackSize, Priority);
+        *pThread = (ThreadType){ .mFunction = function, .mpArgument = pArgument, .mpName = "", .mpThread = nullptr };
+        R_SUCCEED();
+    }
+
+    Result CreateThread(ThreadType* pThread, ThreadFunction function, void* pArgument, void* pStack, size_t StackSize, s32 Priority, s32 CoreId)
+    {
+        AMS_UNUSED(CoreId);
+        return CreateThread(pThread, function, pArgument, pStack, StackSize, Priority);
+    }
+
+    void SetThreadNamePointer(ThreadType* pThread, const char* pName)
+    {
+        pThread->mpName = pName;
+    }
+
+    void StartThread(ThreadType* pThread)
+    {
+        pThread->mpThread = new std::thread([pThread] {
+            t_pCurrentThread = pThread;
+
+            /* Linux limits names to 15 characters, keep the end since that's the part that differs */
+            const size_t Length = std::strlen(pThread->mpName);
+            pthread_setname_np(pthread_self(), pThread->mpName + (Length > 15 ? Length - 15 : 0));
+
+            pThread->mFunction(pThread->mpArgument);
+        });
+    }
+
+    void WaitThread(ThreadType* pThread)
+    {
+        pThread->mpThread->join();
+    }
+
+    ThreadType* GetCurrentThread()
+    {
+        return t_pCurrentThread != nullptr ? t_pCurrentThread : &g_MainThread;
+    }
+
+    void SleepThread(TimeSpan ts)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ts.GetNanoSeconds()));
+    }
+
+    void InitializeMultiWait(MultiWaitType* pMultiWait)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        pMultiWait->mHolders.clear();
+    }
+
+    void FinalizeMultiWait(MultiWaitType* pMultiWait)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        AMS_ABORT_UNLESS(pMultiWait->mHolders.empty());
+    }
+
+    void InitializeMultiWaitHolder(MultiWaitHolderType* pHolder, EventType* pEvent)
+    {
+        *pHolder = (MultiWaitHolderType){ .mpEvent = pEvent, .mHandle = INVALID_HANDLE, .mUserData = 0, .mpOwner = nullptr };
+    }
+
+    void InitializeMultiWaitHolder(MultiWaitHolderType* pHolder, NativeHandle handle)
+    {
+        *pHolder = (MultiWaitHolderType){ .mpEvent = nullptr, .mHandle = handle, .mUserData = 0, .mpOwner = nullptr };
+    }
+
+    void FinalizeMultiWaitHolder(MultiWaitHolderType* pHolder)
+    {
+        AMS_ABORT_UNLESS(pHolder->mpOwner == nullptr, "Finalizing a wait holder that is still linked");
+    }
+
+    void LinkMultiWaitHolder(MultiWaitType* pMultiWait, MultiWaitHolderType* pHolder)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        AMS_ABORT_UNLESS(pHolder->mpOwner == nullptr);
+        pHolder->mpOwner = pMultiWait;
+        pMultiWait->mHolders.push_back(pHolder);
+    }
+
+    void UnlinkMultiWaitHolder(MultiWaitHolderType* pHolder)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        AMS_ABORT_UNLESS(pHolder->mpOwner != nullptr);
+        std::vector<MultiWaitHolderType*>& Holders = pHolder->mpOwner->mHolders;
+        Holders.erase(std::find(Holders.begin(), Holders.end(), pHolder));
+        pHolder->mpOwner = nullptr;
+    }
+
+    void SetMultiWaitHolderUserData(MultiWaitHolderType* pHolder, uintptr_t UserData)
+    {
+        pHolder->mUserData = UserData;
+    }
+
+    uintptr_t GetMultiWaitHolderUserData(const MultiWaitHolderType* pHolder)
+    {
+        return pHolder->mUserData;
+    }
+
+    MultiWaitHolderType* TimedWaitAny(MultiWaitType* pMultiWait, TimeSpan timeout)
+    {
+        const s64 Deadline = timeout.GetNanoSeconds() < 0 ? std::numeric_limits<s64>::max() : GetSteadyNanoSeconds() + timeout.GetNanoSeconds();
+
+        std::unique_lock lk(g_KernelMutex);
+        AMS_ABORT_UNLESS(pMultiWait->mHolders.size() <= MAX_WAIT_OBJECTS, "Waiting on more objects than the kernel allows");
+        for (const MultiWaitHolderType* pHolder : pMultiWait->mHolders)
+        {
+            AMS_ABORT_UNLESS(pHolder->mpEvent != nullptr || g_Handles.count(pHolder->mHandle) != 0, "Waiting on a closed handle");
+        }
+
+        while (true)
+        {
+            for (MultiWaitHolderType* pHolder : pMultiWait->mHolders)
+            {
+                if (IsHolderSignaled(pHolder))
+                    return pHolder;
+            }
+
+            if (Deadline == std::numeric_limits<s64>::max())
+                g_KernelCondition.wait(lk);
+            else if (g_KernelCondition.wait_until(lk, ToTimePoint(Deadline)) == std::cv_status::timeout)
+                return nullptr;
+        }
+    }
+
+    MultiWaitHolderType* WaitAny(MultiWaitType* pMultiWait)
+    {
+        return TimedWaitAny(pMultiWait, TimeSpan::FromNanoSeconds(-1));
+    }
+
+    Result CreateSharedMemory(SharedMemoryType* pSharedMemory, size_t Size, MemoryPermission OwnerPermission, MemoryPermission RemotePermission)
+    {
+        AMS_UNUSED(OwnerPermission, RemotePermission);
+
+        std::shared_ptr<KSharedMemory> pObject = std::make_shared<KSharedMemory>();
+        pObject->mpMemory = std::aligned_alloc(MemoryPageSize, util::AlignUp(Size, MemoryPageSize));
+        AMS_ABORT_UNLESS(pObject->mpMemory != nullptr);
+
+        std::scoped_lock lk(g_KernelMutex);
+        *pSharedMemory = (SharedMemoryType){ .mpMemory = pObject->mpMemory, .mSize = Size, .mHandle = InsertHandle(pObject) };
+        R_SUCCEED();
+    }
+
+    void* MapSharedMemory(SharedMemoryType* pSharedMemory, MemoryPermission permission)
+    {
+        AMS_UNUSED(permission);
+        return pSharedMemory->mpMemory;
+    }
+
+    NativeHandle GetSharedMemoryHandle(const SharedMemoryType* pSharedMemory)
+    {
+        return pSharedMemory->mHandle;
+    }
+}
+
+namespace ams::svc
+{
+    Result QueryMemory(MemoryInfo* pInfo, PageInfo* pPageInfo, uintptr_t Address)
+    {
+        const uintptr_t Reserve = GetTransferReserve();
+        const uintptr_t Page = Address & ~(os::MemoryPageSize - 1);
+        pPageInfo->flags = 0;
+
+        /* Everything below the reserve looks like one block of code, which is all the transfer window search needs */
+        AMS_ABORT_UNLESS(Page < Reserve + g_TransferReserveSize, "Queried past the transfer reserve");
+        if (Page < Reserve)
+        {
+            *pInfo = (MemoryInfo){ .base_address = Page, .size = Reserve - Page, .state = MemoryState_Code, .permission = MemoryPermission_ReadExecute };
+        }
+        else
+        {
+            *pInfo = (MemoryInfo){ .base_address = Reserve, .size = g_TransferReserveSize, .state = MemoryState_Free, .permission = MemoryPermission_None };
+        }
+        R_SUCCEED();
+    }
+
+    Result QueryProcessMemory(MemoryInfo* pInfo, PageInfo* pPageInfo, ::Handle process, u64 Address)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KProcess> pProcess = LookupHandle<KProcess>(process);
+        R_UNLESS(pProcess != nullptr, ResultInvalidHandle());
+
+        pPageInfo->flags = 0;
+        if (Address < pProcess->mBaseAddress)
+        {
+            *pInfo = (MemoryInfo){ .base_address = 0, .size = pProcess->mBaseAddress, .state = MemoryState_Free, .permission = MemoryPermission_None };
+        }
+        else if (Address - pProcess->mBaseAddress < pProcess->mSize)
+        {
+            *pInfo = (MemoryInfo){ .base_address = pProcess->mBaseAddress, .size = pProcess->mSize, .state = MemoryState_Normal, .permission = MemoryPermission_ReadWrite };
+        }
+        else
+        {
+            const u64 End = pProcess->mBaseAddress + pProcess->mSize;
+            *pInfo = (MemoryInfo){ .base_address = End, .size = 0 - End, .state = MemoryState_Free, .permission = MemoryPermission_None };
+        }
+        R_SUCCEED();
+    }
+
+    Result MapProcessMemory(uintptr_t Address, ::Handle process, u64 SourceAddress, size_t Size)
+    {
+        R_UNLESS(Address % os::MemoryPageSize == 0 && SourceAddress % os::MemoryPageSize == 0, ResultInvalidAddress());
+        R_UNLESS(Size != 0 && Size % os::MemoryPageSize == 0, ResultInvalidSize());
+
+        const uintptr_t Reserve = GetTransferReserve();
+        R_UNLESS(Address >= Reserve && Size <= g_TransferReserveSize && Address - Reserve <= g_TransferReserveSize - Size, ResultInvalidMemoryRegion());
+
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KProcess> pProcess = LookupHandle<KProcess>(process);
+        R_UNLESS(pProcess != nullptr, ResultInvalidHandle());
+        R_UNLESS(pProcess->Contains(SourceAddress, Size), ResultInvalidCurrentMemory());
+
+        for (size_t Offset = 0; Offset < Size; Offset += os::MemoryPageSize)
+        {
+            R_UNLESS(g_MappedPages.count(Address + Offset) == 0, ResultInvalidCurrentMemory());
+        }
+
+        for (size_t Offset = 0; Offset < Size; Offset += os::MemoryPageSize)
+        {
+            const off_t PageOffset = pProcess->PageOffset(SourceAddress + Offset);
+            void* pResult = mmap(reinterpret_cast<void*>(Address + Offset), os::MemoryPageSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, pProcess->mFd, PageOffset);
+            AMS_ABORT_UNLESS(pResult != MAP_FAILED);
+            g_MappedPages[Address + Offset] = (MappedPage){ .mProcess = pProcess, .mSourcePage = SourceAddress + Offset, .mOffset = PageOffset };
+        }
+
+        g_SvcCounters.mMapProcessMemory++;
+        R_SUCCEED();
+    }
+
+    Result UnmapProcessMemory(uintptr_t Address, ::Handle process, u64 SourceAddress, size_t Size)
+    {
+        R_UNLESS(Address % os::MemoryPageSize == 0 && SourceAddress % os::MemoryPageSize == 0, ResultInvalidAddress());
+        R_UNLESS(Size != 0 && Size % os::MemoryPageSize == 0, ResultInvalidSize());
+
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KProcess> pProcess = LookupHandle<KProcess>(process);
+        R_UNLESS(pProcess != nullptr, ResultInvalidHandle());
+        R_UNLESS(pProcess->Contains(SourceAddress, Size), ResultInvalidCurrentMemory());
+
+        /* Like the kernel, the mapping has to still be backed by the pages the source range has now */
+        for (size_t Offset = 0; Offset < Size; Offset += os::MemoryPageSize)
+        {
+            auto it = g_MappedPages.find(Address + Offset);
+            R_UNLESS(it != g_MappedPages.end(), ResultInvalidMemoryRegion());
+            R_UNLESS(it->second.mProcess == pProcess && it->second.mSourcePage == SourceAddress + Offset, ResultInvalidMemoryRegion());
+            R_UNLESS(it->second.mOffset == pProcess->PageOffset(SourceAddress + Offset), ResultInvalidMemoryRegion());
+        }
+
+        ReleasePages(Address, Size);
+        for (size_t Offset = 0; Offset < Size; Offset += os::MemoryPageSize)
+        {
+            g_MappedPages.erase(Address + Offset);
+        }
+
+        g_SvcCounters.mUnmapProcessMemory++;
+        R_SUCCEED();
+    }
+
+    Result InvalidateProcessDataCache(::Handle process, u64 Address, u64 Size)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KProcess> pProcess = LookupHandle<KProcess>(process);
+        R_UNLESS(pProcess != nullptr, ResultInvalidHandle());
+        R_UNLESS(pProcess->Contains(Address, Size), ResultInvalidCurrentMemory());
+
+        g_SvcCounters.mProcessDataCacheOperations++;
+        R_SUCCEED();
+    }
+
+    Result FlushProcessDataCache(::Handle process, u64 Address, u64 Size)
+    {
+        return InvalidateProcessDataCache(process, Address, Size);
+    }
+
+    Result ResetSignal(::Handle handle)
+    {
+        std::scoped_lock lk(g_KernelMutex);
+        std::shared_ptr<KEvent> pEvent = LookupHandle<KEvent>(handle);
+        R_UNLESS(pEvent != nullptr, ResultInvalidHandle());
+        R_UNLESS(pEvent->mSignaled, ResultInvalidState());
+
+        pEvent->mSignaled = false;
+        R_SUCCEED();
+    }
+}
+
+namespace ams::fs
+{
+    Result CreateFile(const char* pPath, s64 Size)
+    {
+        const std::string Path = ResolvePath(pPath);
+        const int fd = open(Path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd < 0)
+        {
+            R_UNLESS(errno != EEXIST, ResultPathAlreadyExists());
+            R_THROW(ResultPathNotFound());
+        }
+
+        const bool Resized = ftruncate(fd, Size) == 0;
+        close(fd);
+        AMS_ABORT_UNLESS(Resized);
+        R_SUCCEED();
+    }
+
+    Result DeleteFile(const char* pPath)
+    {
+        R_UNLESS(unlink(ResolvePath(pPath).c_str()) == 0, ResultPathNotFound());
+        R_SUCCEED();
+    }
+
+    Result OpenFile(FileHandle* pOut, const char* pPath, int mode)
+    {
+        AMS_UNUSED(mode);
+        pOut->mpFile = std::fopen(ResolvePath(pPath).c_str(), "r+b");
+        R_UNLESS(pOut->mpFile != nullptr, ResultPathNotFound());
+        R_SUCCEED();
+    }
+
+    void CloseFile(FileHandle file)
+    {
+        std::fclose(file.mpFile);
+    }
+
+    Result WriteFile(FileHandle file, s64 Offset, const void* pBuffer, size_t Size, const WriteOption& option)
+    {
+        AMS_ABORT_UNLESS(std::fseek(file.mpFile, Offset, SEEK_SET) == 0);
+        AMS_ABORT_UNLESS(std::fwrite(pBuffer, 1, Size, file.mpFile) == Size);
+        if (option.mValue == WriteOption::Flush.mValue)
+        {
+            R_TRY(FlushFile(file));
+        }
+        R_SUCCEED();
+    }
+
+    Result FlushFile(FileHandle file)
+    {
+        AMS_ABORT_UNLESS(std::fflush(file.mpFile) == 0);
+        R_SUCCEED();
+    }
+}
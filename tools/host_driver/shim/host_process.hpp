@@ -0,0 +1,29 @@
+/* Host stand-ins for the kernel objects the driver is handed by its clients, see host_driver.cpp */
+#pragma once
+#include "switch.h"
+
+namespace usb::host
+{
+    /* Creates a stand-in for a client process (HID) owning Size bytes of memory at BaseAddress in its own address space */
+    /* The driver reaches it the same way it reaches HID, through MapProcessMemory */
+    Handle CreateClientProcess(u64 BaseAddress, size_t Size);
+
+    void ReadClientMemory(Handle process, u64 Address, void* pOut, size_t Size);
+    void WriteClientMemory(Handle process, u64 Address, const void* pData, size_t Size);
+
+    /* Backs the pages covering the range with new physical pages, the way a buffer that gets freed and reallocated can be */
+    /* Anything still mapping the old pages keeps seeing them, the client process doesn't */
+    void ReplaceClientPages(Handle process, u64 Address, size_t Size);
+
+    struct SvcCounters
+    {
+        u64 mMapProcessMemory;
+        u64 mUnmapProcessMemory;
+        u64 mProcessDataCacheOperations;
+    };
+
+    void GetSvcCounters(SvcCounters* pOut);
+
+    /* Makes a session for the fake interface, the driver uses it through the If*Fwd calls of usb_shim.h */
+    Service CreateInterfaceSession();
+}
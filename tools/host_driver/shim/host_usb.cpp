@@ -0,0 +1,94 @@
+/* Host stand-in for the usb:hs interface session of an adapter, see host_driver.cpp */
+/* The adapter never answers control transfers on the console either, so they complete right away with nothing transferred */
+#include <stratosphere.hpp>
+#include "host_kernel.hpp"
+#include "host_process.hpp"
+#include "../../../usb_mitm/source/usb_shim.h"
+#include <map>
+
+namespace
+{
+    struct FakeInterface
+    {
+        Handle mCtrlXferCompletionEvent;
+        Handle mStateChangeEvent;
+        UsbHsXferReport mCtrlXferReport;
+        u32 mNextXferId;
+    };
+
+    std::mutex g_InterfaceMutex;
+    std::map<Handle, FakeInterface> g_FakeInterfaces;
+    Handle g_NextSession = 0x8000;
+
+    FakeInterface* GetInterface(Service* srv)
+    {
+        auto it = g_FakeInterfaces.find(srv->session);
+        AMS_ABORT_UNLESS(it != g_FakeInterfaces.end(), "Unknown interface session");
+        return &it->second;
+    }
+}
+
+namespace usb::host
+{
+    Service CreateInterfaceSession()
+    {
+        std::scoped_lock lk(g_InterfaceMutex);
+        const Handle Session = g_NextSession++;
+        g_FakeInterfaces[Session] = (FakeInterface){
+            .mCtrlXferCompletionEvent = kernel::CreateEvent(),
+            .mStateChangeEvent = kernel::CreateEvent(),
+            .mCtrlXferReport = {},
+            .mNextXferId = 0,
+        };
+        return (Service){ .session = Session, .own_handle = 1, .object_id = 0, .pointer_buffer_size = 0 };
+    }
+}
+
+void serviceClose(Service* s)
+{
+    std::scoped_lock lk(g_InterfaceMutex);
+    FakeInterface* pInterface = GetInterface(s);
+    svcCloseHandle(pInterface->mCtrlXferCompletionEvent);
+    svcCloseHandle(pInterface->mStateChangeEvent);
+    g_FakeInterfaces.erase(s->session);
+    *s = {};
+}
+
+/* Handles go out as copies, the same as they would over IPC, so the driver closing its copy leaves ours alone */
+Result usbHsIfGetCtrlXferCompletionEventFwd(Service* srv, Handle* handle)
+{
+    std::scoped_lock lk(g_InterfaceMutex);
+    *handle = usb::host::kernel::DuplicateHandle(GetInterface(srv)->mCtrlXferCompletionEvent);
+    return 0;
+}
+
+Result usbHsIfGetStateChangeEventFwd(Service* srv, Handle* handle)
+{
+    std::scoped_lock lk(g_InterfaceMutex);
+    *handle = usb::host::kernel::DuplicateHandle(GetInterface(srv)->mStateChangeEvent);
+    return 0;
+}
+
+Result usbHsIfCtrlXferAsyncFwd(Service* srv, u8 bmRequestType, u8 bRequest, u16 wValue, u16 wIndex, u16 wLength, u64 buffer)
+{
+    AMS_UNUSED(bmRequestType, bRequest, wValue, wIndex, buffer);
+
+    std::scoped_lock lk(g_InterfaceMutex);
+    FakeInterface* pInterface = GetInterface(srv);
+    pInterface->mCtrlXferReport = (UsbHsXferReport){
+        .xferId = pInterface->mNextXferId++,
+        .res = 0,
+        .requestedSize = wLength,
+        .transferredSize = 0,
+        .id = 0,
+    };
+    AMS_ABORT_UNLESS(usb::host::kernel::SignalEvent(pInterface->mCtrlXferCompletionEvent));
+    return 0;
+}
+
+Result usbHsIfGetCtrlXferReportFwd(Service* srv, void* buffer, size_t buffer_size)
+{
+    std::scoped_lock lk(g_InterfaceMutex);
+    std::memcpy(buffer, &GetInterface(srv)->mCtrlXferReport, std::min(buffer_size, sizeof(UsbHsXferReport)));
+    return 0;
+}
@@ -0,0 +1,397 @@
+/* Host stand-in for the parts of libstratosphere the driver core uses, see host_driver.cpp */
+/* Only what driver_thread.cpp, usb_backend_simulated.cpp, trace.cpp and capture.cpp need is here, implemented on top of the */
+/* standard library in host_os.cpp. Anything the driver would abort on aborts here too */
+#pragma once
+#include "switch.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ams
+{
+    class Result
+    {
+    private:
+        u32 mValue;
+
+    public:
+        constexpr Result() : mValue(0) {}
+        constexpr Result(u32 value) : mValue(value) {}
+
+        constexpr u32 GetValue() const { return mValue; }
+        constexpr bool IsSuccess() const { return mValue == 0; }
+        constexpr bool IsFailure() const { return mValue != 0; }
+        constexpr operator u32() const { return mValue; }
+    };
+
+    namespace impl
+    {
+        template<u32 Module, u32 Description>
+        struct ResultDefinition : Result
+        {
+            static constexpr u32 Value = Module | (Description << 9);
+
+            constexpr ResultDefinition() : Result(Value) {}
+
+            static constexpr bool Includes(Result res) { return res.GetValue() == Value; }
+        };
+
+        template<typename... Args>
+        constexpr void Unused(Args&&...) {}
+
+        [[noreturn]] void AbortImpl(const char* pFile, int Line, const char* pWhat, const char* pFormat = nullptr, ...);
+
+        template<typename F>
+        struct ScopeGuard
+        {
+            F mFunction;
+            ~ScopeGuard() { mFunction(); }
+        };
+
+        struct ScopeGuardHelper
+        {
+            template<typename F>
+            ScopeGuard<F> operator+(F&& function) { return ScopeGuard<F>{ std::forward<F>(function) }; }
+        };
+    }
+
+    namespace literals
+    {
+        constexpr size_t operator""_KB(unsigned long long value) { return value * 1024; }
+        constexpr size_t operator""_MB(unsigned long long value) { return value * 1024 * 1024; }
+    }
+
+    using namespace literals;
+
+    class TimeSpan
+    {
+    private:
+        s64 mNanoSeconds;
+
+        constexpr explicit TimeSpan(s64 ns) : mNanoSeconds(ns) {}
+
+    public:
+        constexpr TimeSpan() : mNanoSeconds(0) {}
+
+        static constexpr TimeSpan FromNanoSeconds(s64 value) { return TimeSpan(value); }
+        static constexpr TimeSpan FromMicroSeconds(s64 value) { return TimeSpan(value * 1'000); }
+        static constexpr TimeSpan FromMilliSeconds(s64 value) { return TimeSpan(value * 1'000'000); }
+        static constexpr TimeSpan FromSeconds(s64 value) { return TimeSpan(value * 1'000'000'000); }
+
+        constexpr s64 GetNanoSeconds() const { return mNanoSeconds; }
+        constexpr s64 GetMicroSeconds() const { return mNanoSeconds / 1'000; }
+        constexpr s64 GetMilliSeconds() const { return mNanoSeconds / 1'000'000; }
+    };
+}
+
+#define AMS_CONCATENATE_IMPL(a, b) a##b
+#define AMS_CONCATENATE(a, b) AMS_CONCATENATE_IMPL(a, b)
+
+#define AMS_UNUSED(...) ::ams::impl::Unused(__VA_ARGS__)
+#define AMS_LIKELY(expr) __builtin_expect(!!(expr), 1)
+#define AMS_UNLIKELY(expr) __builtin_expect(!!(expr), 0)
+#define AMS_ABORT(...) ::ams::impl::AbortImpl(__FILE__, __LINE__, "AMS_ABORT" __VA_OPT__(,) __VA_ARGS__)
+#define AMS_ABORT_UNLESS(expr, ...) do { if (!(expr)) { ::ams::impl::AbortImpl(__FILE__, __LINE__, #expr __VA_OPT__(,) __VA_ARGS__); } } while (0)
+/* Asserts are left on, the host build is where they are meant to fire */
+#define AMS_ASSERT(expr, ...) AMS_ABORT_UNLESS(expr __VA_OPT__(,) __VA_ARGS__)
+#define AMS_UNREACHABLE_DEFAULT_CASE() default: ::ams::impl::AbortImpl(__FILE__, __LINE__, "Unreachable default case")
+
+#define NON_COPYABLE(cls) cls(const cls&) = delete; cls& operator=(const cls&) = delete
+#define NON_MOVEABLE(cls) cls(cls&&) = delete; cls& operator=(cls&&) = delete
+
+#define ON_SCOPE_EXIT auto AMS_CONCATENATE(scope_exit_guard_, __LINE__) = ::ams::impl::ScopeGuardHelper() + [&]()
+
+#define R_SUCCEED() return ::ams::Result()
+#define R_THROW(res_expr) return (res_expr)
+#define R_RETURN(res_expr) return (res_expr)
+#define R_TRY(res_expr) { const ::ams::Result R_TRY_RESULT = (res_expr); if (R_TRY_RESULT.IsFailure()) { return R_TRY_RESULT; } }
+#define R_UNLESS(expr, res) { if (!(expr)) { return (res); } }
+#define R_SUCCEED_IF(expr) { if (expr) { R_SUCCEED(); } }
+#define R_ABORT_UNLESS(res_expr) { const ::ams::Result R_ABORT_RESULT = (res_expr); if (R_ABORT_RESULT.IsFailure()) { ::ams::impl::AbortImpl(__FILE__, __LINE__, #res_expr, "Result 0x%x", R_ABORT_RESULT.GetValue()); } }
+
+#define R_TRY_CATCH(res_expr) \
+    { \
+        const ::ams::Result R_CURRENT_RESULT = (res_expr); \
+        if (R_CURRENT_RESULT.IsFailure()) { \
+            if (false)
+
+#define R_CATCH(ResultType) \
+            } else if (ResultType::Includes(R_CURRENT_RESULT)) { \
+                if (true)
+
+#define R_END_TRY_CATCH \
+            else if (R_CURRENT_RESULT.IsFailure()) { \
+                return R_CURRENT_RESULT; \
+            } \
+        } \
+    }
+
+namespace ams::os
+{
+    using NativeHandle = ::Handle;
+
+    static constexpr size_t MemoryPageSize = 0x1000;
+    static constexpr s32 HighestThreadPriority = -12;
+    static constexpr s32 LowestThreadPriority = 15;
+
+    class Tick
+    {
+    private:
+        s64 mTicks;
+
+    public:
+        constexpr explicit Tick(s64 ticks = 0) : mTicks(ticks) {}
+
+        constexpr s64 GetInt64Value() const { return mTicks; }
+    };
+
+    /* Ticks run at the console's 19.2MHz so recorded numbers read the same as on hardware */
+    Tick GetSystemTick();
+    s64 GetSystemTickFrequency();
+    TimeSpan ConvertToTimeSpan(Tick tick);
+    Tick ConvertToTick(TimeSpan ts);
+
+    enum EventClearMode
+    {
+        EventClearMode_ManualClear = 0,
+        EventClearMode_AutoClear = 1,
+    };
+
+    enum MemoryPermission
+    {
+        MemoryPermission_None = 0,
+        MemoryPermission_ReadOnly = 1,
+        MemoryPermission_WriteOnly = 2,
+        MemoryPermission_ReadWrite = 3,
+    };
+
+    struct MutexType
+    {
+        std::recursive_mutex mMutex;
+    };
+
+    void InitializeMutex(MutexType* pMutex, bool IsRecursive, int LockLevel);
+    void FinalizeMutex(MutexType* pMutex);
+    void LockMutex(MutexType* pMutex);
+    void UnlockMutex(MutexType* pMutex);
+
+    struct ConditionVariableType
+    {
+        std::condition_variable_any mConditionVariable;
+    };
+
+    enum class ConditionVariableStatus
+    {
+        TimedOut = 0,
+        Success = 1,
+    };
+
+    void InitializeConditionVariable(ConditionVariableType* pCv);
+    void FinalizeConditionVariable(ConditionVariableType* pCv);
+    void SignalConditionVariable(ConditionVariableType* pCv);
+    void BroadcastConditionVariable(ConditionVariableType* pCv);
+    void WaitConditionVariable(ConditionVariableType* pCv, MutexType* pMutex);
+    ConditionVariableStatus TimedWaitConditionVariable(ConditionVariableType* pCv, MutexType* pMutex, TimeSpan timeout);
+
+    struct EventType
+    {
+        bool mSignaled;
+        EventClearMode mClearMode;
+    };
+
+    void InitializeEvent(EventType* pEvent, bool Signaled, EventClearMode mode);
+    void FinalizeEvent(EventType* pEvent);
+    void SignalEvent(EventType* pEvent);
+    void ClearEvent(EventType* pEvent);
+    void WaitEvent(EventType* pEvent);
+    bool TryWaitEvent(EventType* pEvent);
+    bool TimedWaitEvent(EventType* pEvent, TimeSpan timeout);
+
+    struct TimerEventType
+    {
+        EventClearMode mClearMode;
+        s64 mNextNs;
+        s64 mIntervalNs;
+    };
+
+    void InitializeTimerEvent(TimerEventType* pTimer, EventClearMode mode);
+    void FinalizeTimerEvent(TimerEventType* pTimer);
+    void StartPeriodicTimerEvent(TimerEventType* pTimer, TimeSpan first, TimeSpan interval);
+    void WaitTimerEvent(TimerEventType* pTimer);
+
+    using ThreadFunction = void (*)(void*);
+
+    struct ThreadType
+    {
+        ThreadFunction mFunction;
+        void* mpArgument;
+        const char* mpName;
+        std::thread* mpThread;
+    };
+
+    Result CreateThread(ThreadType* pThread, ThreadFunction function, void* pArgument, void* pStack, size_t StackSize, s32 Priority);
+    Result CreateThread(ThreadType* pThread, ThreadFunction function, void* pArgument, void* pStack, size_t StackSize, s32 Priority, s32 CoreId);
+    void SetThreadNamePointer(ThreadType* pThread, const char* pName);
+    void StartThread(ThreadType* pThread);
+    void WaitThread(ThreadType* pThread);
+    ThreadType* GetCurrentThread();
+    void SleepThread(TimeSpan ts);
+
+    struct MultiWaitType;
+
+    struct MultiWaitHolderType
+    {
+        EventType* mpEvent;
+        NativeHandle mHandle;
+        uintptr_t mUserData;
+        MultiWaitType* mpOwner;
+    };
+
+    struct MultiWaitType
+    {
+        /* In link order, which is also the order WaitAny checks them in */
+        std::vector<MultiWaitHolderType*> mHolders;
+    };
+
+    void InitializeMultiWait(MultiWaitType* pMultiWait);
+    void FinalizeMultiWait(MultiWaitType* pMultiWait);
+    void InitializeMultiWaitHolder(MultiWaitHolderType* pHolder, EventType* pEvent);
+    void InitializeMultiWaitHolder(MultiWaitHolderType* pHolder, NativeHandle handle);
+    void FinalizeMultiWaitHolder(MultiWaitHolderType* pHolder);
+    void LinkMultiWaitHolder(MultiWaitType* pMultiWait, MultiWaitHolderType* pHolder);
+    void UnlinkMultiWaitHolder(MultiWaitHolderType* pHolder);
+    void SetMultiWaitHolderUserData(MultiWaitHolderType* pHolder, uintptr_t UserData);
+    uintptr_t GetMultiWaitHolderUserData(const MultiWaitHolderType* pHolder);
+    MultiWaitHolderType* WaitAny(MultiWaitType* pMultiWait);
+    MultiWaitHolderType* TimedWaitAny(MultiWaitType* pMultiWait, TimeSpan timeout);
+
+    struct SharedMemoryType
+    {
+        void* mpMemory;
+        size_t mSize;
+        NativeHandle mHandle;
+    };
+
+    Result CreateSharedMemory(SharedMemoryType* pSharedMemory, size_t Size, MemoryPermission OwnerPermission, MemoryPermission RemotePermission);
+    void* MapSharedMemory(SharedMemoryType* pSharedMemory, MemoryPermission permission);
+    NativeHandle GetSharedMemoryHandle(const SharedMemoryType* pSharedMemory);
+}
+
+namespace ams::svc
+{
+    using ResultNotImplemented = ::ams::impl::ResultDefinition<1, 33>;
+    using ResultInvalidSize = ::ams::impl::ResultDefinition<1, 101>;
+    using ResultInvalidAddress = ::ams::impl::ResultDefinition<1, 102>;
+    using ResultOutOfResource = ::ams::impl::ResultDefinition<1, 103>;
+    using ResultInvalidCurrentMemory = ::ams::impl::ResultDefinition<1, 106>;
+    using ResultInvalidMemoryRegion = ::ams::impl::ResultDefinition<1, 110>;
+    using ResultInvalidHandle = ::ams::impl::ResultDefinition<1, 114>;
+    using ResultInvalidPointer = ::ams::impl::ResultDefinition<1, 115>;
+    using ResultTimedOut = ::ams::impl::ResultDefinition<1, 117>;
+    using ResultOutOfRange = ::ams::impl::ResultDefinition<1, 119>;
+    using ResultInvalidEnumValue = ::ams::impl::ResultDefinition<1, 120>;
+    using ResultNotFound = ::ams::impl::ResultDefinition<1, 121>;
+    using ResultInvalidState = ::ams::impl::ResultDefinition<1, 125>;
+    using ResultLimitReached = ::ams::impl::ResultDefinition<1, 132>;
+
+    enum MemoryState : u32
+    {
+        MemoryState_Free = 0x00,
+        MemoryState_Code = 0x03,
+        MemoryState_Normal = 0x05,
+        MemoryState_SharedCode = 0x0F,
+    };
+
+    enum MemoryPermission : u32
+    {
+        MemoryPermission_None = 0,
+        MemoryPermission_Read = 1,
+        MemoryPermission_Write = 2,
+        MemoryPermission_Execute = 4,
+        MemoryPermission_ReadWrite = 3,
+        MemoryPermission_ReadExecute = 5,
+    };
+
+    struct MemoryInfo
+    {
+        u64 base_address;
+        u64 size;
+        MemoryState state;
+        u32 attribute;
+        MemoryPermission permission;
+        u32 ipc_count;
+        u32 device_count;
+        u32 padding;
+    };
+
+    struct PageInfo
+    {
+        u32 flags;
+    };
+
+    Result QueryMemory(MemoryInfo* pInfo, PageInfo* pPageInfo, uintptr_t Address);
+    Result QueryProcessMemory(MemoryInfo* pInfo, PageInfo* pPageInfo, ::Handle process, u64 Address);
+    Result MapProcessMemory(uintptr_t Address, ::Handle process, u64 SourceAddress, size_t Size);
+    Result UnmapProcessMemory(uintptr_t Address, ::Handle process, u64 SourceAddress, size_t Size);
+    Result InvalidateProcessDataCache(::Handle process, u64 Address, u64 Size);
+    Result FlushProcessDataCache(::Handle process, u64 Address, u64 Size);
+    Result ResetSignal(::Handle handle);
+}
+
+/* Files under sd:/ land in the directory named by USB_MITM_HOST_SD, or the working directory */
+namespace ams::fs
+{
+    using ResultPathNotFound = ::ams::impl::ResultDefinition<2, 1>;
+    using ResultPathAlreadyExists = ::ams::impl::ResultDefinition<2, 2>;
+
+    struct FileHandle
+    {
+        std::FILE* mpFile;
+    };
+
+    enum OpenMode
+    {
+        OpenMode_Read = (1 << 0),
+        OpenMode_Write = (1 << 1),
+        OpenMode_AllowAppend = (1 << 2),
+        OpenMode_All = OpenMode_Read | OpenMode_Write | OpenMode_AllowAppend,
+    };
+
+    struct WriteOption
+    {
+        int mValue;
+
+        static const WriteOption None;
+        static const WriteOption Flush;
+    };
+
+    inline constexpr WriteOption WriteOption::None = { 0 };
+    inline constexpr WriteOption WriteOption::Flush = { 1 };
+
+    Result CreateFile(const char* pPath, s64 Size);
+    Result DeleteFile(const char* pPath);
+    Result OpenFile(FileHandle* pOut, const char* pPath, int mode);
+    void CloseFile(FileHandle file);
+    Result WriteFile(FileHandle file, s64 Offset, const void* pBuffer, size_t Size, const WriteOption& option);
+    Result FlushFile(FileHandle file);
+}
+
+namespace ams::util
+{
+    template<typename T>
+    constexpr T AlignUp(T value, size_t alignment)
+    {
+        return static_cast<T>((value + alignment - 1) & ~(alignment - 1));
+    }
+}
@@ -0,0 +1,114 @@
+/* Host stand-in for the parts of libnx the driver core uses, see host_driver.cpp */
+/* Kernel objects (events, the client process) live in a handle table implemented by host_os.cpp */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef u32 Handle;
+typedef u32 Result;
+
+#define R_SUCCEEDED(res) (static_cast<u32>(res) == 0)
+#define R_FAILED(res) (static_cast<u32>(res) != 0)
+
+#define INVALID_HANDLE ((Handle)0)
+#define CUR_PROCESS_HANDLE 0xFFFF8001
+#define MAX_WAIT_OBJECTS 0x40
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define NORETURN __attribute__((noreturn))
+
+#define USB_TRANSFER_TYPE_MASK 0x03
+#define USB_ENDPOINT_ADDRESS_MASK 0x0F
+#define USB_ENDPOINT_IN 0x80
+
+struct Service
+{
+    Handle session;
+    u32 own_handle;
+    u32 object_id;
+    u16 pointer_buffer_size;
+};
+
+struct Event
+{
+    Handle revent;
+    Handle wevent;
+    bool autoclear;
+};
+
+Result eventCreate(Event* t, bool autoclear);
+void eventClose(Event* t);
+Result eventFire(Event* t);
+Result eventClear(Event* t);
+
+Result svcCloseHandle(Handle handle);
+
+/* Every mapping on the host is coherent, so these have nothing to do */
+void armDCacheClean(void* addr, size_t size);
+void armDCacheFlush(void* addr, size_t size);
+
+void serviceClose(Service* s);
+
+struct usb_endpoint_descriptor
+{
+    u8 bLength;
+    u8 bDescriptorType;
+    u8 bEndpointAddress;
+    u8 bmAttributes;
+    u16 wMaxPacketSize;
+    u8 bInterval;
+} __attribute__((packed));
+
+struct UsbHsXferReport
+{
+    u32 xferId;
+    Result res;
+    u32 requestedSize;
+    u32 transferredSize;
+    u64 id;
+};
+
+struct UsbHsInterfaceInfo
+{
+    s32 ID;
+    u32 deviceID_2;
+    u32 unk_x8;
+    u8 pad[0x1b8];
+    struct usb_endpoint_descriptor input_endpoint_descs[15];
+    struct usb_endpoint_descriptor output_endpoint_descs[15];
+};
+
+struct UsbHsInterface
+{
+    UsbHsInterfaceInfo inf;
+    char pathstr[0x40];
+    u32 busID;
+    u32 deviceID;
+    u8 device_desc[0x12];
+    u8 config_desc[0x9];
+    u8 pad[5];
+    u64 timestamp;
+};
+
+struct UsbHsInterfaceFilter
+{
+    u16 Flags;
+    u16 idVendor;
+    u16 idProduct;
+    u16 bcdDevice_Min;
+    u16 bcdDevice_Max;
+    u8 bDeviceClass;
+    u8 bDeviceSubClass;
+    u8 bDeviceProtocol;
+    u8 bInterfaceClass;
+    u8 bInterfaceSubClass;
+    u8 bInterfaceProtocol;
+};
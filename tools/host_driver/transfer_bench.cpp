@@ -0,0 +1,154 @@
+/* Measures what moving a packet between HID and the driver costs (ReadWithTransfer/WriteWithTransfer in driver_thread.cpp), */
+/* and checks that a transfer always reaches the pages currently backing the client buffer, even after HID's buffer got */
+/* backed by new pages. The svc calls are served by the host stand-ins in shim/, which count them */
+/* This is a host-side tool, build and run it with: */
+/*     make -C tools/host_driver run-transfer_bench */
+/* Usage: */
+/*     transfer_bench [--iterations <n>] */
+/* The time per call is that of the host's mmap/munmap and says little about the console, the syscalls per transfer do carry over */
+/* Exits with 2 if any transfer read or wrote the wrong data */
+#include <stratosphere.hpp>
+#include "../../usb_mitm/source/driver_thread.hpp"
+#include "../../usb_mitm/source/trace.hpp"
+#include "../../usb_mitm/source/capture.hpp"
+#include "shim/host_process.hpp"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    using namespace usb::gc;
+    using namespace ams::literals;
+
+    static constexpr u64 ClientBase = 0x80000000;
+    static constexpr size_t ClientSize = 32 * ams::os::MemoryPageSize;
+
+    /* HID's read and write buffers, both within a single page like the ones it polls with */
+    static constexpr u64 ReadBuffer = ClientBase + 0x1040;
+    static constexpr u64 WriteBuffer = ClientBase + 0x2080;
+    static constexpr size_t RumblePacketSize = 5;
+
+    u64 g_Failures;
+
+    void Check(bool Condition, const char* pWhat)
+    {
+        if (!Condition)
+        {
+            std::fprintf(stderr, "FAILED: %s\n", pWhat);
+            g_Failures++;
+        }
+    }
+
+    void FillPattern(u8* pData, size_t Size, u8 Seed)
+    {
+        for (size_t i = 0; i < Size; i++)
+        {
+            pData[i] = static_cast<u8>(Seed + i * 7);
+        }
+    }
+
+    /* Both directions have to see the client's current pages, including right after they were replaced */
+    void CheckTransfers(Handle Client)
+    {
+        u8 Expected[AdapterPacketSize];
+        u8 Actual[AdapterPacketSize];
+
+        FillPattern(Expected, sizeof(Expected), 1);
+        usb::host::WriteClientMemory(Client, ReadBuffer, Expected, sizeof(Expected));
+        ReadWithTransfer(Client, ReadBuffer, Actual, sizeof(Actual));
+        Check(std::memcmp(Expected, Actual, sizeof(Expected)) == 0, "read from the client buffer");
+
+        FillPattern(Expected, sizeof(Expected), 2);
+        WriteWithTransfer(Client, Expected, ReadBuffer, sizeof(Expected));
+        usb::host::ReadClientMemory(Client, ReadBuffer, Actual, sizeof(Actual));
+        Check(std::memcmp(Expected, Actual, sizeof(Expected)) == 0, "write to the client buffer");
+
+        /* HID frees the buffer and gets the same address back, now backed by other pages */
+        usb::host::ReplaceClientPages(Client, ReadBuffer, sizeof(Expected));
+
+        FillPattern(Expected, sizeof(Expected), 3);
+        usb::host::WriteClientMemory(Client, ReadBuffer, Expected, sizeof(Expected));
+        ReadWithTransfer(Client, ReadBuffer, Actual, sizeof(Actual));
+        Check(std::memcmp(Expected, Actual, sizeof(Expected)) == 0, "read from a client buffer whose pages were replaced");
+
+        FillPattern(Expected, sizeof(Expected), 4);
+        WriteWithTransfer(Client, Expected, ReadBuffer, sizeof(Expected));
+        usb::host::ReadClientMemory(Client, ReadBuffer, Actual, sizeof(Actual));
+        Check(std::memcmp(Expected, Actual, sizeof(Expected)) == 0, "write to a client buffer whose pages were replaced");
+
+        /* The largest control transfer, starting part way into a page so it spans one more page than its size */
+        static u8 LargeExpected[64_KB];
+        static u8 LargeActual[64_KB];
+        const u64 LargeBuffer = ClientBase + 4 * ams::os::MemoryPageSize + 0x10;
+        FillPattern(LargeExpected, sizeof(LargeExpected), 5);
+        usb::host::WriteClientMemory(Client, LargeBuffer, LargeExpected, sizeof(LargeExpected));
+        ReadWithTransfer(Client, LargeBuffer, LargeActual, sizeof(LargeActual));
+        Check(std::memcmp(LargeExpected, LargeActual, sizeof(LargeExpected)) == 0, "read spanning 17 pages");
+
+        FillPattern(LargeExpected, sizeof(LargeExpected), 6);
+        WriteWithTransfer(Client, LargeExpected, LargeBuffer, sizeof(LargeExpected));
+        usb::host::ReadClientMemory(Client, LargeBuffer, LargeActual, sizeof(LargeActual));
+        Check(std::memcmp(LargeExpected, LargeActual, sizeof(LargeExpected)) == 0, "write spanning 17 pages");
+    }
+
+    /* One HID poll: the packet goes out to the client, and every so often a rumble packet comes back */
+    void Benchmark(Handle Client, u64 Iterations)
+    {
+        u8 Packet[AdapterPacketSize] = { 0x21 };
+        u8 Rumble[RumblePacketSize];
+        usb::host::SvcCounters Before;
+        usb::host::SvcCounters After;
+
+        usb::host::GetSvcCounters(&Before);
+        const auto Start = std::chrono::steady_clock::now();
+        for (u64 i = 0; i < Iterations; i++)
+        {
+            Packet[1] = static_cast<u8>(i);
+            WriteWithTransfer(Client, Packet, ReadBuffer, sizeof(Packet));
+            ReadWithTransfer(Client, WriteBuffer, Rumble, sizeof(Rumble));
+        }
+        const auto End = std::chrono::steady_clock::now();
+        usb::host::GetSvcCounters(&After);
+
+        const u64 Transfers = Iterations * 2;
+        const double Ns = std::chrono::duration<double, std::nano>(End - Start).count();
+        std::printf(
+            "transfers=%" PRIu64 "  per transfer: MapProcessMemory=%.2f  UnmapProcessMemory=%.2f  cache maintenance=%.2f  time=%.0fns\n",
+            Transfers,
+            static_cast<double>(After.mMapProcessMemory - Before.mMapProcessMemory) / Transfers,
+            static_cast<double>(After.mUnmapProcessMemory - Before.mUnmapProcessMemory) / Transfers,
+            static_cast<double>(After.mProcessDataCacheOperations - Before.mProcessDataCacheOperations) / Transfers,
+            Ns / Transfers
+        );
+    }
+}
+
+int main(int argc, char** argv)
+{
+    u64 Iterations = 100000;
+    if (argc == 3 && std::strcmp(argv[1], "--iterations") == 0)
+    {
+        Iterations = std::strtoull(argv[2], nullptr, 10);
+    }
+    else if (argc != 1)
+    {
+        std::fprintf(stderr, "Usage: %s [--iterations <n>]\n", argv[0]);
+        return 1;
+    }
+
+    usb::trace::Initialize();
+    usb::capture::Initialize();
+    Initialize();
+
+    const Handle Client = usb::host::CreateClientProcess(ClientBase, ClientSize);
+    CheckTransfers(Client);
+    Benchmark(Client, Iterations);
+
+    /* The driver thread never returns, so leave without running any destructors under it */
+    std::fflush(stdout);
+    std::fflush(stderr);
+    std::_Exit(g_Failures == 0 ? 0 : 2);
+}
@@ -0,0 +1,224 @@
+/* Checks the button latching behind usb:gc SetAdapterDeliveryMode latch (packet::ButtonLatch in packet_processing.hpp) */
+/* The driver thread accumulates every read into the latch, and each HID fetch takes whatever was latched and ORs it into */
+/* the latest packet. A press that starts and ends between two fetches must show up in exactly the next fetch */
+/* This is a host-side tool, build it with: */
+/*     g++ -std=c++20 -O2 -pthread -o latch_test tools/latch_test/latch_test.cpp */
+/* Usage: */
+/*     latch_test [options] */
+/*         --duration-ms <ms>    How long the threaded check runs for (default 2000) */
+/*         --one-core            Run both threads on a single core, like the sysmodule does on the console */
+/* Exits with 2 if any check failed */
+#include "../../usb_mitm/source/packet_processing.hpp"
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <sched.h>
+
+namespace
+{
+    using namespace usb::gc;
+
+    struct Options
+    {
+        uint64_t mDurationMs = 2000;
+        bool mOneCore = false;
+    };
+
+    /* Bit 0 of a port's buttons is A */
+    static constexpr uint64_t ButtonA = 0x1;
+
+    uint64_t g_Failures;
+
+    void Check(bool Condition, const char* pWhat)
+    {
+        if (!Condition)
+        {
+            std::fprintf(stderr, "FAILED: %s\n", pWhat);
+            g_Failures++;
+        }
+    }
+
+    void MakePacket(uint8_t* pPacket, uint64_t Buttons)
+    {
+        std::memset(pPacket, 0, packet::PacketSize);
+        packet::ScatterButtons(pPacket, Buttons);
+    }
+
+    /* What HID gets from a fetch: the latest packet with the latched buttons merged in */
+    uint64_t Fetch(packet::ButtonLatch* pLatch, const uint8_t* pLatest)
+    {
+        uint8_t Packet[packet::PacketSize];
+        std::memcpy(Packet, pLatest, sizeof(Packet));
+        packet::ApplyLatchedButtons(Packet, pLatch->Take());
+        return packet::GatherButtons(Packet);
+    }
+
+    void CheckSingleThreaded()
+    {
+        packet::ButtonLatch Latch;
+        uint8_t Pressed[packet::PacketSize];
+        uint8_t Released[packet::PacketSize];
+        MakePacket(Pressed, ButtonA << 16);
+        MakePacket(Released, 0);
+        Latch.Clear();
+
+        /* Press then release between two fetches, the latest packet has A up */
+        Latch.Accumulate(Released);
+        Latch.Accumulate(Pressed);
+        Latch.Accumulate(Released);
+        Check(Fetch(&Latch, Released) == ButtonA << 16, "press and release within one fetch interval is delivered");
+
+        /* The fetch exchanged the latch to zero, so the press is not delivered a second time */
+        Check(Latch.Take() == 0, "fetch leaves the latch empty");
+        Latch.Accumulate(Released);
+        Check(Fetch(&Latch, Released) == 0, "press is not delivered again on the next fetch");
+
+        /* A press held across fetches shows up in each of them, from the packet itself */
+        Latch.Accumulate(Pressed);
+        Check(Fetch(&Latch, Pressed) == ButtonA << 16, "held press is delivered on the first fetch");
+        Latch.Accumulate(Pressed);
+        Check(Fetch(&Latch, Pressed) == ButtonA << 16, "held press is delivered on the next fetch");
+
+        /* Presses on different ports within one interval are all delivered */
+        uint8_t Port0[packet::PacketSize];
+        uint8_t Port3[packet::PacketSize];
+        MakePacket(Port0, ButtonA);
+        MakePacket(Port3, ButtonA << 48);
+        Latch.Accumulate(Port0);
+        Latch.Accumulate(Released);
+        Latch.Accumulate(Port3);
+        Latch.Accumulate(Released);
+        Check(Fetch(&Latch, Released) == (ButtonA | ButtonA << 48), "presses on several ports within one fetch interval are delivered");
+
+        /* Switching delivery modes clears the latch */
+        Latch.Accumulate(Pressed);
+        Latch.Clear();
+        Check(Fetch(&Latch, Released) == 0, "cleared latch delivers nothing");
+    }
+
+    /* The driver thread presses and releases one button at a time while the IPC thread keeps fetching. A button is only */
+    /* pressed again once the press before it was delivered, so every fetch must deliver exactly the presses still */
+    /* outstanding when it ran: none lost, and none delivered twice */
+    void CheckThreaded(const Options& Opts)
+    {
+        packet::ButtonLatch Latch;
+        Latch.Clear();
+
+        std::atomic<uint64_t> Outstanding = 0;
+        std::atomic<bool> Stop = false;
+        uint64_t Presses = 0;
+        uint64_t Fetches = 0;
+        uint64_t Delivered = 0;
+        uint64_t Duplicates = 0;
+
+        std::thread Driver([&] {
+            uint8_t Pressed[packet::PacketSize];
+            uint8_t Released[packet::PacketSize];
+            MakePacket(Released, 0);
+            uint64_t Bit = 0;
+            while (!Stop.load(std::memory_order_relaxed))
+            {
+                const uint64_t Mask = static_cast<uint64_t>(1) << (Bit++ % 64);
+                if ((Outstanding.load(std::memory_order_acquire) & Mask) != 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                Outstanding.fetch_or(Mask, std::memory_order_release);
+                MakePacket(Pressed, Mask);
+                Latch.Accumulate(Pressed);
+                Latch.Accumulate(Released);
+                Presses++;
+            }
+        });
+
+        std::thread Hid([&] {
+            uint8_t Released[packet::PacketSize];
+            MakePacket(Released, 0);
+            while (!Stop.load(std::memory_order_relaxed))
+            {
+                const uint64_t Buttons = Fetch(&Latch, Released);
+                const uint64_t Expected = Outstanding.load(std::memory_order_acquire);
+                if ((Buttons & ~Expected) != 0)
+                    Duplicates++;
+                Outstanding.fetch_and(~Buttons, std::memory_order_release);
+                Delivered += __builtin_popcountll(Buttons);
+                Fetches++;
+            }
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(Opts.mDurationMs));
+        Stop.store(true, std::memory_order_relaxed);
+        Driver.join();
+        Hid.join();
+
+        /* One last fetch picks up whatever the driver latched after HID stopped */
+        uint8_t Released[packet::PacketSize];
+        MakePacket(Released, 0);
+        const uint64_t Buttons = Fetch(&Latch, Released);
+        if ((Buttons & ~Outstanding.load()) != 0)
+            Duplicates++;
+        Outstanding.fetch_and(~Buttons);
+        Delivered += __builtin_popcountll(Buttons);
+
+        std::printf(
+            "threaded: presses=%" PRIu64 "  fetches=%" PRIu64 "  delivered=%" PRIu64 "  duplicates=%" PRIu64 "  lost=%d\n",
+            Presses, Fetches, Delivered, Duplicates, __builtin_popcountll(Outstanding.load())
+        );
+        Check(Duplicates == 0, "no press is delivered twice");
+        Check(Outstanding.load() == 0 && Delivered == Presses, "every press is delivered");
+    }
+
+    bool ParseOptions(int argc, char** argv, Options* pOpts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char* pArg = argv[i];
+            if (std::strcmp(pArg, "--one-core") == 0)
+            {
+                pOpts->mOneCore = true;
+                continue;
+            }
+
+            const char* pValue = i + 1 < argc ? argv[i + 1] : nullptr;
+            if (pValue == nullptr)
+                return false;
+            i++;
+
+            if (std::strcmp(pArg, "--duration-ms") == 0)
+                pOpts->mDurationMs = std::strtoull(pValue, nullptr, 10);
+            else
+                return false;
+        }
+        return pOpts->mDurationMs != 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options Opts;
+    if (!ParseOptions(argc, argv, &Opts))
+    {
+        std::fprintf(stderr, "Usage: %s [--duration-ms <ms>] [--one-core]\n", argv[0]);
+        return 1;
+    }
+
+    if (Opts.mOneCore)
+    {
+        cpu_set_t Set;
+        CPU_ZERO(&Set);
+        CPU_SET(sched_getcpu(), &Set);
+        if (sched_setaffinity(0, sizeof(Set), &Set) != 0)
+            std::fprintf(stderr, "Unable to pin to a single core, running unpinned\n");
+    }
+
+    CheckSingleThreaded();
+    CheckThreaded(Opts);
+    std::printf("latch checks: %s\n", g_Failures == 0 ? "passed" : "FAILED");
+    return g_Failures == 0 ? 0 : 2;
+}
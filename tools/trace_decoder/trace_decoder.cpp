@@ -0,0 +1,147 @@
+/* Decoder for the binary event traces written by usb:gc DumpTrace (sd:/usb_mitm_trace.bin) */
+/* This is a host-side tool, build it with: */
+/*     g++ -std=c++20 -O2 -o trace_decoder tools/trace_decoder/trace_decoder.cpp */
+/* Usage: */
+/*     trace_decoder <dump>                    Prints every event as text, in time order */
+/*     trace_decoder <dump> --chrome <out>     Also writes Chrome trace JSON (chrome://tracing, Perfetto) */
+#include "../../usb_mitm/source/trace_format.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    using namespace usb::trace;
+
+    bool ReadDump(const char* pPath, DumpHeader* pHeader, std::vector<Record>* pRecords)
+    {
+        FILE* pFile = std::fopen(pPath, "rb");
+        if (pFile == nullptr)
+        {
+            std::fprintf(stderr, "Unable to open %s\n", pPath);
+            return false;
+        }
+
+        bool IsValid = std::fread(pHeader, sizeof(DumpHeader), 1, pFile) == 1
+            && std::memcmp(pHeader->mMagic, DumpMagic, sizeof(DumpMagic)) == 0
+            && pHeader->mVersion == DumpVersion
+            && pHeader->mRecordSize == sizeof(Record)
+            && pHeader->mTickFrequency != 0;
+
+        if (IsValid)
+        {
+            pRecords->resize(pHeader->mRecordCount);
+            IsValid = std::fread(pRecords->data(), sizeof(Record), pRecords->size(), pFile) == pRecords->size();
+        }
+
+        std::fclose(pFile);
+        if (!IsValid)
+        {
+            std::fprintf(stderr, "%s is not a valid trace dump\n", pPath);
+        }
+        return IsValid;
+    }
+
+    double TicksToMicroSeconds(uint64_t Ticks, uint64_t Frequency)
+    {
+        return static_cast<double>(Ticks) * 1'000'000.0 / static_cast<double>(Frequency);
+    }
+
+    void PrintText(const DumpHeader& Header, const std::vector<Record>& Records, uint64_t BaseTick)
+    {
+        std::printf("# %u records, %u lost, tick frequency %" PRIu64 "hz\n", Header.mRecordCount, Header.mLostCount, Header.mTickFrequency);
+        for (const Record& Entry : Records)
+        {
+            std::printf("%14.3fus  %-12s  %-14s", TicksToMicroSeconds(Entry.mTick - BaseTick, Header.mTickFrequency), GetThreadName(Entry.mThread), GetEventName(Entry.mEvent));
+
+            if (Entry.mAdapter != NoAdapter)
+                std::printf("  adapter=%u", Entry.mAdapter);
+            else
+                std::printf("           ");
+
+            if (Entry.mDurationTicks != 0)
+                std::printf("  dur=%.3fus", TicksToMicroSeconds(Entry.mDurationTicks, Header.mTickFrequency));
+
+            std::printf("  args=[%u, %u, %u, %u]\n", Entry.mArgs[0], Entry.mArgs[1], Entry.mArgs[2], Entry.mArgs[3]);
+        }
+    }
+
+    bool WriteChromeTrace(const char* pPath, const DumpHeader& Header, const std::vector<Record>& Records, uint64_t BaseTick)
+    {
+        FILE* pFile = std::fopen(pPath, "w");
+        if (pFile == nullptr)
+        {
+            std::fprintf(stderr, "Unable to open %s for writing\n", pPath);
+            return false;
+        }
+
+        std::fprintf(pFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+        /* Name the threads so the timeline rows read nicely */
+        for (uint8_t thread = 0; thread < static_cast<uint8_t>(ThreadId::Count); thread++)
+        {
+            std::fprintf(pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", thread, GetThreadName(thread));
+        }
+
+        for (size_t i = 0; i < Records.size(); i++)
+        {
+            const Record& Entry = Records[i];
+            const double Timestamp = TicksToMicroSeconds(Entry.mTick - BaseTick, Header.mTickFrequency);
+
+            /* Spans become complete events, everything else is an instant on its thread */
+            if (Entry.mDurationTicks != 0)
+            {
+                std::fprintf(pFile, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,", GetEventName(Entry.mEvent), Timestamp, TicksToMicroSeconds(Entry.mDurationTicks, Header.mTickFrequency));
+            }
+            else
+            {
+                std::fprintf(pFile, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,", GetEventName(Entry.mEvent), Timestamp);
+            }
+
+            std::fprintf(
+                pFile,
+                "\"pid\":0,\"tid\":%u,\"args\":{\"adapter\":%d,\"arg0\":%u,\"arg1\":%u,\"arg2\":%u,\"arg3\":%u}}%s\n",
+                Entry.mThread,
+                Entry.mAdapter == NoAdapter ? -1 : Entry.mAdapter,
+                Entry.mArgs[0], Entry.mArgs[1], Entry.mArgs[2], Entry.mArgs[3],
+                i + 1 == Records.size() ? "" : ","
+            );
+        }
+
+        std::fprintf(pFile, "]}\n");
+        std::fclose(pFile);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* pChromePath = nullptr;
+    if (argc == 4 && std::strcmp(argv[2], "--chrome") == 0)
+    {
+        pChromePath = argv[3];
+    }
+    else if (argc != 2)
+    {
+        std::fprintf(stderr, "Usage: %s <dump> [--chrome <out.json>]\n", argv[0]);
+        return 1;
+    }
+
+    DumpHeader Header;
+    std::vector<Record> Records;
+    if (!ReadDump(argv[1], &Header, &Records))
+        return 1;
+
+    /* The dump is grouped by thread, merge everything into one timeline */
+    std::stable_sort(Records.begin(), Records.end(), [](const Record& Lhs, const Record& Rhs) { return Lhs.mTick < Rhs.mTick; });
+    const uint64_t BaseTick = Records.empty() ? 0 : Records.front().mTick;
+
+    PrintText(Header, Records, BaseTick);
+
+    if (pChromePath != nullptr && !WriteChromeTrace(pChromePath, Header, Records, BaseTick))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+/* Stress test for VersionedBuffer (usb_mitm/source/versioned_buffer.hpp), the buffer HID's packets and write requests go through */
+/* Every buffer gets its own writer publishing as fast as it can, while reader threads copy values out of all of them. Every */
+/* byte of a published value is derived from its version, so a reader can tell if it was handed a torn copy or one that mixes */
+/* two versions, and versions a reader sees must never go backwards */
+/* This is a host-side tool, build it with: */
+/*     g++ -std=c++20 -O2 -pthread -o versioned_buffer_stress tools/versioned_buffer_stress/versioned_buffer_stress.cpp */
+/* Usage: */
+/*     versioned_buffer_stress [options] */
+/*         --buffers <n>         Number of buffers, each with its own writer (default 2) */
+/*         --readers <n>         Number of reader threads (default 4) */
+/*         --duration-ms <ms>    How long each configuration runs for (default 2000) */
+/*         --one-core            Run every thread on a single core, like the sysmodule does on the console. Writers then get */
+/*                               preempted mid-copy, which is the case the buffer was designed around */
+/* Runs with 2 slots (the writer laps readers all the time) and with the driver's 4. Exits with 2 if any read was bad */
+#include "../../usb_mitm/source/versioned_buffer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sched.h>
+
+namespace
+{
+    using namespace usb::gc;
+
+    struct Options
+    {
+        uint32_t mBuffers = 2;
+        uint32_t mReaders = 4;
+        uint64_t mDurationMs = 2000;
+        bool mOneCore = false;
+    };
+
+    /* Same size as the AdapterPacket the driver publishes */
+    struct Payload
+    {
+        uint64_t mVersion;
+        uint8_t mBytes[72];
+    };
+
+    static_assert(sizeof(Payload) == 80);
+
+    uint8_t ExpectedByte(uint64_t Version, size_t Index)
+    {
+        return static_cast<uint8_t>(Version * 31 + Index * 7 + (Version >> 8));
+    }
+
+    struct ReaderResults
+    {
+        uint64_t mReads = 0;
+        uint64_t mEmptyReads = 0;
+        uint64_t mDistinctVersions = 0;
+        uint64_t mVersionMismatches = 0;
+        uint64_t mTornValues = 0;
+        uint64_t mWentBackwards = 0;
+    };
+
+    template<size_t SlotCount>
+    bool RunConfiguration(const Options& Opts)
+    {
+        using Buffer = VersionedBuffer<Payload, SlotCount>;
+
+        std::vector<std::unique_ptr<Buffer>> Buffers;
+        for (uint32_t i = 0; i < Opts.mBuffers; i++)
+        {
+            Buffers.push_back(std::make_unique<Buffer>());
+            Buffers.back()->Reset();
+        }
+
+        std::atomic<bool> Stop = false;
+        std::vector<uint64_t> Published(Opts.mBuffers, 0);
+        std::vector<ReaderResults> Results(Opts.mReaders);
+        std::vector<std::thread> Threads;
+
+        for (uint32_t i = 0; i < Opts.mBuffers; i++)
+        {
+            Threads.emplace_back([&, i] {
+                Payload Value;
+                uint64_t Version = 0;
+                while (!Stop.load(std::memory_order_relaxed))
+                {
+                    Version++;
+                    Value.mVersion = Version;
+                    for (size_t b = 0; b < sizeof(Value.mBytes); b++)
+                    {
+                        Value.mBytes[b] = ExpectedByte(Version, b);
+                    }
+                    Buffers[i]->Publish(Value);
+                }
+                Published[i] = Version;
+            });
+        }
+
+        for (uint32_t r = 0; r < Opts.mReaders; r++)
+        {
+            Threads.emplace_back([&, r] {
+                ReaderResults* pOut = &Results[r];
+                std::vector<uint64_t> LastSeen(Opts.mBuffers, 0);
+                while (!Stop.load(std::memory_order_relaxed))
+                {
+                    for (uint32_t i = 0; i < Opts.mBuffers; i++)
+                    {
+                        Payload Value;
+                        const uint64_t Version = Buffers[i]->Read(&Value);
+                        pOut->mReads++;
+                        if (Version == 0)
+                        {
+                            pOut->mEmptyReads++;
+                            continue;
+                        }
+
+                        if (Value.mVersion != Version)
+                            pOut->mVersionMismatches++;
+
+                        for (size_t b = 0; b < sizeof(Value.mBytes); b++)
+                        {
+                            if (Value.mBytes[b] != ExpectedByte(Value.mVersion, b))
+                            {
+                                pOut->mTornValues++;
+                                break;
+                            }
+                        }
+
+                        if (Version < LastSeen[i])
+                            pOut->mWentBackwards++;
+                        else if (Version > LastSeen[i])
+                            pOut->mDistinctVersions++;
+                        LastSeen[i] = Version;
+                    }
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(Opts.mDurationMs));
+        Stop.store(true, std::memory_order_relaxed);
+        for (std::thread& Thread : Threads)
+        {
+            Thread.join();
+        }
+
+        uint64_t TotalPublished = 0;
+        for (uint64_t Count : Published)
+        {
+            TotalPublished += Count;
+        }
+
+        bool Passed = true;
+        std::printf("%zu slots: published=%" PRIu64 "\n", SlotCount, TotalPublished);
+        for (uint32_t r = 0; r < Opts.mReaders; r++)
+        {
+            const ReaderResults& Out = Results[r];
+            std::printf(
+                "  reader %u  reads=%" PRIu64 " (empty %" PRIu64 ")  distinct versions=%" PRIu64 "  version mismatches=%" PRIu64 "  torn=%" PRIu64 "  went backwards=%" PRIu64 "\n",
+                r, Out.mReads, Out.mEmptyReads, Out.mDistinctVersions, Out.mVersionMismatches, Out.mTornValues, Out.mWentBackwards
+            );
+            if (Out.mVersionMismatches != 0 || Out.mTornValues != 0 || Out.mWentBackwards != 0)
+                Passed = false;
+        }
+        return Passed;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options* pOpts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char* pArg = argv[i];
+            if (std::strcmp(pArg, "--one-core") == 0)
+            {
+                pOpts->mOneCore = true;
+                continue;
+            }
+
+            const char* pValue = i + 1 < argc ? argv[i + 1] : nullptr;
+            if (pValue == nullptr)
+                return false;
+            i++;
+
+            if (std::strcmp(pArg, "--buffers") == 0)
+                pOpts->mBuffers = static_cast<uint32_t>(std::strtoul(pValue, nullptr, 10));
+            else if (std::strcmp(pArg, "--readers") == 0)
+                pOpts->mReaders = static_cast<uint32_t>(std::strtoul(pValue, nullptr, 10));
+            else if (std::strcmp(pArg, "--duration-ms") == 0)
+                pOpts->mDurationMs = std::strtoull(pValue, nullptr, 10);
+            else
+                return false;
+        }
+        return pOpts->mBuffers != 0 && pOpts->mDurationMs != 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options Opts;
+    if (!ParseOptions(argc, argv, &Opts))
+    {
+        std::fprintf(stderr, "Usage: %s [--buffers <n>] [--readers <n>] [--duration-ms <ms>] [--one-core]\n", argv[0]);
+        return 1;
+    }
+
+    if (Opts.mOneCore)
+    {
+        cpu_set_t Set;
+        CPU_ZERO(&Set);
+        CPU_SET(sched_getcpu(), &Set);
+        if (sched_setaffinity(0, sizeof(Set), &Set) != 0)
+            std::fprintf(stderr, "Unable to pin to a single core, running unpinned\n");
+    }
+
+    const bool Passed = RunConfiguration<2>(Opts) & RunConfiguration<4>(Opts);
+    return Passed ? 0 : 2;
+}
@@ -0,0 +1,267 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+/* Minimal AArch64 assembler for the code we inject into other processes */
+/* Only the handful of instructions the patches need are supported. Everything is constexpr so the encodings can be */
+/* checked at compile time (see the static_asserts at the end), and this only depends on the standard library so host-side */
+/* tooling can use it as is */
+namespace usb::a64
+{
+    /* General purpose register number, whether it's used as W or X is up to the instruction. 31 is SP or ZR depending on the instruction */
+    enum Register : uint32_t
+    {
+        R0 = 0, R1, R2, R3, R4, R5, R6, R7, R8, R9, R10, R11, R12, R13, R14, R15,
+        R16, R17, R18, R19, R20, R21, R22, R23, R24, R25, R26, R27, R28, R29, R30,
+        Sp = 31,
+        Zr = 31,
+        Lr = R30
+    };
+
+    enum Condition : uint32_t
+    {
+        Eq = 0x0,
+        Ne = 0x1,
+        Hs = 0x2,
+        Lo = 0x3,
+        Al = 0xE
+    };
+
+    /* Instruction encoders. Offsets of branches are in bytes, relative to the branch itself */
+    namespace encode
+    {
+        constexpr uint32_t StpX_PreIndex(Register Rt, Register Rt2, Register Rn, int32_t Offset)
+        {
+            return 0xA9800000 | ((static_cast<uint32_t>(Offset / 8) & 0x7F) << 15) | (Rt2 << 10) | (Rn << 5) | Rt;
+        }
+
+        constexpr uint32_t LdpX_PostIndex(Register Rt, Register Rt2, Register Rn, int32_t Offset)
+        {
+            return 0xA8C00000 | ((static_cast<uint32_t>(Offset / 8) & 0x7F) << 15) | (Rt2 << 10) | (Rn << 5) | Rt;
+        }
+
+        /* Shift is the number of bits the immediate is shifted left by, a multiple of 16 */
+        constexpr uint32_t MovzW(Register Rd, uint16_t Immediate, uint32_t Shift = 0)
+        {
+            return 0x52800000 | ((Shift / 16) << 21) | (static_cast<uint32_t>(Immediate) << 5) | Rd;
+        }
+
+        constexpr uint32_t MovzX(Register Rd, uint16_t Immediate, uint32_t Shift = 0)
+        {
+            return 0xD2800000 | ((Shift / 16) << 21) | (static_cast<uint32_t>(Immediate) << 5) | Rd;
+        }
+
+        constexpr uint32_t MovkW(Register Rd, uint16_t Immediate, uint32_t Shift = 0)
+        {
+            return 0x72800000 | ((Shift / 16) << 21) | (static_cast<uint32_t>(Immediate) << 5) | Rd;
+        }
+
+        /* ldr Wt, [Xn, Xm] */
+        constexpr uint32_t LdrW_Register(Register Rt, Register Rn, Register Rm)
+        {
+            return 0xB8606800 | (Rm << 16) | (Rn << 5) | Rt;
+        }
+
+        /* ldr Wt, [Xn, #Offset], Offset must be a multiple of 4 below 16KB */
+        constexpr uint32_t LdrW_Immediate(Register Rt, Register Rn, uint32_t Offset)
+        {
+            return 0xB9400000 | ((Offset / 4) << 10) | (Rn << 5) | Rt;
+        }
+
+        /* strb Wt, [Xn, #Offset], Offset must be below 4KB */
+        constexpr uint32_t Strb_Immediate(Register Rt, Register Rn, uint32_t Offset)
+        {
+            return 0x39000000 | (Offset << 10) | (Rn << 5) | Rt;
+        }
+
+        /* cmp Wn, Wm */
+        constexpr uint32_t CmpW_Register(Register Rn, Register Rm)
+        {
+            return 0x6B000000 | (Rm << 16) | (Rn << 5) | Zr;
+        }
+
+        constexpr uint32_t B(int32_t Offset)
+        {
+            return 0x14000000 | (static_cast<uint32_t>(Offset / 4) & 0x3FFFFFF);
+        }
+
+        constexpr uint32_t Bl(int32_t Offset)
+        {
+            return 0x94000000 | (static_cast<uint32_t>(Offset / 4) & 0x3FFFFFF);
+        }
+
+        constexpr uint32_t BCond(Condition Cond, int32_t Offset)
+        {
+            return 0x54000000 | ((static_cast<uint32_t>(Offset / 4) & 0x7FFFF) << 5) | Cond;
+        }
+
+        constexpr uint32_t Ret(Register Rn = Lr)
+        {
+            return 0xD65F0000 | (Rn << 5);
+        }
+
+        /* Whether a branch can reach Offset. The 26-bit forms reach +-128MB, the 19-bit ones +-1MB */
+        constexpr bool IsValidBranch26(int64_t Offset)
+        {
+            return (Offset % 4) == 0 && Offset >= -(int64_t(1) << 27) && Offset < (int64_t(1) << 27);
+        }
+
+        constexpr bool IsValidBranch19(int64_t Offset)
+        {
+            return (Offset % 4) == 0 && Offset >= -(int64_t(1) << 20) && Offset < (int64_t(1) << 20);
+        }
+    }
+
+    /* Position in the code a branch can target, bound once the code it points to gets emitted */
+    struct Label
+    {
+        size_t mIndex;
+    };
+
+    /* Fixed-size instruction buffer with branches to labels */
+    /* Errors (running out of space, branching to an unbound label) are sticky and reported by Finalize, so that a whole */
+    /* patch can be emitted without checking every step */
+    template<size_t Capacity>
+    class Assembler
+    {
+    public:
+        constexpr Label CreateLabel()
+        {
+            if (mNumLabels == mLabels.size())
+            {
+                mHasError = true;
+                return { 0 };
+            }
+            mLabels[mNumLabels] = Unbound;
+            return { mNumLabels++ };
+        }
+
+        constexpr void Bind(Label label)
+        {
+            mLabels[label.mIndex] = mCount;
+        }
+
+        constexpr void Emit(uint32_t Instruction)
+        {
+            if (mCount == Capacity)
+            {
+                mHasError = true;
+                return;
+            }
+            mFixups[mCount] = { FixupKind::None, 0 };
+            mCode[mCount++] = Instruction;
+        }
+
+        constexpr void B(Label Target)
+        {
+            EmitBranch(encode::B(0), Target, FixupKind::Branch26);
+        }
+
+        constexpr void BCond(Condition Cond, Label Target)
+        {
+            EmitBranch(encode::BCond(Cond, 0), Target, FixupKind::Branch19);
+        }
+
+        /* Resolves branches to labels, returns false if anything went wrong while emitting */
+        constexpr bool Finalize()
+        {
+            for (size_t i = 0; i < mCount && !mHasError; i++)
+            {
+                const Fixup& fixup = mFixups[i];
+                if (fixup.mKind == FixupKind::None)
+                    continue;
+
+                const size_t Target = mLabels[fixup.mLabel];
+                if (Target == Unbound)
+                {
+                    mHasError = true;
+                    break;
+                }
+
+                /* The offset fields of the emitted branches are still zero, so the encoded offset can simply be or'd in */
+                const int64_t Offset = (static_cast<int64_t>(Target) - static_cast<int64_t>(i)) * 4;
+                if (fixup.mKind == FixupKind::Branch19)
+                {
+                    mHasError |= !encode::IsValidBranch19(Offset);
+                    mCode[i] |= encode::BCond(static_cast<Condition>(0), static_cast<int32_t>(Offset));
+                }
+                else
+                {
+                    mHasError |= !encode::IsValidBranch26(Offset);
+                    mCode[i] |= encode::B(static_cast<int32_t>(Offset));
+                }
+                mFixups[i] = { FixupKind::None, 0 };
+            }
+            return !mHasError;
+        }
+
+        constexpr const uint32_t* GetCode() const
+        {
+            return mCode.data();
+        }
+
+        /* Number of instructions emitted */
+        constexpr size_t GetCount() const
+        {
+            return mCount;
+        }
+
+        constexpr size_t GetSize() const
+        {
+            return mCount * sizeof(uint32_t);
+        }
+
+    private:
+        enum class FixupKind
+        {
+            None,
+            Branch26,
+            Branch19
+        };
+
+        /* Branch still waiting for the label it targets to be resolved */
+        struct Fixup
+        {
+            FixupKind mKind;
+            size_t mLabel;
+        };
+
+        static constexpr size_t Unbound = SIZE_MAX;
+
+        constexpr void EmitBranch(uint32_t Instruction, Label Target, FixupKind Kind)
+        {
+            Emit(Instruction);
+            if (!mHasError)
+            {
+                mFixups[mCount - 1] = { Kind, Target.mIndex };
+            }
+        }
+
+        std::array<uint32_t, Capacity> mCode = {};
+        std::array<Fixup, Capacity> mFixups = {};
+        /* Instruction index each label is bound to */
+        std::array<size_t, Capacity + 1> mLabels = {};
+        size_t mCount = 0;
+        size_t mNumLabels = 0;
+        bool mHasError = false;
+    };
+
+    /* Encodings checked against the output of an assembler */
+    static_assert(encode::StpX_PreIndex(R0, R1, Sp, -16) == 0xA9BF07E0);
+    static_assert(encode::LdpX_PostIndex(R0, R1, Sp, 16) == 0xA8C107E0);
+    static_assert(encode::MovzX(R1, 0x1E65) == 0xD283CCA1);
+    static_assert(encode::MovzW(R1, 0x057E) == 0x5280AFC1);
+    static_assert(encode::MovzW(R2, 0xFFFF, 16) == 0x52BFFFE2);
+    static_assert(encode::MovkW(R1, 0x0337, 16) == 0x72A066E1);
+    static_assert(encode::LdrW_Register(R0, R20, R1) == 0xB8616A80);
+    static_assert(encode::LdrW_Immediate(R14, R13, 0) == 0xB94001AE);
+    static_assert(encode::Strb_Immediate(R1, R13, 6) == 0x390019A1);
+    static_assert(encode::CmpW_Register(R0, R1) == 0x6B01001F);
+    static_assert(encode::B(4) == 0x14000001);
+    static_assert(encode::B(0x100) == 0x14000040);
+    static_assert(encode::Bl(-0x3EA04) == 0x97FF057F);
+    static_assert(encode::BCond(Ne, 0x10) == 0x54000081);
+    static_assert(encode::BCond(Ne, -8) == 0x54FFFFC1);
+    static_assert(encode::Ret() == 0xD65F03C0);
+}
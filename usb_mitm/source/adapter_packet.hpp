@@ -0,0 +1,169 @@
+#pragma once
+#include <switch.h>
+#include "versioned_buffer.hpp"
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace usb::gc
+{
+    /* Size of the input packet that the GameCube adapter sends on every poll (report id + 4 ports) */
+    static constexpr size_t AdapterPacketSize = 37;
+
+    /* The packet that was most recently read from an adapter, alongside the report of the transfer that produced it */
+    struct AdapterPacket
+    {
+        UsbHsXferReport mReport;
+        u8 mData[AdapterPacketSize];
+        /* System ticks at which the driver thread woke up for the read completion, and at which it published the packet */
+        u64 mWakeTick;
+        u64 mPublishTick;
+    };
+
+    /* One completed read as recorded in an adapter's packet history */
+    /* This is also the layout handed out to usb:gc clients, so it must stay stable */
+    struct AdapterPacketHistoryEntry
+    {
+        /* Sample number since the adapter was opened, starting at 1. Gaps mean the consumer fell behind */
+        u64 mSequence;
+        /* System tick at which the driver thread picked up the completion */
+        u64 mTick;
+        UsbHsXferReport mReport;
+        u8 mData[AdapterPacketSize];
+        u8 mPadding[3];
+    };
+
+    static_assert(sizeof(AdapterPacketHistoryEntry) == 80);
+
+    /* Fixed-size ring of every completed read on an adapter, written by the driver thread and read from any thread */
+    /* Like VersionedBuffer, each slot carries its own version so readers can detect (and skip) slots overwritten mid-copy */
+    /* Positions in the ring are cursors: the generation of the ring in the upper 16 bits, a sample's sequence number below */
+    /* The generation changes every time the ring is reset, i.e. whenever a new adapter takes the slot, so a cursor handed out */
+    /* for a previous adapter can never be mistaken for a position in the current one. Cursor 0 is never handed out */
+    template<size_t Capacity>
+    class PacketHistoryRing
+    {
+        static_assert(Capacity >= 2);
+
+    public:
+        static constexpr u64 SequenceBits = 48;
+        static constexpr u64 SequenceMask = (static_cast<u64>(1) << SequenceBits) - 1;
+
+        static constexpr u16 GetGeneration(u64 Cursor)
+        {
+            return static_cast<u16>(Cursor >> SequenceBits);
+        }
+
+        static constexpr u64 GetSequence(u64 Cursor)
+        {
+            return Cursor & SequenceMask;
+        }
+
+        static constexpr u64 MakeCursor(u16 Generation, u64 Sequence)
+        {
+            return (static_cast<u64>(Generation) << SequenceBits) | Sequence;
+        }
+
+    private:
+        struct Slot
+        {
+            /* 0 while the slot is being written, otherwise the cursor of the sample it holds */
+            std::atomic<u64> mVersion;
+            AdapterPacketHistoryEntry mEntry;
+        };
+
+        /* Cursor of the newest recorded sample, so readers get the generation and the head in a single load */
+        std::atomic<u64> mHead;
+        Slot mSlots[Capacity];
+
+    public:
+        /* Forgets every recorded sample and starts a new generation. Must not race with Push */
+        void Reset()
+        {
+            for (size_t i = 0; i < Capacity; i++)
+            {
+                mSlots[i].mVersion.store(0, std::memory_order_relaxed);
+            }
+
+            /* Generation 0 is skipped so that no cursor ever ends up as 0 */
+            const u16 Generation = GetGeneration(mHead.load(std::memory_order_relaxed));
+            mHead.store(MakeCursor(Generation == UINT16_MAX ? 1 : Generation + 1, 0), std::memory_order_release);
+        }
+
+        /* Records a sample, only one thread may call this */
+        void Push(u64 Tick, const UsbHsXferReport& Report, const u8* pData)
+        {
+            const u64 Cursor = mHead.load(std::memory_order_relaxed) + 1;
+            const u64 Sequence = GetSequence(Cursor);
+            Slot* pSlot = &mSlots[Sequence % Capacity];
+
+            pSlot->mVersion.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            pSlot->mEntry.mSequence = Sequence;
+            pSlot->mEntry.mTick = Tick;
+            pSlot->mEntry.mReport = Report;
+            std::memcpy(pSlot->mEntry.mData, pData, AdapterPacketSize);
+            pSlot->mVersion.store(Cursor, std::memory_order_release);
+
+            mHead.store(Cursor, std::memory_order_release);
+        }
+
+        /* Cursor of the newest recorded sample. Its sequence is 0 if there is none */
+        u64 GetHead() const
+        {
+            return mHead.load(std::memory_order_acquire);
+        }
+
+        /* Moves a cursor up so that ReadSince returns no more than the newest MaxBacklog samples. Cursors that belong to */
+        /* another generation (or are 0) are treated as being as far behind as possible */
+        u64 LimitBacklog(u64 Cursor, u64 MaxBacklog) const
+        {
+            const u64 Head = mHead.load(std::memory_order_acquire);
+            const u64 Floor = Head - std::min(GetSequence(Head), MaxBacklog);
+            if (GetGeneration(Cursor) != GetGeneration(Head) || Cursor < Floor)
+                return Floor;
+
+            return Cursor;
+        }
+
+        /* Copies out up to MaxEntries samples recorded after Cursor (0 to start from the oldest sample), oldest first */
+        /* *pNextCursor is set to the cursor to pass next time. Samples that were overwritten before they could be copied */
+        /* are skipped, which shows up as a gap in mSequence */
+        size_t ReadSince(u64 Cursor, AdapterPacketHistoryEntry* pEntries, size_t MaxEntries, u64* pNextCursor) const
+        {
+            const u64 Head = mHead.load(std::memory_order_acquire);
+            const u16 Generation = GetGeneration(Head);
+            const u64 HeadSequence = GetSequence(Head);
+
+            /* A cursor from an earlier adapter in this slot (or from the future) starts over from the oldest sample */
+            u64 CursorSequence = GetSequence(Cursor);
+            if (GetGeneration(Cursor) != Generation || CursorSequence > HeadSequence)
+                CursorSequence = 0;
+
+            const u64 Oldest = HeadSequence >= Capacity ? HeadSequence - Capacity + 1 : 1;
+            u64 Sequence = std::max(CursorSequence + 1, Oldest);
+
+            size_t Count = 0;
+            for (; Sequence <= HeadSequence && Count < MaxEntries; Sequence++)
+            {
+                const Slot* pSlot = &mSlots[Sequence % Capacity];
+                const u64 Version = MakeCursor(Generation, Sequence);
+                if (pSlot->mVersion.load(std::memory_order_acquire) != Version)
+                    continue;
+
+                AdapterPacketHistoryEntry Copy;
+                std::memcpy(&Copy, &pSlot->mEntry, sizeof(Copy));
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (pSlot->mVersion.load(std::memory_order_relaxed) == Version)
+                {
+                    pEntries[Count++] = Copy;
+                }
+            }
+
+            *pNextCursor = MakeCursor(Generation, Sequence - 1);
+            return Count;
+        }
+    };
+}
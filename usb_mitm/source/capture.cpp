@@ -0,0 +1,221 @@
+#include "capture.hpp"
+#include <cstring>
+
+namespace usb::capture
+{
+    using namespace ams::literals;
+    namespace impl
+    {
+        constinit std::atomic<bool> g_IsCapturing = false;
+    }
+
+    namespace
+    {
+        /* Four adapters at 1000hz produce roughly 200KB of reads a second, so each buffer covers well over 100ms of SD card latency */
+        static constexpr size_t g_BufferSize = 32_KB;
+
+        struct CaptureBuffer
+        {
+            /* Set once the buffer has been handed to the writer thread, cleared by it once the buffer has been written out */
+            std::atomic<bool> mIsFull;
+            size_t mUsed;
+            u8 mData[g_BufferSize];
+        };
+
+        static CaptureBuffer g_Buffers[2];
+
+        /* Buffer records are appended to, and the next one the writer expects. The buffers are always filled and written in turn */
+        static size_t g_Filling;
+        static size_t g_NextToWrite;
+
+        /* Guards the buffer being filled and the counters against Start and Stop. Only the driver thread records, */
+        /* so this is never contended while a capture runs. Adapters come and go with the driver's interface mutex held, hence the lock level */
+        static ams::os::MutexType g_Mutex;
+        static u64 g_RecordCount;
+        static u64 g_DroppedCount;
+
+        /* Writer Thread */
+        static constexpr size_t g_WriterStackSize = 8_KB;
+        static constexpr s32 g_WriterPriority = ams::os::LowestThreadPriority;
+        alignas(ams::os::MemoryPageSize) static u8 g_WriterStack[g_WriterStackSize];
+        static ams::os::ThreadType g_WriterThread;
+
+        /* Signaled whenever a buffer gets handed to the writer, or a stop is requested */
+        static ams::os::EventType g_BufferReady;
+        static std::atomic<bool> g_StopRequested;
+        /* Signaled by the writer once the file has been completed and closed */
+        static ams::os::EventType g_Stopped;
+
+        static ams::fs::FileHandle g_File;
+        static s64 g_FilePosition;
+
+        static constinit char g_CapturePath[] = "sd:/usb_mitm_capture.bin";
+
+        static void WriteHeader(u64 RecordCount, u64 DroppedCount)
+        {
+            FileHeader Header = {
+                .mVersion = FileVersion,
+                .mRecordHeaderSize = sizeof(RecordHeader),
+                .mTickFrequency = static_cast<u64>(ams::os::GetSystemTickFrequency()),
+                .mRecordCount = static_cast<u32>(std::min<u64>(RecordCount, UINT32_MAX)),
+                .mDroppedCount = static_cast<u32>(std::min<u64>(DroppedCount, UINT32_MAX)),
+            };
+            std::memcpy(Header.mMagic, FileMagic, sizeof(Header.mMagic));
+            R_ABORT_UNLESS(ams::fs::WriteFile(g_File, 0, &Header, sizeof(Header), ams::fs::WriteOption::None));
+        }
+
+        /* Hands the buffer being filled over to the writer and moves on to the other one. Must be called with g_Mutex held */
+        static void HandOverBuffer()
+        {
+            g_Buffers[g_Filling].mIsFull.store(true, std::memory_order_release);
+            ams::os::SignalEvent(&g_BufferReady);
+            g_Filling ^= 1;
+        }
+
+        static void WriterThreadFunction(void*)
+        {
+            while (true)
+            {
+                ams::os::WaitEvent(&g_BufferReady);
+
+                while (g_Buffers[g_NextToWrite].mIsFull.load(std::memory_order_acquire))
+                {
+                    CaptureBuffer* pBuffer = &g_Buffers[g_NextToWrite];
+                    R_ABORT_UNLESS(ams::fs::WriteFile(g_File, g_FilePosition, pBuffer->mData, pBuffer->mUsed, ams::fs::WriteOption::None));
+                    g_FilePosition += pBuffer->mUsed;
+
+                    pBuffer->mUsed = 0;
+                    pBuffer->mIsFull.store(false, std::memory_order_release);
+                    g_NextToWrite ^= 1;
+                }
+
+                if (g_StopRequested.exchange(false, std::memory_order_acquire))
+                {
+                    /* Stop has already turned recording off, so the counters are final */
+                    WriteHeader(g_RecordCount, g_DroppedCount);
+                    R_ABORT_UNLESS(ams::fs::FlushFile(g_File));
+                    ams::fs::CloseFile(g_File);
+                    ams::os::SignalEvent(&g_Stopped);
+                }
+            }
+        }
+    }
+
+    namespace impl
+    {
+        void Append(RecordKind kind, u8 adapter, u64 Tick, u32 Result, const void* pPayload, u16 PayloadSize)
+        {
+            const size_t Size = sizeof(RecordHeader) + PayloadSize;
+
+            ams::os::LockMutex(&g_Mutex);
+            ON_SCOPE_EXIT { ams::os::UnlockMutex(&g_Mutex); };
+
+            /* Stop may have gotten in between the check in Record and here */
+            if (!g_IsCapturing.load(std::memory_order_relaxed))
+                return;
+
+            CaptureBuffer* pBuffer = &g_Buffers[g_Filling];
+            if (!pBuffer->mIsFull.load(std::memory_order_acquire) && pBuffer->mUsed + Size > g_BufferSize)
+            {
+                HandOverBuffer();
+                pBuffer = &g_Buffers[g_Filling];
+            }
+
+            /* Both buffers are waiting on the SD card */
+            if (pBuffer->mIsFull.load(std::memory_order_acquire))
+            {
+                g_DroppedCount++;
+                return;
+            }
+
+            const RecordHeader Header = {
+                .mTick = Tick,
+                .mKind = static_cast<u8>(kind),
+                .mAdapter = adapter,
+                .mPayloadSize = PayloadSize,
+                .mResult = Result
+            };
+            std::memcpy(pBuffer->mData + pBuffer->mUsed, &Header, sizeof(Header));
+            if (PayloadSize != 0)
+            {
+                std::memcpy(pBuffer->mData + pBuffer->mUsed + sizeof(Header), pPayload, PayloadSize);
+            }
+            pBuffer->mUsed += Size;
+            g_RecordCount++;
+        }
+    }
+
+    void Initialize()
+    {
+        ams::os::InitializeMutex(&g_Mutex, false, 2);
+        ams::os::InitializeEvent(&g_BufferReady, false, ams::os::EventClearMode_AutoClear);
+        ams::os::InitializeEvent(&g_Stopped, false, ams::os::EventClearMode_AutoClear);
+        g_StopRequested.store(false, std::memory_order_relaxed);
+
+        R_ABORT_UNLESS(ams::os::CreateThread(
+            &g_WriterThread,
+            WriterThreadFunction,
+            nullptr,
+            g_WriterStack,
+            g_WriterStackSize,
+            g_WriterPriority
+        ));
+
+        ams::os::SetThreadNamePointer(&g_WriterThread, "usb::capture::Writer");
+        ams::os::StartThread(&g_WriterThread);
+    }
+
+    ams::Result Start()
+    {
+        AMS_ABORT_UNLESS(!IsCapturing(), "A capture is already running");
+
+        /* Start from a fresh file every time */
+        R_TRY_CATCH(ams::fs::DeleteFile(g_CapturePath))
+        {
+            R_CATCH(ams::fs::ResultPathNotFound) {}
+        }
+        R_END_TRY_CATCH;
+        R_TRY(ams::fs::CreateFile(g_CapturePath, 0));
+        R_TRY(ams::fs::OpenFile(std::addressof(g_File), g_CapturePath, ams::fs::OpenMode_All));
+
+        /* The counts get filled in once the capture stops */
+        WriteHeader(0, 0);
+        g_FilePosition = sizeof(FileHeader);
+
+        /* The writer is idle between captures, so the buffers are ours to reset */
+        ams::os::LockMutex(&g_Mutex);
+        for (CaptureBuffer& Buffer : g_Buffers)
+        {
+            Buffer.mUsed = 0;
+            Buffer.mIsFull.store(false, std::memory_order_relaxed);
+        }
+        g_Filling = 0;
+        g_NextToWrite = 0;
+        g_RecordCount = 0;
+        g_DroppedCount = 0;
+        impl::g_IsCapturing.store(true, std::memory_order_release);
+        ams::os::UnlockMutex(&g_Mutex);
+
+        R_SUCCEED();
+    }
+
+    void Stop(u64* pRecordCount, u64* pDroppedCount)
+    {
+        AMS_ABORT_UNLESS(IsCapturing(), "No capture is running");
+
+        ams::os::LockMutex(&g_Mutex);
+        impl::g_IsCapturing.store(false, std::memory_order_relaxed);
+        /* Whatever made it into the buffer being filled goes out after everything before it */
+        if (g_Buffers[g_Filling].mUsed != 0 && !g_Buffers[g_Filling].mIsFull.load(std::memory_order_acquire))
+        {
+            HandOverBuffer();
+        }
+        *pRecordCount = g_RecordCount;
+        *pDroppedCount = g_DroppedCount;
+        ams::os::UnlockMutex(&g_Mutex);
+
+        g_StopRequested.store(true, std::memory_order_release);
+        ams::os::SignalEvent(&g_BufferReady);
+        ams::os::WaitEvent(&g_Stopped);
+    }
+}
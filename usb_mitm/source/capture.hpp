@@ -0,0 +1,40 @@
+#pragma once
+#include <stratosphere.hpp>
+#include <atomic>
+#include "capture_format.hpp"
+
+/* Recorder for the traffic between the driver thread and the adapters, written to sd:/usb_mitm_capture.bin */
+/* Records get appended to one of two buffers, and a low priority thread writes the full one out while the other fills up, */
+/* so the driver thread never waits on the SD card. Only the driver thread may record */
+namespace usb::capture
+{
+    namespace impl
+    {
+        extern std::atomic<bool> g_IsCapturing;
+
+        void Append(RecordKind kind, u8 adapter, u64 Tick, u32 Result, const void* pPayload, u16 PayloadSize);
+    }
+
+    /* Must be called once before anything gets recorded */
+    void Initialize();
+
+    /* Starts a new capture, replacing the previous file */
+    ams::Result Start();
+
+    /* Stops capturing and waits for everything recorded to be written out. Returns the number of records written and dropped */
+    void Stop(u64* pRecordCount, u64* pDroppedCount);
+
+    inline bool IsCapturing()
+    {
+        return impl::g_IsCapturing.load(std::memory_order_relaxed);
+    }
+
+    /* Records an event, this is a single load when no capture is running */
+    inline void Record(RecordKind kind, u8 adapter, u64 Tick, u32 Result = 0, const void* pPayload = nullptr, u16 PayloadSize = 0)
+    {
+        if (AMS_UNLIKELY(IsCapturing()))
+        {
+            impl::Append(kind, adapter, Tick, Result, pPayload, PayloadSize);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* On-disk format of the adapter traffic captures written by usb:gc StartCapture/StopCapture */
+/* This only depends on the standard library so that the host-side replay harness (tools/capture_replay) can use it as is */
+namespace usb::capture
+{
+    enum class RecordKind : uint8_t
+    {
+        None = 0,
+        /* An adapter got a slot and was started. No payload */
+        AdapterOpened = 1,
+        /* An adapter was released. No payload */
+        AdapterClosed = 2,
+        /* A read completed. Payload: the raw packet as it came off the wire, none if the read failed or came up short */
+        /* mResult: result of the transfer */
+        Read = 3,
+        /* A write was put on the wire. Payload: the bytes written */
+        Write = 4,
+        /* A control transfer completed. Payload: CtrlXferPayload. mResult: result of the transfer */
+        CtrlXfer = 5,
+
+        Count
+    };
+
+    /* Every record is this header directly followed by mPayloadSize bytes of payload, with no padding in between */
+    struct RecordHeader
+    {
+        /* System tick at which the driver thread saw the event */
+        uint64_t mTick;
+        uint8_t mKind;
+        uint8_t mAdapter;
+        uint16_t mPayloadSize;
+        uint32_t mResult;
+    };
+
+    static_assert(sizeof(RecordHeader) == 16);
+
+    struct CtrlXferPayload
+    {
+        uint8_t bmRequestType;
+        uint8_t bRequest;
+        uint16_t wValue;
+        uint16_t wIndex;
+        uint16_t wLength;
+        uint32_t mTransferredSize;
+    };
+
+    static_assert(sizeof(CtrlXferPayload) == 12);
+
+    static constexpr char FileMagic[8] = { 'G', 'C', 'C', 'A', 'P', 'T', 'U', 'R' };
+    static constexpr uint32_t FileVersion = 1;
+
+    /* A capture is this header followed by mRecordCount records, in the order the driver thread saw them */
+    struct FileHeader
+    {
+        char mMagic[8];
+        uint32_t mVersion;
+        uint32_t mRecordHeaderSize;
+        uint64_t mTickFrequency;
+        uint32_t mRecordCount;
+        /* Records thrown away because the SD card couldn't keep up. Replays of a capture with drops aren't faithful */
+        uint32_t mDroppedCount;
+    };
+
+    static_assert(sizeof(FileHeader) == 32);
+
+    constexpr const char* GetRecordKindName(uint8_t kind)
+    {
+        switch (static_cast<RecordKind>(kind))
+        {
+            case RecordKind::AdapterOpened: return "AdapterOpened";
+            case RecordKind::AdapterClosed: return "AdapterClosed";
+            case RecordKind::Read: return "Read";
+            case RecordKind::Write: return "Write";
+            case RecordKind::CtrlXfer: return "CtrlXfer";
+            default: return "Unknown";
+        }
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "packet_processing.hpp"
+
+/* Decoded view of the GameCube adapter input packet, one entry per port */
+/* The decoder only reads fixed offsets given by the constants below, so it compiles down to straight-line loads and stores */
+/* This only depends on the standard library so that host-side tooling can decode captured packets with it */
+namespace usb::gc::packet
+{
+    /* Report id the adapter puts in front of every input packet */
+    static constexpr uint8_t InputReportId = 0x21;
+
+    /* Kind of controller plugged into a port, from the high nibble of the port status byte */
+    enum class ControllerType : uint8_t
+    {
+        None = 0,
+        Wired = 1,
+        Wireless = 2,
+    };
+
+    static constexpr uint8_t PortStatusTypeShift = 4;
+
+    /* Bits of PortState::mButtons, the first button byte of the port block in the low byte and the second in the high byte */
+    enum PortButton : uint16_t
+    {
+        PortButton_A = (1 << 0),
+        PortButton_B = (1 << 1),
+        PortButton_X = (1 << 2),
+        PortButton_Y = (1 << 3),
+        PortButton_DpadLeft = (1 << 4),
+        PortButton_DpadRight = (1 << 5),
+        PortButton_DpadDown = (1 << 6),
+        PortButton_DpadUp = (1 << 7),
+        PortButton_Start = (1 << 8),
+        PortButton_Z = (1 << 9),
+        PortButton_R = (1 << 10),
+        PortButton_L = (1 << 11),
+    };
+
+    /* Order of the analog bytes within the analog part of a port block */
+    enum AnalogAxis : size_t
+    {
+        AnalogAxis_StickX = 0,
+        AnalogAxis_StickY = 1,
+        AnalogAxis_CStickX = 2,
+        AnalogAxis_CStickY = 3,
+        AnalogAxis_TriggerL = 4,
+        AnalogAxis_TriggerR = 5,
+
+        AnalogAxis_Count
+    };
+
+    static_assert(AnalogAxis_Count == PortAnalogSize);
+
+    /* This is also the layout handed out to usb:gc clients, so it must stay stable */
+    struct PortState
+    {
+        /* ControllerType, None when nothing is plugged in. The remaining fields are whatever the adapter reports then */
+        uint8_t mType;
+        /* The raw status byte, for the bits that aren't decoded */
+        uint8_t mStatus;
+        /* PortButton bits */
+        uint16_t mButtons;
+        uint8_t mStickX;
+        uint8_t mStickY;
+        uint8_t mCStickX;
+        uint8_t mCStickY;
+        uint8_t mTriggerL;
+        uint8_t mTriggerR;
+        uint8_t mPadding[2];
+    };
+
+    static_assert(sizeof(PortState) == 12);
+
+    /* Decoded packet of one adapter. This is also the layout handed out to usb:gc clients, so it must stay stable */
+    struct ControllerState
+    {
+        /* Number of packets decoded since the adapter was opened, starting at 1 */
+        uint64_t mSequence;
+        /* System tick at which the driver thread picked up the read the packet came from */
+        uint64_t mTick;
+        /* Adapter slot */
+        uint8_t mAdapter;
+        /* Bit per port with a controller plugged in */
+        uint8_t mConnectedPorts;
+        uint8_t mPadding[6];
+        PortState mPorts[PortCount];
+    };
+
+    static_assert(sizeof(ControllerState) == 72);
+
+    constexpr PortState DecodePort(const uint8_t* pPort)
+    {
+        const uint8_t* pAnalog = pPort + PortAnalogOffset;
+        return {
+            .mType = static_cast<uint8_t>(pPort[PortStatusOffset] >> PortStatusTypeShift),
+            .mStatus = pPort[PortStatusOffset],
+            .mButtons = static_cast<uint16_t>(pPort[PortButtonsOffset] | (pPort[PortButtonsOffset + 1] << 8)),
+            .mStickX = pAnalog[AnalogAxis_StickX],
+            .mStickY = pAnalog[AnalogAxis_StickY],
+            .mCStickX = pAnalog[AnalogAxis_CStickX],
+            .mCStickY = pAnalog[AnalogAxis_CStickY],
+            .mTriggerL = pAnalog[AnalogAxis_TriggerL],
+            .mTriggerR = pAnalog[AnalogAxis_TriggerR],
+            .mPadding = {},
+        };
+    }
+
+    /* Decodes the ports of a PacketSize byte packet, the sequence, tick and adapter are left for the caller to fill in */
+    constexpr void DecodePacket(const uint8_t* pPacket, ControllerState* pOut)
+    {
+        pOut->mConnectedPorts = 0;
+        for (size_t port = 0; port < PortCount; port++)
+        {
+            pOut->mPorts[port] = DecodePort(pPacket + PortOffset(port));
+            if (pOut->mPorts[port].mType != static_cast<uint8_t>(ControllerType::None))
+            {
+                pOut->mConnectedPorts |= static_cast<uint8_t>(1 << port);
+            }
+        }
+    }
+
+    namespace impl
+    {
+        /* A wired controller in port 1 holding A and Start with the stick pushed right, a wireless one in port 4, nothing in between */
+        constexpr bool CheckDecodePacket()
+        {
+            constexpr uint8_t Packet[PacketSize] = {
+                InputReportId,
+                0x14, 0x01, 0x01, 0xF0, 0x80, 0x81, 0x7F, 0x20, 0x30,
+                0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                0x24, 0x00, 0x0C, 0x80, 0x80, 0x80, 0x80, 0xFF, 0x00,
+            };
+
+            ControllerState State = {};
+            DecodePacket(Packet, &State);
+
+            const PortState& First = State.mPorts[0];
+            const PortState& Last = State.mPorts[3];
+            return State.mConnectedPorts == 0b1001
+                && First.mType == static_cast<uint8_t>(ControllerType::Wired) && First.mStatus == 0x14
+                && First.mButtons == (PortButton_A | PortButton_Start)
+                && First.mStickX == 0xF0 && First.mStickY == 0x80 && First.mCStickX == 0x81 && First.mCStickY == 0x7F
+                && First.mTriggerL == 0x20 && First.mTriggerR == 0x30
+                && State.mPorts[1].mType == static_cast<uint8_t>(ControllerType::None)
+                && Last.mType == static_cast<uint8_t>(ControllerType::Wireless)
+                && Last.mButtons == (PortButton_R | PortButton_L) && Last.mTriggerL == 0xFF && Last.mTriggerR == 0x00;
+        }
+    }
+
+    static_assert(impl::CheckDecodePacket());
+}
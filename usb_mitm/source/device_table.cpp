@@ -0,0 +1,143 @@
+#include "device_table.hpp"
+#include "logger.hpp"
+#include <cstdio>
+#include <cstring>
+
+namespace usb::devices
+{
+    using namespace ams::literals;
+    namespace
+    {
+        static constexpr DeviceEntry g_DefaultDevices[] = {
+            /* Official GameCube adapter. Its input packet is the report id followed by 4 ports of 9 bytes, the output packet */
+            /* is the 0x11 rumble command followed by one byte per port */
+            {
+                .mVendorId = 0x057E,
+                .mProductId = 0x0337,
+                .mInterfaceClass = 0x03,
+                .mTargetInterval = 1,
+                .mInputPacketSize = GameCubeAdapterInputSize,
+                .mOutputPacketSize = 5,
+            },
+        };
+
+        static_assert(std::size(g_DefaultDevices) <= MaxDevices);
+
+        static DeviceEntry g_Devices[MaxDevices];
+        static size_t g_NumDevices;
+
+        static constinit char g_ConfigPath[] = "sd:/config/usb_mitm/devices.txt";
+
+        /* Longest config file we bother reading, that's plenty for MaxDevices lines with comments */
+        static char g_ConfigBuffer[4_KB];
+
+        /* Adds an entry, replacing any existing entry for the same device */
+        static void AddDevice(const DeviceEntry& Device)
+        {
+            for (size_t i = 0; i < g_NumDevices; i++)
+            {
+                if (g_Devices[i].mVendorId == Device.mVendorId && g_Devices[i].mProductId == Device.mProductId)
+                {
+                    g_Devices[i] = Device;
+                    return;
+                }
+            }
+
+            if (g_NumDevices == MaxDevices)
+            {
+                ::usb::util::Log("[DeviceTable] Device table is full, ignoring %04x:%04x\n", Device.mVendorId, Device.mProductId);
+                return;
+            }
+            g_Devices[g_NumDevices++] = Device;
+        }
+
+        static void ParseLine(char* pLine, size_t LineNumber)
+        {
+            /* Strip comments */
+            if (char* pComment = std::strchr(pLine, '#'); pComment != nullptr)
+                *pComment = '\0';
+
+            unsigned VendorId, ProductId, InterfaceClass, Interval, InputSize, OutputSize;
+            char Extra;
+            const int NumFields = std::sscanf(pLine, "%x %x %x %u %u %u %c", &VendorId, &ProductId, &InterfaceClass, &Interval, &InputSize, &OutputSize, &Extra);
+
+            /* Blank line */
+            if (NumFields == EOF)
+                return;
+
+            if (NumFields != 6 || VendorId > UINT16_MAX || ProductId > UINT16_MAX || InterfaceClass > UINT8_MAX || Interval > 16
+                || InputSize == 0 || InputSize > UINT16_MAX || OutputSize > UINT16_MAX)
+            {
+                ::usb::util::Log("[DeviceTable] Ignoring malformed line %zu of %s\n", LineNumber, g_ConfigPath);
+                return;
+            }
+
+            AddDevice((DeviceEntry){
+                .mVendorId = static_cast<u16>(VendorId),
+                .mProductId = static_cast<u16>(ProductId),
+                .mInterfaceClass = static_cast<u8>(InterfaceClass),
+                .mTargetInterval = static_cast<u8>(Interval),
+                .mInputPacketSize = static_cast<u16>(InputSize),
+                .mOutputPacketSize = static_cast<u16>(OutputSize),
+            });
+        }
+
+        static void LoadConfig()
+        {
+            ams::fs::FileHandle File;
+            if (R_FAILED(ams::fs::OpenFile(std::addressof(File), g_ConfigPath, ams::fs::OpenMode_Read)))
+            {
+                ::usb::util::Log("[DeviceTable] No %s, using the built-in devices\n", g_ConfigPath);
+                return;
+            }
+            ON_SCOPE_EXIT { ams::fs::CloseFile(File); };
+
+            size_t Size;
+            R_ABORT_UNLESS(ams::fs::ReadFile(&Size, File, 0, g_ConfigBuffer, sizeof(g_ConfigBuffer) - 1));
+            g_ConfigBuffer[Size] = '\0';
+
+            size_t LineNumber = 1;
+            for (char* pLine = g_ConfigBuffer; pLine != nullptr; LineNumber++)
+            {
+                char* pNext = std::strchr(pLine, '\n');
+                if (pNext != nullptr)
+                    *pNext++ = '\0';
+
+                ParseLine(pLine, LineNumber);
+                pLine = pNext;
+            }
+        }
+    }
+
+    void Initialize()
+    {
+        g_NumDevices = 0;
+        for (const DeviceEntry& Device : g_DefaultDevices)
+        {
+            AddDevice(Device);
+        }
+
+        LoadConfig();
+
+        for (size_t i = 0; i < g_NumDevices; i++)
+        {
+            const DeviceEntry& Device = g_Devices[i];
+            ::usb::util::Log(
+                "[DeviceTable] %04x:%04x class %02x, bInterval %u, packets %u/%u%s\n",
+                Device.mVendorId, Device.mProductId, Device.mInterfaceClass, Device.mTargetInterval, Device.mInputPacketSize, Device.mOutputPacketSize,
+                IsDrivenByAdapterDriver(Device) ? ", driven by the adapter driver" : ""
+            );
+        }
+    }
+
+    size_t GetDeviceCount()
+    {
+        return g_NumDevices;
+    }
+
+    const DeviceEntry& GetDevice(size_t index)
+    {
+        AMS_ABORT_UNLESS(index < g_NumDevices, "Invalid device index");
+        return g_Devices[index];
+    }
+}
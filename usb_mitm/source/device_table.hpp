@@ -0,0 +1,40 @@
+#pragma once
+#include <stratosphere.hpp>
+
+/* Devices that get special treatment, loaded once at startup */
+/* The table starts out with the official GameCube adapter and can be extended (or the default entry overridden) through */
+/* sd:/config/usb_mitm/devices.txt, with one device per line: */
+/*     <vid> <pid> <interface class> <bInterval> <input packet size> <output packet size> */
+/* The ids and class are hex, the rest decimal. Anything after a '#' is a comment. For example, the default entry is: */
+/*     057e 0337 03 1 37 5 */
+namespace usb::devices
+{
+    /* Size of the input packet of the GameCube adapter protocol, devices with it get taken over by the driver thread */
+    static constexpr u16 GameCubeAdapterInputSize = 37;
+
+    static constexpr size_t MaxDevices = 8;
+
+    struct DeviceEntry
+    {
+        u16 mVendorId;
+        u16 mProductId;
+        /* Class of the interface HID acquires, matched by the mitm filter */
+        u8 mInterfaceClass;
+        /* bInterval the usb sysmodule patch forces onto the device's endpoints, 0 leaves the device's own value alone */
+        u8 mTargetInterval;
+        u16 mInputPacketSize;
+        u16 mOutputPacketSize;
+    };
+
+    /* Loads the table, must be called before the usb sysmodule gets patched or any interface is acquired */
+    void Initialize();
+
+    size_t GetDeviceCount();
+    const DeviceEntry& GetDevice(size_t index);
+
+    /* Whether the device speaks the GameCube adapter protocol, in which case the driver thread takes it over from HID */
+    inline bool IsDrivenByAdapterDriver(const DeviceEntry& Device)
+    {
+        return Device.mInputPacketSize == GameCubeAdapterInputSize;
+    }
+}
@@ -1,6 +1,15 @@
 #include "driver_thread.hpp"
+#include "adapter_packet.hpp"
+#include "packet_processing.hpp"
+#include "latency_stats.hpp"
+#include "shared_state.hpp"
+#include "usb_backend.hpp"
 #include "usb_shim.h"
 #include "logger.hpp"
+#include "trace.hpp"
+#include "capture.hpp"
+#include <cstring>
+#include <cmath>
 
 #define PAGE_ALIGN(e) (((e) + (ams::os::MemoryPageSize - 1)) & ~(ams::os::MemoryPageSize - 1))
 
@@ -11,6 +20,58 @@ namespace usb::gc
     {
         static constexpr size_t g_MaxAsyncXfers = 4;
 
+        static_assert(AdapterPacketSize == packet::PacketSize);
+
+        /* Number of reads kept in flight on each adapter's read endpoint */
+        /* With more than one URB queued, the USB stack always has a buffer to complete into while we process the previous one */
+#ifdef USB_MITM_READ_URB_DEPTH
+        static constexpr size_t g_ReadUrbDepth = USB_MITM_READ_URB_DEPTH;
+#else
+        static constexpr size_t g_ReadUrbDepth = 3;
+#endif
+        static_assert(g_ReadUrbDepth >= 2 && g_ReadUrbDepth <= 4, "Read URB depth must be between 2 and 4");
+
+        /* Limits on a single BatchBufferAsync request, the staging buffer for it lives on the IPC thread's stack */
+        static constexpr size_t g_MaxBatchTransferSize = 1_KB;
+
+        /* Number of reads we keep around per adapter, at 1000hz this is the last 64ms of input */
+        static constexpr size_t g_PacketHistoryLength = 64;
+
+        /* Largest packet HID writes to the adapter. It only ever sends the 5 byte rumble packet (0x11 + one byte per port) */
+        static constexpr size_t g_MaxWritePacketSize = 16;
+
+        /* Intervals between read completions longer than this are counted as missed polls */
+        static constexpr ams::TimeSpan g_PollingGapThreshold = ams::TimeSpan::FromMilliSeconds(2);
+
+        /* Running record of the time between read completions on an adapter, everything is in system ticks */
+        /* The sum of squares is kept as a double: a single gap of a few minutes (the console sleeping, say) squared is already */
+        /* past what 64 bits hold at 19.2MHz, and a double only loses precision far below what the standard deviation needs */
+        struct PollingAccumulator
+        {
+            u64 mIntervals;
+            u64 mSumTicks;
+            double mSumSquaredTicks;
+            u64 mLongestGapTicks;
+            u64 mGapsOverThreshold;
+        };
+
+        /* Write requested by HID, waiting to be put on the wire by the driver thread */
+        struct WriteRequest
+        {
+            u8 mData[g_MaxWritePacketSize];
+            u32 mSize;
+            /* System tick at which HID handed us the packet */
+            u64 mTick;
+        };
+
+        /* Packets of a single request from HID, which go out one after the other in this order. A PostBufferAsync is a */
+        /* batch of one, a BatchBufferAsync on the write endpoint has one packet per URB */
+        struct WriteBatch
+        {
+            WriteRequest mRequests[g_MaxBatchUrbs];
+            u32 mCount;
+        };
+
         /* Structure defining our adapter interface details */
         struct ProxyInterfaceImpl
         {
@@ -24,18 +85,13 @@ namespace usb::gc
             };
 
             Service mIfSession;
-            Service mReadEpSession;
-            Service mWriteEpSession;
+            backend::AdapterEndpoints mEndpoints;
 
             Handle mClientProcess;
             Handle mStateChangeEvent;
             Handle mCompletionEvents[CompletionEventId::MAX];
             Event mExposedCompletionEvents[CompletionEventId::MAX];
 
-            /* These structs go unused aside for a sanity check during initialization */
-            struct usb_endpoint_descriptor mReadDescriptor;
-            struct usb_endpoint_descriptor mWriteDescriptor;
-
             /* Pending async transfers so that the HID service can get it's state required to initialize */
             IntfAsyncXfer mPendingXfers[g_MaxAsyncXfers];
             u32 mNumPending;
@@ -43,11 +99,75 @@ namespace usb::gc
             UsbHsXferReport mLatestWriteReport;
             UsbHsXferReport mLatestReadReport;
 
+            /* Newest request HID wants written. Only the newest one matters, so requests that come in while a write is in flight */
+            /* simply replace each other and get coalesced into a single request. The packets within a request are never coalesced */
+            VersionedBuffer<WriteBatch> mWriteMailbox;
+
+            /* Write state, only touched by the driver thread */
+            bool mWriteInFlight;
+            /* Version of the newest mailbox entry that has been dealt with (written or skipped) */
+            u64 mWriteVersionHandled;
+            /* Request being worked through, and the index of its next packet to go out */
+            WriteBatch mWriteBatch;
+            u32 mWriteBatchNext;
+            /* Request currently on the wire, and the last one that made it to the adapter (mSize of 0 if none did) */
+            WriteRequest mWriteSubmitted;
+            WriteRequest mWriteOnWire;
+
+            /* Write counters exposed over usb:gc, written by the driver thread */
+            std::atomic<u64> mWritesSubmitted;
+            /* Requests that never had to go on the wire, either because they matched what the adapter already has or a newer one replaced them */
+            std::atomic<u64> mWritesAvoided;
+            std::atomic<u64> mWriteLatencyLastTicks;
+            std::atomic<u64> mWriteLatencyMaxTicks;
+
+            /* Number of read URBs currently queued on the read endpoint, only touched by the driver thread */
+            u32 mReadsInFlight;
+
+            /* Counters exposed over usb:gc, written by the driver thread */
+            std::atomic<u64> mReadsCompleted;
+            std::atomic<u64> mReadsFailed;
+            /* Completions that drained every queued read, meaning there was a window with no URB outstanding */
+            std::atomic<u64> mReadStarvedPolls;
+
+            /* Latest completed read, published by the driver thread once the transfer has landed */
+            /* This is what HID and usb:gc clients read from, they never touch the DMA buffer directly */
+            VersionedBuffer<AdapterPacket> mLatestPacket;
+
+            /* The latest successful read decoded per port, published by the driver thread alongside mLatestPacket */
+            VersionedBuffer<packet::ControllerState> mLatestState;
+            /* Only touched by the driver thread */
+            u64 mStatesDecoded;
+
+            /* Polling rate record, accumulated by the driver thread and published after every batch of reads */
+            PollingAccumulator mPolling;
+            u64 mLastArrivalTick;
+            VersionedBuffer<PollingAccumulator> mPollingSnapshot;
+            /* Set by usb:gc, the driver thread starts the record over the next time it updates it */
+            std::atomic<bool> mPollingResetRequested;
+
+            /* Timing of the packets handed to HID, recorded by the driver thread on publish and by ReadPacket on fetch */
+            stats::LatencyHistogram mWakeToPublish;
+            stats::LatencyHistogram mPublishToFetch;
+            stats::LatencyHistogram mSampleAge;
+
+            /* Every completed read, for consumers that want the full 1000hz stream rather than the latest packet */
+            PacketHistoryRing<g_PacketHistoryLength> mHistory;
+
+            /* Button bits seen across every read since HID last fetched a packet, only used with DeliveryMode::LatchPresses */
+            packet::ButtonLatch mLatchedButtons;
+
+            /* Only touched by the driver thread */
+            packet::AnalogFilterState mAnalogFilter;
+
             bool mHasStarted;
             bool mIsAcquired;
             bool mIsRequestShutdown;
 
-            void Initialize(Handle ClientProcess, Service IfSession, const UsbHsInterface* intf)
+            /* Index of the wait holder registered for each completion event, or -1. Only touched by the driver thread */
+            s32 mWaitHolders[CompletionEventId::MAX];
+
+            void Initialize(u32 Id, Handle ClientProcess, Service IfSession, const UsbHsInterface* intf)
             {
                 AMS_ASSERT(!mIsAcquired);
 
@@ -55,69 +175,53 @@ namespace usb::gc
                 mClientProcess = ClientProcess;
 
                 R_ABORT_UNLESS(usbHsIfGetCtrlXferCompletionEventFwd(&mIfSession, &mCompletionEvents[CompletionEventId::Interface]));
-                const struct usb_endpoint_descriptor *ReadEndpoint, *WriteEndpoint;
-
-                size_t i;
-                for (i = 0; i < 15; i++)
-                {
-                    ReadEndpoint = intf->inf.input_endpoint_descs + i;
-                    if (ReadEndpoint->bLength != 0)
-                        break;
-                }
-                AMS_ABORT_UNLESS(i < 15, "ReadEndpoint not found");
-
-                for (i = 0; i < 15; i++)
-                {
-                    WriteEndpoint = intf->inf.output_endpoint_descs + i;
-                    if (WriteEndpoint->bLength != 0)
-                        break;
-                }
-                AMS_ABORT_UNLESS(i < 15, "WriteEndpoint not found");
-
-                /* NOTE: We could hardcode the paramters here for these endpoints, but I'd rather showcase what exactly we're passing in like the libnx */
-                /* base implementation of these methods does */
-                R_ABORT_UNLESS(usbHsIfOpenUsbEpFwd(
-                    &mIfSession, &mReadEpSession, 1,
-                    (ReadEndpoint->bmAttributes & USB_TRANSFER_TYPE_MASK) + 1,
-                    ReadEndpoint->bEndpointAddress & USB_ENDPOINT_ADDRESS_MASK,
-                    (ReadEndpoint->bEndpointAddress & USB_ENDPOINT_IN) == 0 ? 0x1 : 0x2,
-                    ReadEndpoint->wMaxPacketSize,
-                    &mReadDescriptor
-                ));
-
-                R_ABORT_UNLESS(usbHsIfOpenUsbEpFwd(
-                    &mIfSession, &mWriteEpSession, 1,
-                    (WriteEndpoint->bmAttributes & USB_TRANSFER_TYPE_MASK) + 1,
-                    WriteEndpoint->bEndpointAddress & USB_ENDPOINT_ADDRESS_MASK,
-                    (WriteEndpoint->bEndpointAddress & USB_ENDPOINT_IN) == 0 ? 0x1 : 0x2,
-                    WriteEndpoint->wMaxPacketSize,
-                    &mWriteDescriptor
-                ));
-
-                /* Done automatically by libnx, must be explicitly done here */
-                R_ABORT_UNLESS(usbHsEpPopulateRingFwd(&mReadEpSession));
-                R_ABORT_UNLESS(usbHsEpPopulateRingFwd(&mWriteEpSession));
+                backend::OpenEndpoints(&mEndpoints, Id, &mIfSession, intf, g_ReadUrbDepth);
 
                 /* Endpoints have been opened, let's get the transfer completion events for all of them */
                 R_ABORT_UNLESS(usbHsIfGetStateChangeEventFwd(&mIfSession, &mStateChangeEvent));
-                R_ABORT_UNLESS(usbHsEpGetCompletionEventFwd(&mReadEpSession, &mCompletionEvents[CompletionEventId::ReadEndpoint]));
-                R_ABORT_UNLESS(usbHsEpGetCompletionEventFwd(&mWriteEpSession, &mCompletionEvents[CompletionEventId::WriteEndpoint]));
+                mCompletionEvents[CompletionEventId::ReadEndpoint] = backend::GetCompletionEvent(&mEndpoints, backend::EndpointId::Read);
+                mCompletionEvents[CompletionEventId::WriteEndpoint] = backend::GetCompletionEvent(&mEndpoints, backend::EndpointId::Write);
 
                 /* Let's create proxy events for all of the xfer completions, since we need control over when they get signaled or not */
                 R_ABORT_UNLESS(eventCreate(&mExposedCompletionEvents[CompletionEventId::Interface], false));
                 R_ABORT_UNLESS(eventCreate(&mExposedCompletionEvents[CompletionEventId::ReadEndpoint], false));
                 R_ABORT_UNLESS(eventCreate(&mExposedCompletionEvents[CompletionEventId::WriteEndpoint], false));
 
-                /* Quick Sanity Check */
-                /* Originally, this also did a sanity check on the bInterval values, but since the */
-                /* code for that could be possible to disable in the future, I removed them*/
-                AMS_ABORT_UNLESS(mReadDescriptor.bEndpointAddress == 0x81);
-                AMS_ABORT_UNLESS(mWriteDescriptor.bEndpointAddress == 0x2);
-
                 mLatestReadReport.xferId = UINT32_MAX;
                 mLatestWriteReport.xferId = UINT32_MAX;
+                mReadsInFlight = 0;
+                mReadsCompleted.store(0, std::memory_order_relaxed);
+                mReadsFailed.store(0, std::memory_order_relaxed);
+                mReadStarvedPolls.store(0, std::memory_order_relaxed);
+                mWriteMailbox.Reset();
+                mWriteInFlight = false;
+                mWriteVersionHandled = 0;
+                mWriteBatch.mCount = 0;
+                mWriteBatchNext = 0;
+                mWriteOnWire.mSize = 0;
+                mWritesSubmitted.store(0, std::memory_order_relaxed);
+                mWritesAvoided.store(0, std::memory_order_relaxed);
+                mWriteLatencyLastTicks.store(0, std::memory_order_relaxed);
+                mWriteLatencyMaxTicks.store(0, std::memory_order_relaxed);
+                mLatestPacket.Reset();
+                mLatestState.Reset();
+                mStatesDecoded = 0;
+                mWakeToPublish.Reset();
+                mPublishToFetch.Reset();
+                mSampleAge.Reset();
+                mPolling = {};
+                mLastArrivalTick = 0;
+                mPollingSnapshot.Reset();
+                mPollingResetRequested.store(false, std::memory_order_relaxed);
+                mHistory.Reset();
+                mLatchedButtons.Clear();
+                packet::ResetAnalogFilter(&mAnalogFilter);
                 mNumPending = 0;
                 mHasStarted = false;
+                for (size_t i = 0; i < CompletionEventId::MAX; i++)
+                {
+                    mWaitHolders[i] = -1;
+                }
                 mIsAcquired = true;
             }
 
@@ -129,15 +233,10 @@ namespace usb::gc
                 eventClose(&mExposedCompletionEvents[CompletionEventId::ReadEndpoint]);
                 eventClose(&mExposedCompletionEvents[CompletionEventId::Interface]);
 
-                svcCloseHandle(mCompletionEvents[CompletionEventId::WriteEndpoint]);
-                svcCloseHandle(mCompletionEvents[CompletionEventId::ReadEndpoint]);
+                /* The endpoint completion events belong to the backend */
                 svcCloseHandle(mCompletionEvents[CompletionEventId::Interface]);
+                backend::CloseEndpoints(&mEndpoints);
 
-                R_ABORT_UNLESS(usbHsEpCloseFwd(&mWriteEpSession));
-                R_ABORT_UNLESS(usbHsEpCloseFwd(&mReadEpSession));
-
-                serviceClose(&mWriteEpSession);
-                serviceClose(&mReadEpSession);
                 serviceClose(&mIfSession);
 
                 mIsAcquired = false;
@@ -151,7 +250,8 @@ namespace usb::gc
         {
             enum class Kind : u32 {
                 InterfaceChangeRequested,
-                InterfaceOperationFinished
+                InterfaceOperationFinished,
+                WriteRequested
             };
 
             Kind mKind;
@@ -159,8 +259,92 @@ namespace usb::gc
             ProxyInterfaceImpl::CompletionEventId mEventId;
         };
 
+        /* Fixed pool of wait holders for the driver thread's MultiWait that can be linked and unlinked one at a time, so that */
+        /* an adapter being opened/closed or a control transfer finishing doesn't require tearing down every other adapter's holders */
+        class WaitHolderRegistry
+        {
+        private:
+            struct Entry
+            {
+                ams::os::MultiWaitHolderType mHolder;
+                WaitHolderData mData;
+                bool mIsUsed;
+            };
+
+            ams::os::MultiWaitType mWaiter;
+            Entry mEntries[MAX_WAIT_OBJECTS];
+
+            s32 Allocate(const WaitHolderData& data)
+            {
+                for (s32 i = 0; i < MAX_WAIT_OBJECTS; i++)
+                {
+                    if (!mEntries[i].mIsUsed)
+                    {
+                        mEntries[i].mIsUsed = true;
+                        mEntries[i].mData = data;
+                        return i;
+                    }
+                }
+
+                AMS_ABORT("Ran out of wait holders");
+            }
+
+            void Link(s32 index)
+            {
+                ams::os::SetMultiWaitHolderUserData(&mEntries[index].mHolder, reinterpret_cast<uintptr_t>(&mEntries[index].mData));
+                ams::os::LinkMultiWaitHolder(&mWaiter, &mEntries[index].mHolder);
+            }
+
+        public:
+            void Initialize()
+            {
+                ams::os::InitializeMultiWait(&mWaiter);
+            }
+
+            /* Adds a holder to the end of the wait list, returning its index */
+            s32 Add(ams::os::EventType* pEvent, const WaitHolderData& data)
+            {
+                s32 Index = Allocate(data);
+                ams::os::InitializeMultiWaitHolder(&mEntries[Index].mHolder, pEvent);
+                Link(Index);
+                return Index;
+            }
+
+            s32 Add(Handle handle, const WaitHolderData& data)
+            {
+                s32 Index = Allocate(data);
+                ams::os::InitializeMultiWaitHolder(&mEntries[Index].mHolder, handle);
+                Link(Index);
+                return Index;
+            }
+
+            /* Unlinks and releases a holder, leaving every other holder linked */
+            void Remove(s32 index)
+            {
+                AMS_ASSERT(mEntries[index].mIsUsed);
+                ams::os::UnlinkMultiWaitHolder(&mEntries[index].mHolder);
+                ams::os::FinalizeMultiWaitHolder(&mEntries[index].mHolder);
+                mEntries[index].mIsUsed = false;
+            }
+
+            WaitHolderData* WaitAny()
+            {
+                ams::os::MultiWaitHolderType* pSignaled = ams::os::WaitAny(&mWaiter);
+                return reinterpret_cast<WaitHolderData*>(ams::os::GetMultiWaitHolderUserData(pSignaled));
+            }
+        };
+
         /* Global variables defining our thread state */
+        /* Number of adapter slots, every slot's memory is reserved up front so this is chosen at build time */
+        /* The driver thread waits on 3 events per adapter, which is what bounds this */
+#ifdef USB_MITM_MAX_ADAPTERS
+        static constexpr size_t g_MaxSupportedAdapters = USB_MITM_MAX_ADAPTERS;
+#else
         static constexpr size_t g_MaxSupportedAdapters = 4;
+#endif
+        static_assert(g_MaxSupportedAdapters >= 1, "At least one adapter slot is required");
+        /* The interface update and write request events, plus a read, write and control transfer holder for every adapter */
+        static_assert(2 + g_MaxSupportedAdapters * ProxyInterfaceImpl::CompletionEventId::MAX <= MAX_WAIT_OBJECTS);
         static constexpr size_t g_ThreadStackSize = 16_KB;
         static constexpr s32 g_ThreadPriority = -11;
         alignas(ams::os::MemoryPageSize) static u8 g_ThreadStack[g_ThreadStackSize];
@@ -171,30 +355,95 @@ namespace usb::gc
         /* Outside of looking for adapters to shut down/initialize */
         static ams::os::MutexType g_InterfaceMutex;
 
-        /* Our 4 Adapter Interfaces. These contain all of the state required for interacting with the GC adapters and proxying their */
+        /* Our Adapter Interfaces. These contain all of the state required for interacting with the GC adapters and proxying their */
         /* packets to/from the HID service */
         static ProxyInterfaceImpl g_Interfaces[g_MaxSupportedAdapters];
 
+        /* Slots that aren't acquired, used as a stack so a freshly released slot (with warm memory) is handed out first. Guarded by g_InterfaceMutex */
+        static u32 g_FreeSlots[g_MaxSupportedAdapters];
+        static size_t g_NumFreeSlots;
+
+        /* Signaled (with g_InterfaceMutex held) whenever a slot gets released, OpenInterface waits on this when every slot is taken */
+        static ams::os::ConditionVariableType g_SlotReleased;
+
+        /* How long OpenInterface waits for a slot to be released before giving the adapter back to usb:hs */
+        static constexpr ams::TimeSpan g_SlotWaitTimeout = ams::TimeSpan::FromMilliSeconds(500);
+        static WaitHolderRegistry g_WaitHolders;
+
+        /* How packets get handed to HID, per adapter slot. This is kept outside of the interfaces so it survives replugging an adapter */
+        static std::atomic<DeliveryMode> g_DeliveryModes[g_MaxSupportedAdapters];
+
+        /* Analog filter selected for each port of each adapter slot, one byte per port. Also survives replugging */
+        static std::atomic<u32> g_AnalogFilterModes[g_MaxSupportedAdapters];
+
         /* Event signaled when there is a large enough change to our thread state that we need to reconstruct our multi-waiter */
         static ams::os::EventType g_InterfaceUpdateRequested;
 
-        /* Packet Memory */
-        /* These are page-aligned regions of memory that we are going to read/write the packets to/from */
-        /* There are two pages assigned to each adapter (assigned statically) */
-        /* There is no synchronization here. If the client runs multiple "write" packets before we've read one, then it overrides the previous */
-        /* Packets they sent. This is similar to a mailbox */
-        alignas(ams::os::MemoryPageSize) static u8 g_AdapterRwMemory[g_MaxSupportedAdapters * ams::os::MemoryPageSize * 2];
+        /* Event signaled when HID has handed us a packet to write to one of the adapters */
+        static ams::os::EventType g_WriteRequested;
+
+        /* Shared State */
+        /* Read-only region handed out to usb:gc clients, holding the latest packet of every adapter slot. Only the driver thread writes to it */
+        using SharedStateRegion = shared::SharedState<g_MaxSupportedAdapters>;
+        static constexpr size_t g_SharedStateSize = PAGE_ALIGN(sizeof(SharedStateRegion));
+        static_assert(AdapterPacketSize == shared::SharedPacketSize);
+        static ams::os::SharedMemoryType g_SharedMemory;
+        static SharedStateRegion* g_pSharedState;
+
+        /* Packet Subscriptions */
+        /* usb:gc clients can ask for an event that gets signaled whenever a new packet is published for an adapter slot */
+        /* Subscribe (on the IPC thread) creates the event and then marks the slot active, after that only the driver thread touches */
+        /* the event: Unsubscribe just asks for it to be closed, so it can never be closed while the driver thread is signaling it */
+        enum class SubscriptionState : u32
+        {
+            Free,
+            Active,
+            CloseRequested,
+        };
+
+        struct PacketSubscription
+        {
+            std::atomic<SubscriptionState> mState;
+            u32 mAdapter;
+            bool mOnlyOnChange;
+            Event mEvent;
+
+            /* Last packet the subscriber got signaled for, only touched by the driver thread */
+            bool mHasLastData;
+            u8 mLastData[AdapterPacketSize];
+        };
+
+        static PacketSubscription g_Subscriptions[g_MaxSubscriptions];
+
+        /* Serializes clients looking for a free subscription slot */
+        static ams::os::MutexType g_SubscriptionMutex;
+
+        /* Time the driver thread spends bringing its wait holders in line with the interfaces, written by the driver thread */
+        static std::atomic<u64> g_WaiterSyncCount;
+        static std::atomic<u64> g_WaiterSyncLastTicks;
+        static std::atomic<u64> g_WaiterSyncMaxTicks;
+        static std::atomic<u64> g_WaiterSyncTotalTicks;
+
+        /* Slot Memory */
+        /* These are page-aligned regions of memory that belong to an adapter slot, and get handed out together with it */
+        struct AdapterSlotMemory
+        {
+            /* Packets get written to the adapter from here. Only the driver thread touches this, HID's packets go through mWriteMailbox */
+            alignas(ams::os::MemoryPageSize) u8 mWrite[ams::os::MemoryPageSize];
+
+            /* One page per queued read URB, indexed by the URB's transfer id */
+            alignas(ams::os::MemoryPageSize) u8 mReads[g_ReadUrbDepth][ams::os::MemoryPageSize];
+
+            /* Used for asynchronous interface transfers. Based on testing, the HID process does not double up on these transfers */
+            /* on the same interface, so one page per slot is enough */
+            alignas(ams::os::MemoryPageSize) u8 mAsyncXferScratch[ams::os::MemoryPageSize];
+        };
+
+        static AdapterSlotMemory g_SlotMemory[g_MaxSupportedAdapters];
 
         /* We special case this packet so that if HID requests a write before we've initialized properly (very unlikely) they don't overwrite this packet in a race condition */
         alignas(ams::os::MemoryPageSize) static u8 g_InitializePacket[ams::os::MemoryPageSize] = { 0x13 };
 
-        /* Async Transfer Scratch Memory */
-        /* Because we only support up to a max of 4 adapters plugged in (already likely more than enough), we can set aside a static */
-        /* region of memory that is used for asynchronous interface transfers. */
-        /* Based on testing, the HID process does not double up on these transfers on the same interface, so it's fine to assign these regions */
-        /* statically based on interface IDs */
-        alignas(ams::os::MemoryPageSize) static u8 g_AsyncXferScratch[ams::os::MemoryPageSize * g_MaxSupportedAdapters];
-
         /* Memory Transfer */
         /* We need to have a page of memory that we are able to map/unmap at runtime in order to read/write to/from the client buffers */
         /* This memory space must be identified at runtime, we have no way to unmap our own processes's data memory region, otherwise */
@@ -202,236 +451,579 @@ namespace usb::gc
         static ams::os::MutexType g_TransferMutex;
         static uintptr_t g_TransferMemory;
 
-        static u8* MemoryForInterface(u32 id, bool read) {
-            return g_AdapterRwMemory + ams::os::MemoryPageSize * (id * 2 + (read ? 1 : 0));
+        /* Client pages get mapped into the transfer window for the duration of a single transfer, and unmapped before it returns */
+        /* Keeping them mapped across transfers isn't safe: MapProcessMemory doesn't pin the source pages, so once HID frees a buffer */
+        /* and its address gets backed by new pages, a mapping kept around would still alias the old ones. Nothing the kernel lets us */
+        /* query (svcQueryProcessMemory reports no physical address) can tell that happened */
+        /* The window fits the largest control transfer (16 bit length) at any alignment */
+        static constexpr size_t g_TransferWindowSize = 64_KB + ams::os::MemoryPageSize;
+
+        static u64 TicksToNs(u64 Ticks) {
+            return static_cast<u64>(ams::os::ConvertToTimeSpan(ams::os::Tick(Ticks)).GetNanoSeconds());
         }
 
-        static void DriverThreadFunction(void*)
+        /* Runs a write to a shared state slot under its sequence counter, see SharedAdapterSlot */
+        template<typename F>
+        static void WriteSharedSlot(u32 id, F Write)
         {
-            ams::os::MultiWaitType Waiter;
-            ams::os::MultiWaitHolderType WaitHolders[MAX_WAIT_OBJECTS];
-            WaitHolderData WaitHolderDatas[MAX_WAIT_OBJECTS];
-            u32 WaitHolderCount = 0;
+            shared::SharedAdapterSlot* pSlot = &g_pSharedState->mSlots[id];
+            const u32 Sequence = pSlot->mSequence.load(std::memory_order_relaxed);
 
-            u32 EnabledInterfaces[g_MaxSupportedAdapters] = { 0 };
-            u32 EnabledIntfCount = 0;
+            pSlot->mSequence.store(Sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            Write(pSlot);
+            pSlot->mSequence.store(Sequence + 2, std::memory_order_release);
+        }
 
-            DEBUG("[DriverThread::Driver] Initializing thread\n");
+        static u8* WriteMemoryForInterface(u32 id) {
+            return g_SlotMemory[id].mWrite;
+        }
+
+        static u8* ReadMemoryForInterface(u32 id, size_t urb) {
+            return g_SlotMemory[id].mReads[urb];
+        }
+
+        static u8* AsyncXferScratchForInterface(u32 id) {
+            return g_SlotMemory[id].mAsyncXferScratch;
+        }
 
-            ams::os::InitializeMultiWait(&Waiter);
-
-            /* Wait for the first time an interface update is requested */
-            /* After this initial wait, this event gets added to a multi-wait list */
-            DEBUG("[DriverThread::Driver] Waiting for first interface request\n");
-            ams::os::WaitEvent(&g_InterfaceUpdateRequested);
-            while (true) {
-                DEBUG("[DriverThread::Driver] Interface state change requested, reconstructing async waiters\n");
-                /* We clear the event explicitly (and declare it without autoclear) */
-                /* This is because when the event gets signaled from a MultiWait it does not clear even if autoclear is set */
-                ams::os::ClearEvent(&g_InterfaceUpdateRequested);
-                EnabledIntfCount = 0;
-
-                /* Find the number of enabled interfaces */
-                ams::os::LockMutex(&g_InterfaceMutex);
-                for (u32 i = 0; i < g_MaxSupportedAdapters; i++)
+        /* Queues a read into the buffer of the specified URB slot. The slot is passed as the transfer id so we can find */
+        /* the buffer again from the report */
+        static void PostRead(ProxyInterfaceImpl* pIntf, u32 id, size_t urb)
+        {
+            backend::PostBuffer(&pIntf->mEndpoints, backend::EndpointId::Read, ReadMemoryForInterface(id, urb), AdapterPacketSize, urb);
+            pIntf->mReadsInFlight++;
+        }
+
+        /* Copies a finished read out of the DMA buffer and makes it visible to readers */
+        /* Only called for reads that succeeded with a full packet, see PublishReadError for the others */
+        static void PublishReadPacket(ProxyInterfaceImpl* pIntf, u32 id, const u8* pBuffer, u64 WakeTick)
+        {
+            AdapterPacket Packet;
+            Packet.mReport = pIntf->mLatestReadReport;
+            std::memcpy(Packet.mData, pBuffer, AdapterPacketSize);
+
+            /* The history always holds the raw packets */
+            pIntf->mHistory.Push(WakeTick, Packet.mReport, Packet.mData);
+            capture::Record(capture::RecordKind::Read, static_cast<u8>(id), WakeTick, Packet.mReport.res, Packet.mData, AdapterPacketSize);
+
+            if (g_DeliveryModes[id].load(std::memory_order_relaxed) == DeliveryMode::LatchPresses)
+            {
+                pIntf->mLatchedButtons.Accumulate(Packet.mData);
+            }
+
+            packet::PushAnalogSample(&pIntf->mAnalogFilter, Packet.mData);
+
+            const u32 PackedModes = g_AnalogFilterModes[id].load(std::memory_order_relaxed);
+            if (PackedModes != 0)
+            {
+                packet::AnalogFilterMode Modes[packet::PortCount];
+                for (size_t port = 0; port < packet::PortCount; port++)
                 {
-                    if (g_Interfaces[i].mIsRequestShutdown)
-                        g_Interfaces[i].Finalize();
-                    else if (g_Interfaces[i].mIsAcquired)
-                        EnabledInterfaces[EnabledIntfCount++] = i;
+                    Modes[port] = static_cast<packet::AnalogFilterMode>((PackedModes >> (8 * port)) & 0xFF);
                 }
-                ams::os::UnlockMutex(&g_InterfaceMutex);
+                packet::ApplyAnalogFilter(&pIntf->mAnalogFilter, Modes, Packet.mData);
+            }
 
-                /* If we currently don't have any interfaces, then restart the loop waiting for the next update event */
-                if (EnabledIntfCount == 0) {
-                    DEBUG("[DriverThread::Driver] No enabled interfaces, waiting until another interface request\n");
-                    ams::os::WaitEvent(&g_InterfaceUpdateRequested);
+            /* Decoded once here rather than by every consumer. This is the packet as HID gets it, analog filters included, */
+            /* latched buttons are only merged in when HID fetches it */
+            packet::ControllerState State;
+            packet::DecodePacket(Packet.mData, &State);
+            State.mSequence = ++pIntf->mStatesDecoded;
+            State.mTick = WakeTick;
+            State.mAdapter = static_cast<u8>(id);
+            std::memset(State.mPadding, 0, sizeof(State.mPadding));
+            pIntf->mLatestState.Publish(State);
+
+            Packet.mWakeTick = WakeTick;
+            Packet.mPublishTick = ams::os::GetSystemTick().GetInt64Value();
+            pIntf->mWakeToPublish.Record(TicksToNs(Packet.mPublishTick - WakeTick));
+            pIntf->mLatestPacket.Publish(Packet);
+
+            WriteSharedSlot(id, [&](shared::SharedAdapterSlot* pSlot) {
+                pSlot->mPacketCount++;
+                pSlot->mTick = WakeTick;
+                std::memcpy(pSlot->mData, Packet.mData, AdapterPacketSize);
+            });
+
+            /* Wake up everyone waiting on this adapter */
+            for (PacketSubscription& Subscription : g_Subscriptions)
+            {
+                if (Subscription.mState.load(std::memory_order_acquire) != SubscriptionState::Active || Subscription.mAdapter != id)
                     continue;
+
+                if (Subscription.mOnlyOnChange)
+                {
+                    if (Subscription.mHasLastData && std::memcmp(Subscription.mLastData, Packet.mData, AdapterPacketSize) == 0)
+                        continue;
+
+                    std::memcpy(Subscription.mLastData, Packet.mData, AdapterPacketSize);
+                    Subscription.mHasLastData = true;
                 }
 
-                DEBUG("[DriverThread::Driver] There are %u enabled interfaces\n", EnabledIntfCount);
+                eventFire(&Subscription.mEvent);
+            }
+        }
+
+        /* A failed or short read leaves whatever was in the read buffer before, so none of it gets published. Only its report */
+        /* is passed on, alongside the last packet that did arrive, so that HID still sees the error */
+        static void PublishReadError(ProxyInterfaceImpl* pIntf, u32 id, u64 WakeTick)
+        {
+            AdapterPacket Packet = {};
+            pIntf->mLatestPacket.Read(&Packet);
+            Packet.mReport = pIntf->mLatestReadReport;
+
+            pIntf->mHistory.Push(WakeTick, Packet.mReport, Packet.mData);
+            capture::Record(capture::RecordKind::Read, static_cast<u8>(id), WakeTick, Packet.mReport.res);
+
+            Packet.mPublishTick = ams::os::GetSystemTick().GetInt64Value();
+            pIntf->mLatestPacket.Publish(Packet);
+        }
+
+        /* Adds the reads that completed since the last wake up to the polling record */
+        /* When several reads get drained on the same wake up we can't tell when each of them completed. The first one gets */
+        /* the whole time since the previous wake up and the rest count as back to back, so a stall shows up as one long gap */
+        /* rather than being spread out into a run of ordinary looking intervals */
+        static void RecordReadArrivals(ProxyInterfaceImpl* pIntf, u64 WakeTick, u32 NumArrived)
+        {
+            if (pIntf->mPollingResetRequested.exchange(false, std::memory_order_relaxed))
+            {
+                pIntf->mPolling = {};
+                pIntf->mLastArrivalTick = 0;
+            }
+
+            if (NumArrived == 0)
+                return;
 
-                DEBUG("[DriverThread::Driver] Cleaning up previous waiter\n");
-                /* Initialize our MultiWait holder again */
-                ams::os::UnlinkAllMultiWaitHolder(&Waiter);
-                for (u32 i = 0; i < WaitHolderCount; i++)
+            if (pIntf->mLastArrivalTick != 0)
+            {
+                const u64 Gap = WakeTick - pIntf->mLastArrivalTick;
+                PollingAccumulator* pPolling = &pIntf->mPolling;
+                pPolling->mIntervals += NumArrived;
+                pPolling->mSumTicks += Gap;
+                pPolling->mSumSquaredTicks += static_cast<double>(Gap) * static_cast<double>(Gap);
+                pPolling->mLongestGapTicks = std::max(pPolling->mLongestGapTicks, Gap);
+                if (Gap > static_cast<u64>(ams::os::ConvertToTick(g_PollingGapThreshold).GetInt64Value()))
                 {
-                    ams::os::FinalizeMultiWaitHolder(&WaitHolders[i]);
+                    pPolling->mGapsOverThreshold++;
                 }
+                pIntf->mPollingSnapshot.Publish(*pPolling);
+            }
 
-                DEBUG("[DriverThread::Driver] Initializing new waiter\n");
-                /* Reinitialize our first event (InterfaceChangeRequested) */
-                /* TODO: Abstract this into a struct with an associated method since this is very easy to make mistakes on */
-                WaitHolderCount = 0;
-                WaitHolderDatas[WaitHolderCount] = (WaitHolderData){
-                    .mKind = WaitHolderData::Kind::InterfaceChangeRequested
-                };
-                ams::os::InitializeMultiWaitHolder(&WaitHolders[WaitHolderCount], &g_InterfaceUpdateRequested);
-                ams::os::SetMultiWaitHolderUserData(&WaitHolders[WaitHolderCount], reinterpret_cast<uintptr_t>(&WaitHolderDatas[WaitHolderCount]));
-                ams::os::LinkMultiWaitHolder(&Waiter, &WaitHolders[WaitHolderCount++]);
+            pIntf->mLastArrivalTick = WakeTick;
+        }
 
+        /* Puts the next packet HID asked for on the wire, unless a write is already in flight (its completion will call this again) */
+        /* The packets of a request go out in order, once all of them have the newest request is picked up from the mailbox */
+        /* Packets that match what the adapter already has are dropped, so rumble only costs bus time when it actually changes */
+        static void SubmitPendingWrite(ProxyInterfaceImpl* pIntf, u32 id)
+        {
+            if (pIntf->mWriteInFlight)
+                return;
 
-                /* For each of our enabled interfaces, add their read/write endpoints to the MultiWaiter */
-                for (u32 i = 0; i < EnabledIntfCount; i++)
+            const WriteRequest* pRequest = nullptr;
+            while (pRequest == nullptr)
+            {
+                if (pIntf->mWriteBatchNext == pIntf->mWriteBatch.mCount)
                 {
-                    u32 IntfId = EnabledInterfaces[i];
-                    /* Before adding to the multi-wait list, we check to see if the adapter has started yet */
-                    /* Starting the adapter means that you send a packet that simply indicates it's time to start polling*/
-                    /* TODO: Should this really be handled here? I don't know, maybe we just allow the HID service to send this */
-                    if (!g_Interfaces[IntfId].mHasStarted)
+                    const u64 Version = pIntf->mWriteMailbox.Read(&pIntf->mWriteBatch);
+                    if (Version == pIntf->mWriteVersionHandled)
                     {
-                        DEBUG("[DriverThread::Driver] Adapter interface %u has not yet started, sending initialization packet and requesting read\n", IntfId);
-                        u32 dummy;
-                        R_ABORT_UNLESS(usbHsEpPostBufferAsyncFwd(
-                            &g_Interfaces[IntfId].mWriteEpSession,
-                            g_InitializePacket,
-                            1,
-                            0,
-                            &dummy
-                        ));
-                        R_ABORT_UNLESS(usbHsEpPostBufferAsyncFwd(
-                            &g_Interfaces[IntfId].mReadEpSession,
-                            MemoryForInterface(IntfId, true),
-                            37,
-                            0,
-                            &dummy
-                        ));
-                        g_Interfaces[IntfId].mHasStarted = true;
+                        pIntf->mWriteBatchNext = pIntf->mWriteBatch.mCount;
+                        return;
                     }
 
-                    /* Priority matters here */
-                    /* The MultiWait will signal the first one of these events which gets fired, and if multiple of them are active at a time it will */
-                    /* the one first in the list (I believe). So putting these at the start (and read before write) means that it won't get blocked by async xfer */
-                    /* requests. */
-                    WaitHolderDatas[WaitHolderCount] = (WaitHolderData){
-                        .mKind = WaitHolderData::Kind::InterfaceOperationFinished,
-                        .mIntfId = IntfId,
-                        .mEventId = ProxyInterfaceImpl::CompletionEventId::ReadEndpoint
-                    };
-                    WaitHolderDatas[WaitHolderCount + 1] = (WaitHolderData){
-                        .mKind = WaitHolderData::Kind::InterfaceOperationFinished,
-                        .mIntfId = IntfId,
-                        .mEventId = ProxyInterfaceImpl::CompletionEventId::WriteEndpoint
-                    };
-
-                    ams::os::InitializeMultiWaitHolder(&WaitHolders[WaitHolderCount], g_Interfaces[IntfId].mCompletionEvents[ProxyInterfaceImpl::CompletionEventId::ReadEndpoint]);
-                    ams::os::InitializeMultiWaitHolder(&WaitHolders[WaitHolderCount + 1], g_Interfaces[IntfId].mCompletionEvents[ProxyInterfaceImpl::CompletionEventId::WriteEndpoint]);
-                    ams::os::SetMultiWaitHolderUserData(&WaitHolders[WaitHolderCount], reinterpret_cast<uintptr_t>(&WaitHolderDatas[WaitHolderCount]));
-                    ams::os::SetMultiWaitHolderUserData(&WaitHolders[WaitHolderCount + 1], reinterpret_cast<uintptr_t>(&WaitHolderDatas[WaitHolderCount + 1]));
-                    ams::os::LinkMultiWaitHolder(&Waiter, &WaitHolders[WaitHolderCount++]);
-                    ams::os::LinkMultiWaitHolder(&Waiter, &WaitHolders[WaitHolderCount++]);
-
-                    /* We only add one pending async xfer at a time since 1.) the HID service does not stack these, and 2.) we only have so many memory regions available */
-                    if (g_Interfaces[IntfId].mNumPending > 0)
+                    /* Every request between the last one we handled and this one got replaced before it could go out */
+                    pIntf->mWritesAvoided.fetch_add(Version - pIntf->mWriteVersionHandled - 1, std::memory_order_relaxed);
+                    pIntf->mWriteVersionHandled = Version;
+                    pIntf->mWriteBatchNext = 0;
+                }
+
+                const WriteRequest* pNext = &pIntf->mWriteBatch.mRequests[pIntf->mWriteBatchNext++];
+                if (pNext->mSize == pIntf->mWriteOnWire.mSize && std::memcmp(pNext->mData, pIntf->mWriteOnWire.mData, pNext->mSize) == 0)
+                {
+                    pIntf->mWritesAvoided.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                pRequest = pNext;
+            }
+
+            const WriteRequest& Request = *pRequest;
+            pIntf->mWriteSubmitted = Request;
+            std::memcpy(WriteMemoryForInterface(id), Request.mData, Request.mSize);
+
+            backend::PostBuffer(&pIntf->mEndpoints, backend::EndpointId::Write, WriteMemoryForInterface(id), Request.mSize, 0);
+            pIntf->mWriteInFlight = true;
+            pIntf->mWritesSubmitted.fetch_add(1, std::memory_order_relaxed);
+            trace::RecordEvent(trace::EventId::WriteSubmitted, static_cast<u8>(id), Request.mSize);
+            capture::Record(capture::RecordKind::Write, static_cast<u8>(id), ams::os::GetSystemTick().GetInt64Value(), 0, Request.mData, static_cast<u16>(Request.mSize));
+        }
+
+        static void AddInterfaceWaitHolder(WaitHolderRegistry* pRegistry, u32 IntfId, ProxyInterfaceImpl::CompletionEventId EventId)
+        {
+            ProxyInterfaceImpl* pIntf = &g_Interfaces[IntfId];
+            AMS_ASSERT(pIntf->mWaitHolders[EventId] < 0);
+            pIntf->mWaitHolders[EventId] = pRegistry->Add(pIntf->mCompletionEvents[EventId], (WaitHolderData){
+                .mKind = WaitHolderData::Kind::InterfaceOperationFinished,
+                .mIntfId = IntfId,
+                .mEventId = EventId
+            });
+        }
+
+        static void RemoveInterfaceWaitHolder(WaitHolderRegistry* pRegistry, u32 IntfId, ProxyInterfaceImpl::CompletionEventId EventId)
+        {
+            ProxyInterfaceImpl* pIntf = &g_Interfaces[IntfId];
+            if (pIntf->mWaitHolders[EventId] >= 0)
+            {
+                pRegistry->Remove(pIntf->mWaitHolders[EventId]);
+                pIntf->mWaitHolders[EventId] = -1;
+            }
+        }
+
+        /* Brings the registered wait holders in line with the state of every interface */
+        /* Only interfaces that actually changed get their holders touched, everyone else keeps streaming */
+        static void SyncInterfaceWaitHolders(WaitHolderRegistry* pRegistry)
+        {
+            const s64 StartTick = ams::os::GetSystemTick().GetInt64Value();
+
+            /* Unsubscribing is handled here since we are the only ones allowed to close a subscription's event */
+            for (PacketSubscription& Subscription : g_Subscriptions)
+            {
+                if (Subscription.mState.load(std::memory_order_acquire) == SubscriptionState::CloseRequested)
+                {
+                    eventClose(&Subscription.mEvent);
+                    Subscription.mState.store(SubscriptionState::Free, std::memory_order_release);
+                }
+            }
+
+            ams::os::LockMutex(&g_InterfaceMutex);
+            for (u32 IntfId = 0; IntfId < g_MaxSupportedAdapters; IntfId++)
+            {
+                ProxyInterfaceImpl* pIntf = &g_Interfaces[IntfId];
+
+                if (pIntf->mIsRequestShutdown)
+                {
+                    DEBUG("[DriverThread::Driver] Adapter interface %u is shutting down, removing its waiters\n", IntfId);
+                    /* The holders have to go before Finalize closes the handles they wait on */
+                    RemoveInterfaceWaitHolder(pRegistry, IntfId, ProxyInterfaceImpl::CompletionEventId::ReadEndpoint);
+                    RemoveInterfaceWaitHolder(pRegistry, IntfId, ProxyInterfaceImpl::CompletionEventId::WriteEndpoint);
+                    RemoveInterfaceWaitHolder(pRegistry, IntfId, ProxyInterfaceImpl::CompletionEventId::Interface);
+                    pIntf->Finalize();
+                    capture::Record(capture::RecordKind::AdapterClosed, static_cast<u8>(IntfId), ams::os::GetSystemTick().GetInt64Value());
+
+                    WriteSharedSlot(IntfId, [](shared::SharedAdapterSlot* pSlot) {
+                        pSlot->mFlags &= ~shared::SlotFlag_Connected;
+                    });
+
+                    /* Hand the slot back and wake up anyone waiting for one */
+                    g_FreeSlots[g_NumFreeSlots++] = IntfId;
+                    ams::os::BroadcastConditionVariable(&g_SlotReleased);
+                    continue;
+                }
+
+                if (!pIntf->mIsAcquired)
+                    continue;
+
+                /* Before adding to the multi-wait list, we check to see if the adapter has started yet */
+                /* Starting the adapter means that you send a packet that simply indicates it's time to start polling*/
+                /* TODO: Should this really be handled here? I don't know, maybe we just allow the HID service to send this */
+                if (!pIntf->mHasStarted)
+                {
+                    DEBUG("[DriverThread::Driver] Adapter interface %u has not yet started, sending initialization packet and requesting read\n", IntfId);
+                    capture::Record(capture::RecordKind::AdapterOpened, static_cast<u8>(IntfId), ams::os::GetSystemTick().GetInt64Value());
+                    backend::PostBuffer(&pIntf->mEndpoints, backend::EndpointId::Write, g_InitializePacket, 1, 0);
+                    capture::Record(capture::RecordKind::Write, static_cast<u8>(IntfId), ams::os::GetSystemTick().GetInt64Value(), 0, g_InitializePacket, 1);
+                    /* Writes HID requests get held back until this one has completed */
+                    pIntf->mWriteSubmitted.mSize = 0;
+                    pIntf->mWriteInFlight = true;
+                    for (size_t urb = 0; urb < g_ReadUrbDepth; urb++)
                     {
-                        DEBUG("[DriverThread::Driver] Adapter interface %u has %u pending async transfer requests, processing the first one\n", IntfId, g_Interfaces[IntfId].mNumPending);
-                        WaitHolderDatas[WaitHolderCount] = (WaitHolderData){
-                            .mKind = WaitHolderData::Kind::InterfaceOperationFinished,
-                            .mIntfId = IntfId,
-                            .mEventId = ProxyInterfaceImpl::CompletionEventId::Interface
-                        };
-                        ams::os::InitializeMultiWaitHolder(&WaitHolders[WaitHolderCount], g_Interfaces[IntfId].mCompletionEvents[ProxyInterfaceImpl::CompletionEventId::Interface]);
-                        ams::os::SetMultiWaitHolderUserData(&WaitHolders[WaitHolderCount], reinterpret_cast<uintptr_t>(&WaitHolderDatas[WaitHolderCount]));
-                        ams::os::LinkMultiWaitHolder(&Waiter, &WaitHolders[WaitHolderCount++]);
+                        PostRead(pIntf, IntfId, urb);
                     }
+                    pIntf->mHasStarted = true;
+
+                    WriteSharedSlot(IntfId, [](shared::SharedAdapterSlot* pSlot) {
+                        pSlot->mFlags |= shared::SlotFlag_Connected;
+                        pSlot->mPacketCount = 0;
+                        pSlot->mTick = 0;
+                        std::memset(pSlot->mData, 0, sizeof(pSlot->mData));
+                    });
+                }
+
+                /* Priority matters here */
+                /* The MultiWait will signal the first one of these events which gets fired, and if multiple of them are active at a time it will */
+                /* the one first in the list (I believe). So adding read before write means that it won't get blocked by them. */
+                /* NOTE: Holders are appended, so a newly opened adapter's endpoints land behind any control transfer holders of other adapters. */
+                /* Those are rare and short lived, so this doesn't matter in practice. */
+                if (pIntf->mWaitHolders[ProxyInterfaceImpl::CompletionEventId::ReadEndpoint] < 0)
+                {
+                    DEBUG("[DriverThread::Driver] Adding waiters for adapter interface %u\n", IntfId);
+                    AddInterfaceWaitHolder(pRegistry, IntfId, ProxyInterfaceImpl::CompletionEventId::ReadEndpoint);
+                    AddInterfaceWaitHolder(pRegistry, IntfId, ProxyInterfaceImpl::CompletionEventId::WriteEndpoint);
                 }
 
-                /* Now that we've configured out multi-waiter, we are going to wait in a loop and continuously process requests */
-                bool NeedsBreak = false;
-                while (!NeedsBreak)
+                /* We only wait on one pending async xfer at a time since 1.) the HID service does not stack these, and 2.) we only have so many memory regions available */
+                if (pIntf->mNumPending > 0 && pIntf->mWaitHolders[ProxyInterfaceImpl::CompletionEventId::Interface] < 0)
+                {
+                    DEBUG("[DriverThread::Driver] Adapter interface %u has %u pending async transfer requests, processing the first one\n", IntfId, pIntf->mNumPending);
+                    AddInterfaceWaitHolder(pRegistry, IntfId, ProxyInterfaceImpl::CompletionEventId::Interface);
+                }
+            }
+            ams::os::UnlockMutex(&g_InterfaceMutex);
+
+            trace::RecordSpan(trace::EventId::WaiterSync, trace::NoAdapter, StartTick);
+
+            const u64 Elapsed = ams::os::GetSystemTick().GetInt64Value() - StartTick;
+            g_WaiterSyncCount.fetch_add(1, std::memory_order_relaxed);
+            g_WaiterSyncTotalTicks.fetch_add(Elapsed, std::memory_order_relaxed);
+            g_WaiterSyncLastTicks.store(Elapsed, std::memory_order_relaxed);
+            if (Elapsed > g_WaiterSyncMaxTicks.load(std::memory_order_relaxed))
+            {
+                g_WaiterSyncMaxTicks.store(Elapsed, std::memory_order_relaxed);
+            }
+        }
+
+        static void DriverThreadFunction(void*)
+        {
+            DEBUG("[DriverThread::Driver] Initializing thread\n");
+            trace::RegisterCurrentThread(trace::ThreadId::Driver);
+
+            g_WaitHolders.Initialize();
+            g_WaitHolders.Add(&g_InterfaceUpdateRequested, (WaitHolderData){
+                .mKind = WaitHolderData::Kind::InterfaceChangeRequested
+            });
+            g_WaitHolders.Add(&g_WriteRequested, (WaitHolderData){
+                .mKind = WaitHolderData::Kind::WriteRequested
+            });
+
+            /* Continuously process requests, only touching the wait holders of interfaces that changed */
+            while (true)
+            {
+                WaitHolderData* pUserData = g_WaitHolders.WaitAny();
+                const u64 WakeTick = ams::os::GetSystemTick().GetInt64Value();
+                trace::RecordEvent(
+                    trace::EventId::DriverWake,
+                    pUserData->mKind == WaitHolderData::Kind::InterfaceOperationFinished ? static_cast<u8>(pUserData->mIntfId) : trace::NoAdapter,
+                    static_cast<u32>(pUserData->mKind),
+                    static_cast<u32>(pUserData->mEventId)
+                );
+                switch (pUserData->mKind)
                 {
-                    ams::os::MultiWaitHolderType* pSignaled = ams::os::WaitAny(&Waiter);
+                    /* If the client did something that would indicate a change in interface, update the holders of that interface */
+                    case WaitHolderData::Kind::InterfaceChangeRequested:
+                    {
+                        DEBUG("[DriverThread::Driver] Waiter signaled with interface state change, updating waiters\n");
+                        /* We clear the event explicitly (and declare it without autoclear) */
+                        /* This is because when the event gets signaled from a MultiWait it does not clear even if autoclear is set */
+                        ams::os::ClearEvent(&g_InterfaceUpdateRequested);
+                        SyncInterfaceWaitHolders(&g_WaitHolders);
+                        break;
+                    }
 
-                    WaitHolderData* pUserData = reinterpret_cast<WaitHolderData*>(ams::os::GetMultiWaitHolderUserData(pSignaled));
-                    switch (pUserData->mKind)
+                    /* HID handed us a new packet to write, get it on the wire for every adapter that isn't busy writing already */
+                    case WaitHolderData::Kind::WriteRequested:
                     {
-                        /* If the client did something that would indicate a change in interface, we need to restart our loop */
-                        case WaitHolderData::Kind::InterfaceChangeRequested: 
-                        DEBUG("[DriverThread::Driver] Waiter signaled with interface state change, reinitializing the thread variables\n");
-                        NeedsBreak = true;
+                        ams::os::ClearEvent(&g_WriteRequested);
+                        for (u32 IntfId = 0; IntfId < g_MaxSupportedAdapters; IntfId++)
+                        {
+                            ProxyInterfaceImpl* pIntf = &g_Interfaces[IntfId];
+                            /* Only adapters that we are waiting on can have a write completion come back */
+                            if (pIntf->mWaitHolders[ProxyInterfaceImpl::CompletionEventId::WriteEndpoint] >= 0)
+                            {
+                                SubmitPendingWrite(pIntf, IntfId);
+                            }
+                        }
                         break;
+                    }
 
-                        /* Otherwise, process our data requests as usual */
-                        case WaitHolderData::Kind::InterfaceOperationFinished:
+                    /* Otherwise, process our data requests as usual */
+                    case WaitHolderData::Kind::InterfaceOperationFinished:
+                    {
                         ProxyInterfaceImpl* pIntf = &g_Interfaces[pUserData->mIntfId];
                         IntfAsyncXfer* pRequest;
 
                         /* Reset the signal on the event since it's not autocleared */
                         R_ABORT_UNLESS(ams::svc::ResetSignal(pIntf->mCompletionEvents[pUserData->mEventId]));
 
-                        u32 dummy;
                         switch (pUserData->mEventId)
                         {
                             case ProxyInterfaceImpl::CompletionEventId::Interface:
                                 /* Technically super thread unsafe, but the HID service only submits one of these per intf at a time */
                                 pRequest = &pIntf->mPendingXfers[--pIntf->mNumPending];
 
-                                /* Populate the response regions of the async xfer request and then recreate the multi-wait because this one is now invalid */
+                                /* Populate the response regions of the async xfer request */
                                 R_ABORT_UNLESS(usbHsIfGetCtrlXferReportFwd(&pIntf->mIfSession, pRequest->mpReport, sizeof(UsbHsXferReport)));
 
+                                if (capture::IsCapturing())
+                                {
+                                    const capture::CtrlXferPayload Payload = {
+                                        .bmRequestType = pRequest->bmRequestType,
+                                        .bRequest = pRequest->bRequest,
+                                        .wValue = pRequest->wValue,
+                                        .wIndex = pRequest->wIndex,
+                                        .wLength = pRequest->wLength,
+                                        .mTransferredSize = pRequest->mpReport->transferredSize
+                                    };
+                                    capture::Record(capture::RecordKind::CtrlXfer, static_cast<u8>(pUserData->mIntfId), WakeTick, pRequest->mpReport->res, &Payload, sizeof(Payload));
+                                }
+
                                 if ((pRequest->bmRequestType & USB_ENDPOINT_IN) != 0)
                                 {
-                                    WriteWithTransfer(pIntf->mClientProcess, g_AsyncXferScratch + (ams::os::MemoryPageSize * pUserData->mIntfId), pRequest->mClientBuffer, PAGE_ALIGN(pRequest->wValue));
+                                    WriteWithTransfer(pIntf->mClientProcess, AsyncXferScratchForInterface(pUserData->mIntfId), pRequest->mClientBuffer, PAGE_ALIGN(pRequest->wValue));
                                 }
 
                                 R_ABORT_UNLESS(eventFire(&pIntf->mExposedCompletionEvents[pUserData->mEventId]));
-                                NeedsBreak = true;
+
+                                /* Stop waiting on control transfers until the next one is submitted, which will signal the update event */
+                                /* NOTE: pUserData belongs to the holder being removed, so it must not be touched after this */
+                                if (pIntf->mNumPending == 0)
+                                {
+                                    RemoveInterfaceWaitHolder(&g_WaitHolders, pUserData->mIntfId, ProxyInterfaceImpl::CompletionEventId::Interface);
+                                }
                                 break;
                             case ProxyInterfaceImpl::CompletionEventId::ReadEndpoint:
-                                /* Do nothing except request another read, but only if the xfer was successful (an error here will cause a deadlock) */
-                                R_ABORT_UNLESS(usbHsEpGetXferReportFwd(&pIntf->mReadEpSession, &pIntf->mLatestReadReport, 1, &dummy));
-                                if (AMS_UNLIKELY(dummy != 1))
+                            {
+                                /* Drain every finished read in completion order, re-queueing each buffer as soon as it's been published */
+                                /* Reads are only re-queued if the xfer was successful (an error here will cause a deadlock) */
+                                UsbHsXferReport Reports[g_ReadUrbDepth];
+                                const u32 NumReports = backend::GetXferReports(&pIntf->mEndpoints, backend::EndpointId::Read, Reports, g_ReadUrbDepth);
+                                if (AMS_UNLIKELY(NumReports == 0))
                                 {
-                                    DEBUG("[DriverThread::Driver] Unable to get xfer report for latest read for adapter interface %u, not-continuing read operations\n", pUserData->mIntfId);
+                                    DEBUG("[DriverThread::Driver] Unable to get xfer report for latest read for adapter interface %u\n", pUserData->mIntfId);
                                     break;
                                 }
 
-                                if (AMS_UNLIKELY(R_FAILED(pIntf->mLatestReadReport.res)))
+                                /* If every queued read has completed, the USB stack had nothing to complete into until we re-queue */
+                                if (NumReports >= pIntf->mReadsInFlight)
                                 {
-                                    DEBUG(
-                                        "[DriverThread::Driver] Latest read failed for adapter interface %u: { .res = %x, .requestedSize = %x, .transferredSize = %x }\n",
-                                        pUserData->mIntfId, pIntf->mLatestReadReport.res, pIntf->mLatestReadReport.requestedSize, pIntf->mLatestReadReport.transferredSize
-                                    );
+                                    pIntf->mReadStarvedPolls.fetch_add(1, std::memory_order_relaxed);
                                 }
-                                else
+
+                                u32 NumArrived = 0;
+                                for (u32 i = 0; i < NumReports; i++)
                                 {
-                                    R_ABORT_UNLESS(usbHsEpPostBufferAsyncFwd(&pIntf->mReadEpSession, MemoryForInterface(pUserData->mIntfId, true), 37, 0, &dummy));
+                                    const size_t Urb = Reports[i].id;
+                                    AMS_ABORT_UNLESS(Urb < g_ReadUrbDepth, "Read completed with an unknown transfer id");
+
+                                    pIntf->mReadsInFlight--;
+                                    pIntf->mLatestReadReport = Reports[i];
+
+                                    /* Publish before re-queueing, since the next read will DMA into the same buffer */
+                                    const bool IsPacket = R_SUCCEEDED(Reports[i].res) && Reports[i].transferredSize >= AdapterPacketSize;
+                                    if (AMS_LIKELY(IsPacket))
+                                    {
+                                        PublishReadPacket(pIntf, pUserData->mIntfId, ReadMemoryForInterface(pUserData->mIntfId, Urb), WakeTick);
+                                    }
+                                    else
+                                    {
+                                        PublishReadError(pIntf, pUserData->mIntfId, WakeTick);
+                                    }
+
+                                    if (AMS_UNLIKELY(R_FAILED(Reports[i].res)))
+                                    {
+                                        pIntf->mReadsFailed.fetch_add(1, std::memory_order_relaxed);
+                                        DEBUG(
+                                            "[DriverThread::Driver] Latest read failed for adapter interface %u: { .res = %x, .requestedSize = %x, .transferredSize = %x }\n",
+                                            pUserData->mIntfId, Reports[i].res, Reports[i].requestedSize, Reports[i].transferredSize
+                                        );
+                                    }
+                                    else
+                                    {
+                                        pIntf->mReadsCompleted.fetch_add(1, std::memory_order_relaxed);
+                                        PostRead(pIntf, pUserData->mIntfId, Urb);
+                                        if (IsPacket)
+                                            NumArrived++;
+                                    }
                                 }
 
+                                RecordReadArrivals(pIntf, WakeTick, NumArrived);
+                                trace::RecordEvent(trace::EventId::ReadsDrained, static_cast<u8>(pUserData->mIntfId), NumReports, NumArrived);
+
                                 break;
+                            }
                             case ProxyInterfaceImpl::CompletionEventId::WriteEndpoint:
-                                /* TODO: Make this write request on-demand? Will take up less resources... */
-                                /* Do nothing except request another write, but only if the xfer was successful (an error here will cause a deadlock) */
-                                R_ABORT_UNLESS(usbHsEpGetXferReportFwd(&pIntf->mWriteEpSession, &pIntf->mLatestWriteReport, 1, &dummy));
-                                if (AMS_UNLIKELY(dummy != 1))
+                            {
+                                /* Writes are only posted when HID asks for a different packet, so there is at most one of these in flight */
+                                if (AMS_UNLIKELY(backend::GetXferReports(&pIntf->mEndpoints, backend::EndpointId::Write, &pIntf->mLatestWriteReport, 1) != 1))
                                 {
-                                    DEBUG("[DriverThread::Driver] Unable to get xfer report for latest write for adapter interface %u, not-continuing write operations\n", pUserData->mIntfId);
+                                    DEBUG("[DriverThread::Driver] Unable to get xfer report for latest write for adapter interface %u\n", pUserData->mIntfId);
                                     break;
                                 }
 
+                                pIntf->mWriteInFlight = false;
+                                trace::RecordEvent(trace::EventId::WriteCompleted, static_cast<u8>(pUserData->mIntfId), pIntf->mLatestWriteReport.res);
                                 if (AMS_UNLIKELY(R_FAILED(pIntf->mLatestWriteReport.res)))
                                 {
                                     DEBUG(
                                         "[DriverThread::Driver] Latest write failed for adapter interface %u: { .res = %x, .requestedSize = %x, .transferredSize = %x }\n",
                                         pUserData->mIntfId, pIntf->mLatestWriteReport.res, pIntf->mLatestWriteReport.requestedSize, pIntf->mLatestWriteReport.transferredSize
                                     );
+                                    /* We don't know what the adapter ended up with, so make sure the next request goes out even if it's the same */
+                                    pIntf->mWriteOnWire.mSize = 0;
                                 }
-                                else
+                                else if (pIntf->mWriteSubmitted.mSize != 0)
                                 {
-                                    *MemoryForInterface(pUserData->mIntfId, false) = 0x11;
-                                    R_ABORT_UNLESS(usbHsEpPostBufferAsyncFwd(&pIntf->mWriteEpSession, MemoryForInterface(pUserData->mIntfId, false), 5, 0, &dummy));
+                                    pIntf->mWriteOnWire = pIntf->mWriteSubmitted;
+
+                                    const u64 Latency = WakeTick - pIntf->mWriteSubmitted.mTick;
+                                    pIntf->mWriteLatencyLastTicks.store(Latency, std::memory_order_relaxed);
+                                    if (Latency > pIntf->mWriteLatencyMaxTicks.load(std::memory_order_relaxed))
+                                    {
+                                        pIntf->mWriteLatencyMaxTicks.store(Latency, std::memory_order_relaxed);
+                                    }
                                 }
+
+                                /* Anything HID asked for while this write was on the wire goes out now */
+                                SubmitPendingWrite(pIntf, pUserData->mIntfId);
                                 break;
+                            }
                             AMS_UNREACHABLE_DEFAULT_CASE();
                         }
                     }
                 }
             }
         }
+
+        /* Whether the whole range is mapped read-write in the client, so that the transfer window can be mapped over it */
+        static bool IsClientBufferMapped(Handle ForeignProcess, u64 Address, size_t Size)
+        {
+            const u64 End = Address + Size;
+            if (End < Address)
+                return false;
+
+            u64 Current = Address;
+            while (Current < End)
+            {
+                ams::svc::MemoryInfo MemInfo;
+                ams::svc::PageInfo PageInfo;
+                if (R_FAILED(ams::svc::QueryProcessMemory(&MemInfo, &PageInfo, ForeignProcess, Current)))
+                    return false;
+
+                if (MemInfo.state == ams::svc::MemoryState_Free || (MemInfo.permission & ams::svc::MemoryPermission_ReadWrite) != ams::svc::MemoryPermission_ReadWrite)
+                    return false;
+
+                Current = MemInfo.base_address + MemInfo.size;
+            }
+            return true;
+        }
+
+        /* BatchBufferAsync's URB size is a guess (it takes it from the unnamed unk1 argument), so a batch only goes through if */
+        /* that reading of it fits within what the endpoint was opened for and lands entirely in the client's memory */
+        static bool IsValidBatch(Handle ForeignProcess, const EndpointLimits& Limits, u64 buffer, u32 urbCount, u32 urbSize)
+        {
+            if (urbCount == 0 || urbCount > g_MaxBatchUrbs || urbCount > Limits.mMaxUrbCount)
+                return false;
+
+            if (urbSize == 0 || urbSize > Limits.mMaxXferSize)
+                return false;
+
+            const size_t TotalSize = static_cast<size_t>(urbCount) * urbSize;
+            return TotalSize <= g_MaxBatchTransferSize && IsClientBufferMapped(ForeignProcess, buffer, TotalSize);
+        }
     }
 
-    /* Locates the closest memory after our executable section that we can map at least a page to for transfer memory */
-    /* We should only need a page for HID client stuff */
+    /* Locates the closest memory after our executable section that we can map our transfer window to */
     void LocateTransferMemory()
     {
         ams::svc::MemoryInfo MemInfo;
@@ -444,7 +1036,7 @@ namespace usb::gc
 
         while (true)
         {
-            if (MemInfo.state == ams::svc::MemoryState_Free && MemInfo.size >= ams::os::MemoryPageSize)
+            if (MemInfo.state == ams::svc::MemoryState_Free && MemInfo.size >= g_TransferWindowSize)
             {
                 break;
             }
@@ -471,21 +1063,19 @@ namespace usb::gc
             return;
         }
 
-        ams::os::LockMutex(&g_TransferMutex);
+        trace::ScopedSpan Trace(trace::EventId::TransferRead, trace::NoAdapter);
+        Trace.mArgs[0] = static_cast<u32>(size);
 
-        R_ABORT_UNLESS(ams::svc::MapProcessMemory(g_TransferMemory, ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
-        armDCacheClean(reinterpret_cast<void*>(g_TransferMemory), ams::os::MemoryPageSize);
+        const uintptr_t ForeignPage = ForeignMemory & ~(ams::os::MemoryPageSize - 1);
+        const size_t MappedSize = PAGE_ALIGN(ForeignMemory - ForeignPage + size);
+        AMS_ABORT_UNLESS(MappedSize <= g_TransferWindowSize, "Transfer is too large for the transfer window");
 
-        for (size_t i = 0; i < size; i++)
-        {
-            reinterpret_cast<uint8_t*>(LocalMemory)[i] = reinterpret_cast<uint8_t*>(g_TransferMemory)[i];
-        }
+        ams::os::LockMutex(&g_TransferMutex);
 
-        armDCacheFlush(reinterpret_cast<void*>(g_TransferMemory), ams::os::MemoryPageSize);
-        R_ABORT_UNLESS(ams::svc::UnmapProcessMemory(g_TransferMemory, ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
-        /* TODO: Are both of these really necessary? */
-        R_ABORT_UNLESS(ams::svc::InvalidateProcessDataCache(ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
-        R_ABORT_UNLESS(ams::svc::FlushProcessDataCache(ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
+        /* No cache maintenance: the window aliases HID's pages with the same cacheable attributes, so it is coherent */
+        R_ABORT_UNLESS(ams::svc::MapProcessMemory(g_TransferMemory, ForeignProcess, ForeignPage, MappedSize));
+        std::memcpy(LocalMemory, reinterpret_cast<void*>(g_TransferMemory + (ForeignMemory - ForeignPage)), size);
+        R_ABORT_UNLESS(ams::svc::UnmapProcessMemory(g_TransferMemory, ForeignProcess, ForeignPage, MappedSize));
 
         ams::os::UnlockMutex(&g_TransferMutex);
     }
@@ -503,36 +1093,57 @@ namespace usb::gc
             DEBUG("[DriverThread::Api::WriteWithTransfer] Early exiting because a size of 0x0 was requested for transfer\n");
             return;
         }
-        /* I don't want to through any debug logs in this function unless it crashes, since this is run so frequently it would cause */
-        /* runtime performance issues if debug logging is enabled, so bad that it would likely impact test results */
+        /* I don't want to through any debug logs in this function unless it crashes. Logging only appends to the log ring now, */
+        /* but this runs for every packet and would still flood the ring (and the SD card) if debug logging is enabled */
 
-        ams::os::LockMutex(&g_TransferMutex);
+        trace::ScopedSpan Trace(trace::EventId::TransferWrite, trace::NoAdapter);
+        Trace.mArgs[0] = static_cast<u32>(size);
 
-        R_ABORT_UNLESS(ams::svc::MapProcessMemory(g_TransferMemory, ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
-        armDCacheClean(reinterpret_cast<void*>(g_TransferMemory), ams::os::MemoryPageSize);
+        const uintptr_t ForeignPage = ForeignMemory & ~(ams::os::MemoryPageSize - 1);
+        const size_t MappedSize = PAGE_ALIGN(ForeignMemory - ForeignPage + size);
+        AMS_ABORT_UNLESS(MappedSize <= g_TransferWindowSize, "Transfer is too large for the transfer window");
 
-        for (size_t i = 0; i < size; i++)
-        {
-            reinterpret_cast<uint8_t*>(g_TransferMemory)[i] = reinterpret_cast<uint8_t*>(LocalMemory)[i];
-        }
+        ams::os::LockMutex(&g_TransferMutex);
 
-        armDCacheFlush(reinterpret_cast<void*>(g_TransferMemory), ams::os::MemoryPageSize);
-        R_ABORT_UNLESS(ams::svc::UnmapProcessMemory(g_TransferMemory, ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
-        /* TODO: Are both of these really necessary? */
-        R_ABORT_UNLESS(ams::svc::InvalidateProcessDataCache(ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
-        R_ABORT_UNLESS(ams::svc::FlushProcessDataCache(ForeignProcess, ForeignMemory, PAGE_ALIGN(size)));
+        /* See ReadWithTransfer for why there is no cache maintenance here */
+        R_ABORT_UNLESS(ams::svc::MapProcessMemory(g_TransferMemory, ForeignProcess, ForeignPage, MappedSize));
+        std::memcpy(reinterpret_cast<void*>(g_TransferMemory + (ForeignMemory - ForeignPage)), LocalMemory, size);
+        R_ABORT_UNLESS(ams::svc::UnmapProcessMemory(g_TransferMemory, ForeignProcess, ForeignPage, MappedSize));
 
         ams::os::UnlockMutex(&g_TransferMutex);
     }
 
     void Initialize()
     {
+        /* The shared state is mapped first so that the transfer memory search below steers clear of it */
+        R_ABORT_UNLESS(ams::os::CreateSharedMemory(&g_SharedMemory, g_SharedStateSize, ams::os::MemoryPermission_ReadWrite, ams::os::MemoryPermission_ReadOnly));
+        g_pSharedState = reinterpret_cast<SharedStateRegion*>(ams::os::MapSharedMemory(&g_SharedMemory, ams::os::MemoryPermission_ReadWrite));
+        AMS_ABORT_UNLESS(g_pSharedState != nullptr, "Unable to map the shared adapter state");
+        std::memset(static_cast<void*>(g_pSharedState), 0, g_SharedStateSize);
+        g_pSharedState->mHeader = (shared::SharedStateHeader){
+            .mMagic = shared::SharedStateMagic,
+            .mVersion = shared::SharedStateVersion,
+            .mSlotCount = g_MaxSupportedAdapters,
+            .mSlotSize = sizeof(shared::SharedAdapterSlot),
+            .mTickFrequency = static_cast<u64>(ams::os::GetSystemTickFrequency()),
+        };
+
         DEBUG("[DriverThread::Api::Initialize] Looking for transfer memory page\n");
         LocateTransferMemory();
         DEBUG("[DriverThread::Api::Initialize] Transfer memory page found at %llx\n", g_TransferMemory);
         ams::os::InitializeMutex(&g_InterfaceMutex, false, 1);
+        ams::os::InitializeConditionVariable(&g_SlotReleased);
+        /* Pushed in reverse so that the lowest slot gets handed out first */
+        for (size_t i = 0; i < g_MaxSupportedAdapters; i++)
+        {
+            g_FreeSlots[i] = g_MaxSupportedAdapters - 1 - i;
+        }
+        g_NumFreeSlots = g_MaxSupportedAdapters;
         ams::os::InitializeEvent(&g_InterfaceUpdateRequested, false, ams::os::EventClearMode_ManualClear);
+        ams::os::InitializeEvent(&g_WriteRequested, false, ams::os::EventClearMode_ManualClear);
         ams::os::InitializeMutex(&g_TransferMutex, false, 1);
+        ams::os::InitializeMutex(&g_SubscriptionMutex, false, 1);
+        backend::Initialize();
 
         R_ABORT_UNLESS(ams::os::CreateThread(
             &g_Thread,
@@ -551,40 +1162,44 @@ namespace usb::gc
     {
         ams::os::WaitThread(&g_Thread);
         ams::os::FinalizeEvent(&g_InterfaceUpdateRequested);
+        ams::os::FinalizeEvent(&g_WriteRequested);
+        ams::os::FinalizeConditionVariable(&g_SlotReleased);
         ams::os::FinalizeMutex(&g_InterfaceMutex);
     }
 
-    /* Open our endpoints and set up for proxying data, requires that there be < 4 adapters already connected */
-    ProxyInterface OpenInterface(Handle ClientProcess, Service IfSession, const UsbHsInterface* pInterface)
+    /* Open our endpoints and set up for proxying data */
+    bool OpenInterface(Handle ClientProcess, Service IfSession, const UsbHsInterface* pInterface, ProxyInterface* pOut)
     {
         ams::os::LockMutex(&g_InterfaceMutex);
-        bool AwaitingShutdown = false;
-        size_t i;
-        for (i = 0; i < g_MaxSupportedAdapters; i++)
-        {
-            if (!g_Interfaces[i].mIsAcquired) break;
-            else if (g_Interfaces[i].mIsRequestShutdown) AwaitingShutdown = true;
-        }
 
-        if (i == g_MaxSupportedAdapters)
+        /* If every slot is taken, wait for the driver thread to release one. An adapter that was just unplugged only gets */
+        /* released once the driver thread has processed its shutdown, so replugging often lands here for a moment */
+        if (g_NumFreeSlots == 0)
         {
-            ams::os::UnlockMutex(&g_InterfaceMutex);
-            if (AwaitingShutdown)
+            DEBUG("[DriverThread::Api::OpenInterface] No available adapter slots, waiting for one to be released\n");
+            const s64 Deadline = ams::os::GetSystemTick().GetInt64Value() + ams::os::ConvertToTick(g_SlotWaitTimeout).GetInt64Value();
+            while (g_NumFreeSlots == 0)
             {
-                DEBUG("[DriverThread::Api::OpenInterface] No available adatper spots found, but at least one is shutting down. Waiting for that to finish\n");
+                const s64 Remaining = Deadline - ams::os::GetSystemTick().GetInt64Value();
+                if (Remaining <= 0)
+                    break;
+
+                ams::os::TimedWaitConditionVariable(&g_SlotReleased, &g_InterfaceMutex, ams::os::ConvertToTimeSpan(ams::os::Tick(Remaining)));
             }
-            else
+
+            if (g_NumFreeSlots == 0)
             {
-                DEBUG("[DriverThread::Api::OpenInterface] No available adapter spots found, and none of them are shutting donw. Aborting\n");
-                AMS_ABORT("Too many adapters plugged in");
+                ams::os::UnlockMutex(&g_InterfaceMutex);
+                DEBUG("[DriverThread::Api::OpenInterface] No adapter slot was released in time, refusing the adapter\n");
+                return false;
             }
-            ams::os::SleepThread(ams::TimeSpan::FromMicroSeconds(100));
-            return OpenInterface(ClientProcess, IfSession, pInterface);
         }
 
+        const u32 i = g_FreeSlots[--g_NumFreeSlots];
+
         DEBUG("[DriverThread::Api::OpenInterface] Found available adapter slot %u, initializing adapter\n", i);
 
-        g_Interfaces[i].Initialize(ClientProcess, IfSession, pInterface);
+        g_Interfaces[i].Initialize(i, ClientProcess, IfSession, pInterface);
 
         DEBUG("[DriverThread::Api::OpenInterface] Adapter %u initialized\n", i);
 
@@ -592,13 +1207,14 @@ namespace usb::gc
         ams::os::SignalEvent(&g_InterfaceUpdateRequested);
 
         /* We unlock before returning because all of this data is read-only after initialization */
-        return (ProxyInterface) {
-            .mId = (u32)i,
+        *pOut = (ProxyInterface) {
+            .mId = i,
             .mIfStateChangeEvent = g_Interfaces[i].mStateChangeEvent,
             .mCtrlXferCompletionEvent = g_Interfaces[i].mExposedCompletionEvents[ProxyInterfaceImpl::CompletionEventId::Interface].revent,
             .mReadPostBufferCompletionEvent = g_Interfaces[i].mExposedCompletionEvents[ProxyInterfaceImpl::CompletionEventId::ReadEndpoint].revent,
             .mWritePostBufferCompletionEvent = g_Interfaces[i].mExposedCompletionEvents[ProxyInterfaceImpl::CompletionEventId::WriteEndpoint].revent,
         };
+        return true;
     }
 
     void CloseInterface(InterfaceId id)
@@ -614,6 +1230,7 @@ namespace usb::gc
         AMS_ABORT_UNLESS(id < g_MaxSupportedAdapters, "Invalid interface id");
 
         ProxyInterfaceImpl* pIntf = &g_Interfaces[id];
+        trace::RecordEvent(trace::EventId::IpcCtrlXfer, static_cast<u8>(id), xfer.bmRequestType, xfer.bRequest, xfer.wValue);
 
         if (pIntf->mNumPending == g_MaxAsyncXfers)
         {
@@ -624,7 +1241,7 @@ namespace usb::gc
         if ((xfer.bmRequestType & USB_ENDPOINT_IN) == 0)
         {
             DEBUG("[DriverThread::Api::IntfAsyncTransfer] Async interface transfer requested with write, transferring memory to scratch region %u\n", id);
-            ReadWithTransfer(pIntf->mClientProcess, xfer.mClientBuffer, g_AsyncXferScratch + (ams::os::MemoryPageSize * id), PAGE_ALIGN(xfer.wValue));
+            ReadWithTransfer(pIntf->mClientProcess, xfer.mClientBuffer, AsyncXferScratchForInterface(id), PAGE_ALIGN(xfer.wValue));
         }
         else
         {
@@ -633,7 +1250,7 @@ namespace usb::gc
 
         R_ABORT_UNLESS(usbHsIfCtrlXferAsyncFwd(
             &pIntf->mIfSession, xfer.bmRequestType, xfer.bRequest, xfer.wValue, xfer.wIndex, xfer.wLength,
-            reinterpret_cast<u64>(g_AsyncXferScratch + (ams::os::MemoryPageSize * id))
+            reinterpret_cast<u64>(AsyncXferScratchForInterface(id))
         ));
 
         pIntf->mPendingXfers[pIntf->mNumPending++] = xfer;
@@ -642,13 +1259,27 @@ namespace usb::gc
         ams::os::SignalEvent(&g_InterfaceUpdateRequested);
     }
 
-    void WritePacket(InterfaceId id, u64 buffer, size_t size, UsbHsXferReport* pReport)
+    bool WritePacket(InterfaceId id, u64 buffer, size_t size, UsbHsXferReport* pReport)
     {
+        trace::RecordEvent(trace::EventId::IpcWritePacket, static_cast<u8>(id), static_cast<u32>(size));
+
+        /* Anything larger than the adapter takes would have to be cut short, so it doesn't go out at all */
+        if (size > g_MaxWritePacketSize)
+            return false;
+
         /* If it's the initialization packet, just stub this and fire the event */
         if (size != 1)
         {
-            u8* pWriteMemory = MemoryForInterface(id, false);
-            ReadWithTransfer(g_Interfaces[id].mClientProcess, buffer, pWriteMemory, size);
+            /* Hand the packet to the driver thread, which decides whether it actually needs to go out */
+            WriteBatch Batch;
+            WriteRequest* pRequest = &Batch.mRequests[0];
+            pRequest->mSize = static_cast<u32>(size);
+            ReadWithTransfer(g_Interfaces[id].mClientProcess, buffer, pRequest->mData, pRequest->mSize);
+            pRequest->mTick = ams::os::GetSystemTick().GetInt64Value();
+            Batch.mCount = 1;
+            g_Interfaces[id].mWriteMailbox.Publish(Batch);
+            ams::os::SignalEvent(&g_WriteRequested);
+
             const UsbHsXferReport* pLatest = &g_Interfaces[id].mLatestWriteReport;
             if (AMS_UNLIKELY(pLatest->xferId == UINT32_MAX))
             {
@@ -662,7 +1293,10 @@ namespace usb::gc
             }
             else
             {
+                /* The result of the last write that went out, but for the size of this packet, which is taken in full */
                 *pReport = *pLatest;
+                pReport->requestedSize = static_cast<u32>(size);
+                pReport->transferredSize = static_cast<u32>(size);
             }
         }
         else
@@ -676,14 +1310,77 @@ namespace usb::gc
             };
         }
         R_ABORT_UNLESS(eventFire(&g_Interfaces[id].mExposedCompletionEvents[ProxyInterfaceImpl::CompletionEventId::WriteEndpoint]));
+        return true;
+    }
+
+    bool WritePacketBatch(InterfaceId id, const EndpointLimits& Limits, u64 buffer, u32 urbCount, u32 urbSize, UsbHsXferReport* pReports)
+    {
+        AMS_ABORT_UNLESS(id < g_MaxSupportedAdapters, "Invalid interface id");
+        trace::RecordEvent(trace::EventId::IpcBatchWrite, static_cast<u8>(id), urbCount, urbSize);
+
+        ProxyInterfaceImpl* pIntf = &g_Interfaces[id];
+        if (urbSize > g_MaxWritePacketSize || !IsValidBatch(pIntf->mClientProcess, Limits, buffer, urbCount, urbSize))
+            return false;
+
+        /* Like with WritePacket, the initialization packet is sent by the driver thread itself */
+        if (urbSize != 1)
+        {
+            u8 Staging[g_MaxBatchTransferSize];
+            ReadWithTransfer(pIntf->mClientProcess, buffer, Staging, static_cast<size_t>(urbCount) * urbSize);
+
+            /* Every URB becomes a packet of the same request, so none of them get coalesced away */
+            WriteBatch Batch;
+            const u64 Tick = ams::os::GetSystemTick().GetInt64Value();
+            for (u32 i = 0; i < urbCount; i++)
+            {
+                std::memcpy(Batch.mRequests[i].mData, Staging + i * urbSize, urbSize);
+                Batch.mRequests[i].mSize = urbSize;
+                Batch.mRequests[i].mTick = Tick;
+            }
+            Batch.mCount = urbCount;
+            pIntf->mWriteMailbox.Publish(Batch);
+            ams::os::SignalEvent(&g_WriteRequested);
+        }
+
+        const UsbHsXferReport* pLatest = &pIntf->mLatestWriteReport;
+        for (u32 i = 0; i < urbCount; i++)
+        {
+            pReports[i] = (UsbHsXferReport){
+                .xferId = 0,
+                .res = (urbSize == 1 || pLatest->xferId == UINT32_MAX) ? 0 : pLatest->res,
+                .requestedSize = urbSize,
+                .transferredSize = urbSize,
+                .id = 0
+            };
+        }
+
+        R_ABORT_UNLESS(eventFire(&pIntf->mExposedCompletionEvents[ProxyInterfaceImpl::CompletionEventId::WriteEndpoint]));
+        return true;
     }
 
     void ReadPacket(InterfaceId id, u64 buffer, size_t size, UsbHsXferReport* pReport)
     {
         AMS_ABORT_UNLESS(id < g_MaxSupportedAdapters, "Invalid interface id");
-        WriteWithTransfer(g_Interfaces[id].mClientProcess, MemoryForInterface(id, true), buffer, size);
-        const UsbHsXferReport* pLatest = &g_Interfaces[id].mLatestReadReport;
-        if (AMS_UNLIKELY(pLatest->xferId == UINT32_MAX))
+        trace::RecordEvent(trace::EventId::IpcReadPacket, static_cast<u8>(id), static_cast<u32>(size));
+
+        AdapterPacket Packet = {};
+        const bool HasPacket = g_Interfaces[id].mLatestPacket.Read(&Packet) != 0;
+
+        if (AMS_LIKELY(HasPacket))
+        {
+            const u64 FetchTick = ams::os::GetSystemTick().GetInt64Value();
+            g_Interfaces[id].mPublishToFetch.Record(TicksToNs(FetchTick - Packet.mPublishTick));
+            g_Interfaces[id].mSampleAge.Record(TicksToNs(FetchTick - Packet.mWakeTick));
+        }
+
+        /* Make sure any press that started and ended between two HID polls is still seen by HID */
+        if (g_DeliveryModes[id].load(std::memory_order_relaxed) == DeliveryMode::LatchPresses)
+        {
+            packet::ApplyLatchedButtons(Packet.mData, g_Interfaces[id].mLatchedButtons.Take());
+        }
+
+        WriteWithTransfer(g_Interfaces[id].mClientProcess, Packet.mData, buffer, std::min(size, AdapterPacketSize));
+        if (AMS_UNLIKELY(!HasPacket))
         {
             *pReport = (UsbHsXferReport){
                 .xferId = 0,
@@ -695,11 +1392,71 @@ namespace usb::gc
         }
         else
         {
-            *pReport = *pLatest;
+            *pReport = Packet.mReport;
         }
         R_ABORT_UNLESS(eventFire(&g_Interfaces[id].mExposedCompletionEvents[ProxyInterfaceImpl::CompletionEventId::ReadEndpoint]));
     }
 
+    bool ReadPacketBatch(InterfaceId id, const EndpointLimits& Limits, u64 buffer, u32 urbCount, u32 urbSize, u64* pCursor, UsbHsXferReport* pReports)
+    {
+        AMS_ABORT_UNLESS(id < g_MaxSupportedAdapters, "Invalid interface id");
+        trace::RecordEvent(trace::EventId::IpcBatchRead, static_cast<u8>(id), urbCount, urbSize);
+
+        ProxyInterfaceImpl* pIntf = &g_Interfaces[id];
+
+        /* A read shorter than a packet would mean urbSize isn't what we take it for */
+        if (urbSize < AdapterPacketSize || !IsValidBatch(pIntf->mClientProcess, Limits, buffer, urbCount, urbSize))
+            return false;
+
+        const size_t TotalSize = static_cast<size_t>(urbCount) * urbSize;
+
+        /* Hand out every sample the client hasn't seen yet, oldest first. If there are fewer new samples than URBs, the */
+        /* remaining URBs are filled with the latest packet so that every URB in the batch still completes */
+        AdapterPacketHistoryEntry Entries[g_MaxBatchUrbs];
+        u64 Cursor = *pCursor;
+
+        /* Skip straight to the newest samples if the client has fallen further behind than the batch can hold. A cursor left */
+        /* over from an adapter that used to be in this slot counts as being that far behind */
+        Cursor = pIntf->mHistory.LimitBacklog(Cursor, urbCount);
+
+        size_t NumEntries = pIntf->mHistory.ReadSince(Cursor, Entries, urbCount, pCursor);
+
+        AdapterPacket Latest = {};
+        const bool HasPacket = pIntf->mLatestPacket.Read(&Latest) != 0;
+
+        const u32 CopySize = std::min<u32>(urbSize, AdapterPacketSize);
+        u8 Staging[g_MaxBatchTransferSize] = {};
+        for (u32 i = 0; i < urbCount; i++)
+        {
+            const u8* pData;
+            UsbHsXferReport Report;
+            if (i < NumEntries)
+            {
+                pData = Entries[i].mData;
+                Report = Entries[i].mReport;
+            }
+            else if (HasPacket)
+            {
+                pData = Latest.mData;
+                Report = Latest.mReport;
+            }
+            else
+            {
+                pData = Latest.mData;
+                Report = (UsbHsXferReport){ .xferId = 0, .res = 0, .requestedSize = CopySize, .transferredSize = CopySize, .id = 0 };
+            }
+
+            std::memcpy(Staging + i * urbSize, pData, CopySize);
+            pReports[i] = Report;
+            pReports[i].requestedSize = urbSize;
+            pReports[i].transferredSize = std::min(Report.transferredSize, CopySize);
+        }
+
+        WriteWithTransfer(pIntf->mClientProcess, Staging, buffer, TotalSize);
+        R_ABORT_UNLESS(eventFire(&pIntf->mExposedCompletionEvents[ProxyInterfaceImpl::CompletionEventId::ReadEndpoint]));
+        return true;
+    }
+
     uint32_t GetAdapterPacketStateForUsbGc(
         uint8_t* pBytes,
         size_t Size
@@ -708,23 +1465,226 @@ namespace usb::gc
         uint32_t NumAdapters = 0;
         for (u32 i = 0; i < g_MaxSupportedAdapters; i++)
         {
-            if (Size < 38)
+            if (Size < AdapterPacketSize + 1)
                 break;
 
             if (g_Interfaces[i].mIsAcquired)
             {
                 NumAdapters++;
-                u8* pAdapterMem = MemoryForInterface(i, true); 
+                AdapterPacket Packet = {};
+                g_Interfaces[i].mLatestPacket.Read(&Packet);
                 pBytes[0] = (u8)i;
-                for (size_t j = 0; j < 37; j++)
-                {
-                    pBytes[j + 1] = pAdapterMem[j];
-                }
-                Size -= 38;
-                pBytes += 38;
+                std::memcpy(pBytes + 1, Packet.mData, AdapterPacketSize);
+                Size -= AdapterPacketSize + 1;
+                pBytes += AdapterPacketSize + 1;
             }
         }
 
         return NumAdapters;
     }
-}
\ No newline at end of file
+
+    uint32_t GetAdapterControllerStatesForUsbGc(
+        packet::ControllerState* pStates,
+        size_t MaxStates
+    )
+    {
+        uint32_t NumStates = 0;
+        for (u32 i = 0; i < g_MaxSupportedAdapters && NumStates < MaxStates; i++)
+        {
+            if (g_Interfaces[i].mIsAcquired && g_Interfaces[i].mLatestState.Read(&pStates[NumStates]) != 0)
+            {
+                NumStates++;
+            }
+        }
+
+        return NumStates;
+    }
+
+    size_t GetAdapterPacketHistoryForUsbGc(
+        u32 id,
+        u64 Cursor,
+        AdapterPacketHistoryEntry* pEntries,
+        size_t MaxEntries,
+        u64* pNextCursor
+    )
+    {
+        if (id >= g_MaxSupportedAdapters || !g_Interfaces[id].mIsAcquired)
+        {
+            *pNextCursor = Cursor;
+            return 0;
+        }
+
+        return g_Interfaces[id].mHistory.ReadSince(Cursor, pEntries, MaxEntries, pNextCursor);
+    }
+
+    bool SetAdapterDeliveryMode(u32 id, DeliveryMode mode)
+    {
+        if (id >= g_MaxSupportedAdapters)
+            return false;
+
+        switch (mode)
+        {
+            case DeliveryMode::Latest:
+            case DeliveryMode::LatchPresses:
+                break;
+            default:
+                return false;
+        }
+
+        /* Drop whatever was latched under the previous mode so it doesn't leak into the next packet */
+        g_DeliveryModes[id].store(mode, std::memory_order_relaxed);
+        g_Interfaces[id].mLatchedButtons.Clear();
+        return true;
+    }
+
+    bool SetAdapterAnalogFilter(u32 id, u32 port, packet::AnalogFilterMode mode)
+    {
+        if (id >= g_MaxSupportedAdapters || port >= packet::PortCount || mode >= packet::AnalogFilterMode::Count)
+            return false;
+
+        /* Only the usb:gc thread changes these, but the driver thread reads them, so keep the update a single store */
+        const u32 Shift = 8 * port;
+        const u32 Previous = g_AnalogFilterModes[id].load(std::memory_order_relaxed);
+        g_AnalogFilterModes[id].store((Previous & ~(0xFFu << Shift)) | (static_cast<u32>(mode) << Shift), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool GetAdapterDriverStats(u32 id, AdapterDriverStats* pOut)
+    {
+        if (id >= g_MaxSupportedAdapters || !g_Interfaces[id].mIsAcquired)
+            return false;
+
+        const ProxyInterfaceImpl* pIntf = &g_Interfaces[id];
+        *pOut = (AdapterDriverStats){
+            .mReadsCompleted = pIntf->mReadsCompleted.load(std::memory_order_relaxed),
+            .mReadsFailed = pIntf->mReadsFailed.load(std::memory_order_relaxed),
+            .mReadStarvedPolls = pIntf->mReadStarvedPolls.load(std::memory_order_relaxed),
+            .mReadUrbDepth = g_ReadUrbDepth,
+            .mWritesSubmitted = pIntf->mWritesSubmitted.load(std::memory_order_relaxed),
+            .mWritesAvoided = pIntf->mWritesAvoided.load(std::memory_order_relaxed),
+            .mWriteLatencyLastNs = TicksToNs(pIntf->mWriteLatencyLastTicks.load(std::memory_order_relaxed)),
+            .mWriteLatencyMaxNs = TicksToNs(pIntf->mWriteLatencyMaxTicks.load(std::memory_order_relaxed)),
+        };
+        return true;
+    }
+
+    bool GetAdapterLatencyStats(u32 id, AdapterLatencyStats* pOut)
+    {
+        if (id >= g_MaxSupportedAdapters || !g_Interfaces[id].mIsAcquired)
+            return false;
+
+        const ProxyInterfaceImpl* pIntf = &g_Interfaces[id];
+        pIntf->mWakeToPublish.Summarize(&pOut->mWakeToPublish);
+        pIntf->mPublishToFetch.Summarize(&pOut->mPublishToFetch);
+        pIntf->mSampleAge.Summarize(&pOut->mSampleAge);
+        return true;
+    }
+
+    bool ResetAdapterLatencyStats(u32 id)
+    {
+        if (id >= g_MaxSupportedAdapters || !g_Interfaces[id].mIsAcquired)
+            return false;
+
+        g_Interfaces[id].mWakeToPublish.Reset();
+        g_Interfaces[id].mPublishToFetch.Reset();
+        g_Interfaces[id].mSampleAge.Reset();
+        return true;
+    }
+
+    bool GetAdapterPollingStats(u32 id, AdapterPollingStats* pOut)
+    {
+        if (id >= g_MaxSupportedAdapters || !g_Interfaces[id].mIsAcquired)
+            return false;
+
+        PollingAccumulator Polling = {};
+        g_Interfaces[id].mPollingSnapshot.Read(&Polling);
+
+        *pOut = (AdapterPollingStats){
+            .mIntervals = Polling.mIntervals,
+            .mLongestGapNs = TicksToNs(Polling.mLongestGapTicks),
+            .mGapsOver2Ms = Polling.mGapsOverThreshold,
+        };
+
+        if (Polling.mIntervals != 0)
+        {
+            const double Mean = static_cast<double>(Polling.mSumTicks) / Polling.mIntervals;
+            const double Variance = std::max(0.0, Polling.mSumSquaredTicks / Polling.mIntervals - Mean * Mean);
+            const double NsPerTick = 1'000'000'000.0 / ams::os::GetSystemTickFrequency();
+
+            pOut->mMeanIntervalNs = static_cast<u64>(Mean * NsPerTick);
+            pOut->mStdDevIntervalNs = static_cast<u64>(std::sqrt(Variance) * NsPerTick);
+            pOut->mMeanRateMilliHz = static_cast<u64>(1'000'000'000'000.0 / (Mean * NsPerTick));
+        }
+        return true;
+    }
+
+    bool ResetAdapterPollingStats(u32 id)
+    {
+        if (id >= g_MaxSupportedAdapters || !g_Interfaces[id].mIsAcquired)
+            return false;
+
+        g_Interfaces[id].mPollingResetRequested.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool SubscribeAdapterPackets(u32 id, u32 flags, Handle* pReadableEvent, u32* pSubscriptionId)
+    {
+        if (id >= g_MaxSupportedAdapters)
+            return false;
+
+        ams::os::LockMutex(&g_SubscriptionMutex);
+
+        u32 Index;
+        for (Index = 0; Index < g_MaxSubscriptions; Index++)
+        {
+            if (g_Subscriptions[Index].mState.load(std::memory_order_acquire) == SubscriptionState::Free)
+                break;
+        }
+
+        if (Index == g_MaxSubscriptions)
+        {
+            ams::os::UnlockMutex(&g_SubscriptionMutex);
+            return false;
+        }
+
+        PacketSubscription* pSubscription = &g_Subscriptions[Index];
+        pSubscription->mAdapter = id;
+        pSubscription->mOnlyOnChange = (flags & SubscriptionFlag_OnlyOnChange) != 0;
+        pSubscription->mHasLastData = false;
+        R_ABORT_UNLESS(eventCreate(&pSubscription->mEvent, false));
+        pSubscription->mState.store(SubscriptionState::Active, std::memory_order_release);
+
+        ams::os::UnlockMutex(&g_SubscriptionMutex);
+
+        *pReadableEvent = pSubscription->mEvent.revent;
+        *pSubscriptionId = Index;
+        return true;
+    }
+
+    void UnsubscribeAdapterPackets(u32 SubscriptionId)
+    {
+        AMS_ABORT_UNLESS(SubscriptionId < g_MaxSubscriptions, "Invalid subscription id");
+
+        SubscriptionState Expected = SubscriptionState::Active;
+        if (g_Subscriptions[SubscriptionId].mState.compare_exchange_strong(Expected, SubscriptionState::CloseRequested, std::memory_order_acq_rel))
+        {
+            ams::os::SignalEvent(&g_InterfaceUpdateRequested);
+        }
+    }
+
+    Handle GetSharedAdapterState(size_t* pSize)
+    {
+        *pSize = g_SharedStateSize;
+        return ams::os::GetSharedMemoryHandle(&g_SharedMemory);
+    }
+
+    void GetDriverStats(DriverStats* pOut)
+    {
+        *pOut = (DriverStats){
+            .mWaiterSyncCount = g_WaiterSyncCount.load(std::memory_order_relaxed),
+            .mWaiterSyncLastNs = TicksToNs(g_WaiterSyncLastTicks.load(std::memory_order_relaxed)),
+            .mWaiterSyncMaxNs = TicksToNs(g_WaiterSyncMaxTicks.load(std::memory_order_relaxed)),
+            .mWaiterSyncTotalNs = TicksToNs(g_WaiterSyncTotalTicks.load(std::memory_order_relaxed)),
+        };
+    }
+}
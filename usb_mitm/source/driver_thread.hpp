@@ -1,5 +1,9 @@
 #pragma once
 #include <stratosphere.hpp>
+#include "adapter_packet.hpp"
+#include "packet_processing.hpp"
+#include "controller_state.hpp"
+#include "latency_stats.hpp"
 
 namespace usb::gc
 {
@@ -32,6 +36,67 @@ namespace usb::gc
         size_t mSize;
     };
 
+    /* How the packet handed to HID on each ReadPacket is produced */
+    enum class DeliveryMode : u32
+    {
+        /* The most recent packet read from the adapter */
+        Latest = 0,
+        /* The most recent packet, with the digital buttons of every packet read since HID's last fetch ORed in */
+        LatchPresses = 1,
+    };
+
+    /* Counters kept by the driver thread for each adapter, exposed over usb:gc */
+    struct AdapterDriverStats
+    {
+        u64 mReadsCompleted;
+        u64 mReadsFailed;
+        /* Number of times every queued read had completed by the time we processed them, i.e. polls that could have been missed */
+        u64 mReadStarvedPolls;
+        u64 mReadUrbDepth;
+        /* Writes put on the wire, and write requests from HID that didn't need to be */
+        u64 mWritesSubmitted;
+        u64 mWritesAvoided;
+        /* Time from HID handing us a write to the adapter acknowledging it */
+        u64 mWriteLatencyLastNs;
+        u64 mWriteLatencyMaxNs;
+    };
+
+    /* Latency of the packets going through an adapter, exposed over usb:gc */
+    /* usb:hs doesn't timestamp transfers, so the earliest point we can observe a read completion is the driver thread waking up for it */
+    struct AdapterLatencyStats
+    {
+        /* Driver thread waking up for a read completion to the packet being published */
+        stats::LatencySummary mWakeToPublish;
+        /* Packet being published to HID fetching it */
+        stats::LatencySummary mPublishToFetch;
+        /* Age of the sample by the time HID fetched it, the sum of the two above */
+        stats::LatencySummary mSampleAge;
+    };
+
+    /* Rate at which reads actually complete on an adapter, exposed over usb:gc */
+    /* With the bInterval patch applied this should sit at 1000hz, a drop usually means a hub or a patch that didn't apply */
+    struct AdapterPollingStats
+    {
+        /* Number of intervals between read completions the rest of this is computed over */
+        u64 mIntervals;
+        u64 mMeanIntervalNs;
+        u64 mStdDevIntervalNs;
+        /* Mean polling rate in thousandths of a hertz, 1000000 at 1000hz */
+        u64 mMeanRateMilliHz;
+        u64 mLongestGapNs;
+        u64 mGapsOver2Ms;
+    };
+
+    /* Counters kept by the driver thread that aren't tied to a single adapter, exposed over usb:gc */
+    struct DriverStats
+    {
+        /* Number of times the driver thread updated its wait list after an interface change, and how long that took */
+        u64 mWaiterSyncCount;
+        u64 mWaiterSyncLastNs;
+        u64 mWaiterSyncMaxNs;
+        u64 mWaiterSyncTotalNs;
+    };
+
     /* Initialize and Finalization API */
     /* Initializes the thread for polling gamecube adapters */
     void Initialize();
@@ -41,7 +106,8 @@ namespace usb::gc
     /* Opens an interface to the GameCube adapter. */
     /* Opening this interface will open both of the endpoints at the same time and begin driving the gamecube adapter. */
     /* The endpoints will not be closed until CloseInterface is invoked */
-    ProxyInterface OpenInterface(Handle ClientProcess, Service IfSession, const UsbHsInterface* pInterface);
+    /* If every adapter slot is in use this waits a short while for one to be released, and returns false if none was */
+    bool OpenInterface(Handle ClientProcess, Service IfSession, const UsbHsInterface* pInterface, ProxyInterface* pOut);
 
     /* Closes the interface to the GameCube adapter. */
     void CloseInterface(InterfaceId id);
@@ -54,11 +120,36 @@ namespace usb::gc
     /* Note that this method is non-blocking, and that the "queue" of packets to the GC adapter */
     /* Is only one long. If this method is called again before the driver thread has had an opportunity */
     /* to write the previous packet, then the previous packet gets discarded. */
-    void WritePacket(InterfaceId id, u64 buffer, size_t size, UsbHsXferReport* pReport);
+    /* Packets identical to the one the adapter already has are never written. */
+    /* Returns false, without writing anything, if the packet is larger than the adapter takes */
+    bool WritePacket(InterfaceId id, u64 buffer, size_t size, UsbHsXferReport* pReport);
 
     /* Gets the last packet that was read from the GameCube controller, and writes it to the specified pointer */
     void ReadPacket(InterfaceId id, u64 buffer, size_t size, UsbHsXferReport* pReport);
 
+    /* Largest number of URBs accepted in a single batched read or write */
+    static constexpr u32 g_MaxBatchUrbs = 16;
+
+    /* What the client opened an endpoint with (OpenUsbEp), every batch on that endpoint has to stay within it */
+    struct EndpointLimits
+    {
+        u16 mMaxUrbCount;
+        u32 mMaxXferSize;
+    };
+
+    /* Fills a batch of urbCount reads, each urbSize bytes long and laid out back to back in the client buffer */
+    /* The reads are filled with the samples recorded after *pCursor (which gets advanced), padded out with the latest packet */
+    /* *pCursor starts out as 0, a cursor left over from an adapter that used to be in the slot gets the newest samples */
+    /* One report per URB is written to pReports. Returns false, without touching the client buffer, if the batch doesn't */
+    /* fit the endpoint's limits, is smaller than a packet per URB or isn't mapped in the client */
+    bool ReadPacketBatch(InterfaceId id, const EndpointLimits& Limits, u64 buffer, u32 urbCount, u32 urbSize, u64* pCursor, UsbHsXferReport* pReports);
+
+    /* Writes a batch of urbCount packets, each urbSize bytes long and laid out back to back in the client buffer */
+    /* Unlike separate WritePacket calls, the packets of a batch are never coalesced: each one goes out, in order */
+    /* One report per URB is written to pReports. Returns false if the batch doesn't fit the endpoint's limits, has packets */
+    /* larger than the adapter takes or isn't mapped in the client */
+    bool WritePacketBatch(InterfaceId id, const EndpointLimits& Limits, u64 buffer, u32 urbCount, u32 urbSize, UsbHsXferReport* pReports);
+
     void ReadWithTransfer(Handle ForeignProcess, uintptr_t ForeignMemory, void* LocalMemory, size_t Size);
     void WriteWithTransfer(Handle ForeignProcess, void* LocalMemory, uintptr_t ForeignMemory, size_t Size);
 
@@ -66,4 +157,64 @@ namespace usb::gc
         uint8_t* pBytes,
         size_t Size
     );
+
+    /* Copies out the decoded state of every adapter that has produced a packet yet, returns the number of states written */
+    uint32_t GetAdapterControllerStatesForUsbGc(
+        packet::ControllerState* pStates,
+        size_t MaxStates
+    );
+
+    /* Copies out the reads recorded on an adapter after the given cursor (0 for the oldest), see PacketHistoryRing::ReadSince */
+    /* Cursors are opaque and only valid for the adapter they were handed out for, anything else starts over */
+    size_t GetAdapterPacketHistoryForUsbGc(
+        u32 id,
+        u64 Cursor,
+        AdapterPacketHistoryEntry* pEntries,
+        size_t MaxEntries,
+        u64* pNextCursor
+    );
+
+    /* Changes how packets from the adapter in the specified slot are delivered to HID. Returns false if the slot or mode is invalid */
+    bool SetAdapterDeliveryMode(u32 id, DeliveryMode mode);
+
+    /* Selects the analog filter applied to one port of the adapter in the specified slot. Returns false if any argument is invalid */
+    bool SetAdapterAnalogFilter(u32 id, u32 port, packet::AnalogFilterMode mode);
+
+    /* Copies out the counters of the adapter in the specified slot. Returns false if there is no adapter there */
+    bool GetAdapterDriverStats(u32 id, AdapterDriverStats* pOut);
+
+    /* Summarizes the latency histograms of the adapter in the specified slot. Returns false if there is no adapter there */
+    bool GetAdapterLatencyStats(u32 id, AdapterLatencyStats* pOut);
+
+    /* Clears the latency histograms of the adapter in the specified slot. Returns false if there is no adapter there */
+    bool ResetAdapterLatencyStats(u32 id);
+
+    /* Summarizes the polling rate of the adapter in the specified slot. Returns false if there is no adapter there */
+    bool GetAdapterPollingStats(u32 id, AdapterPollingStats* pOut);
+
+    /* Starts the polling rate record of the adapter in the specified slot over. Returns false if there is no adapter there */
+    bool ResetAdapterPollingStats(u32 id);
+
+    /* Maximum number of packet subscriptions alive at once, across every usb:gc client */
+    static constexpr u32 g_MaxSubscriptions = 8;
+
+    enum SubscriptionFlag : u32
+    {
+        /* Only signal when the packet differs from the last one the subscriber was signaled for */
+        SubscriptionFlag_OnlyOnChange = (1 << 0),
+    };
+
+    /* Creates an event that gets signaled whenever a packet is published for the adapter in the specified slot */
+    /* The subscription follows the slot, so it keeps working across replugging. The event is never cleared by us */
+    /* Returns false if the slot is invalid or every subscription is in use */
+    bool SubscribeAdapterPackets(u32 id, u32 flags, Handle* pReadableEvent, u32* pSubscriptionId);
+
+    /* Stops signaling a subscription, the event gets closed by the driver thread shortly after */
+    void UnsubscribeAdapterPackets(u32 SubscriptionId);
+
+    /* Handle to the read-only shared memory holding the latest packet of every adapter slot, see shared_state.hpp for the layout */
+    Handle GetSharedAdapterState(size_t* pSize);
+
+    /* Copies out the counters of the driver thread itself */
+    void GetDriverStats(DriverStats* pOut);
 }
\ No newline at end of file
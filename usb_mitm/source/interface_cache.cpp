@@ -0,0 +1,203 @@
+#include "interface_cache.hpp"
+#include "logger.hpp"
+#include "usb_shim.h"
+#include <algorithm>
+
+namespace ams::mitm::usb::interface_cache
+{
+    namespace
+    {
+        static ::Service* g_pUsbService;
+
+        /* The cache's arrays come from the service heap */
+        static lmem::HeapHandle g_HeapHandle;
+
+        /* Signaled by usb:hs whenever an interface gets attached, detached or acquired. Cleared, with g_Mutex held, by */
+        /* whichever of the refresher and a missed lookup gets to it first, and that one refreshes the cache */
+        static Handle g_StateChangeEvent;
+
+        /* Guards the cache. Held across the queries of a refresh so a lookup never sees a half-built cache */
+        static ams::os::MutexType g_Mutex;
+
+        /* The cached interfaces and the device each belongs to, g_NumInterfaces out of g_Capacity are in use */
+        static UsbHsInterface* g_pInterfaces;
+        static const ::usb::devices::DeviceEntry** g_pDevices;
+        static size_t g_NumInterfaces;
+        static size_t g_Capacity;
+
+        static constexpr size_t g_InitialCapacity = 4;
+
+        /* Refresher Thread */
+        static constexpr size_t g_RefresherStackSize = 8_KB;
+        static constexpr s32 g_RefresherPriority = -11;
+        alignas(ams::os::MemoryPageSize) static u8 g_RefresherStack[g_RefresherStackSize];
+        static ams::os::ThreadType g_RefresherThread;
+
+        UsbHsInterfaceFilter MakeDeviceFilter(const ::usb::devices::DeviceEntry& Device)
+        {
+            return (UsbHsInterfaceFilter){
+                .Flags = UsbHsInterfaceFilterFlags_idVendor | UsbHsInterfaceFilterFlags_idProduct | UsbHsInterfaceFilterFlags_bInterfaceClass,
+                .idVendor = Device.mVendorId,
+                .idProduct = Device.mProductId,
+                .bcdDevice_Min = 0,
+                .bcdDevice_Max = 0,
+                .bDeviceClass = 0,
+                .bDeviceSubClass = 0,
+                .bDeviceProtocol = 0,
+                .bInterfaceClass = Device.mInterfaceClass,
+                .bInterfaceSubClass = 0,
+                .bInterfaceProtocol = 0,
+            };
+        }
+
+        /* Doubles the capacity, keeping the cached entries. Returns false, leaving the cache as is, if the heap is out of room */
+        /* Must be called with g_Mutex held */
+        bool Grow()
+        {
+            const size_t Capacity = g_Capacity * 2;
+            auto pInterfaces = static_cast<UsbHsInterface*>(lmem::AllocateFromExpHeap(g_HeapHandle, sizeof(UsbHsInterface) * Capacity));
+            auto pDevices = static_cast<const ::usb::devices::DeviceEntry**>(lmem::AllocateFromExpHeap(g_HeapHandle, sizeof(*g_pDevices) * Capacity));
+            if (pInterfaces == nullptr || pDevices == nullptr)
+            {
+                if (pInterfaces != nullptr)
+                    lmem::FreeToExpHeap(g_HeapHandle, pInterfaces);
+                if (pDevices != nullptr)
+                    lmem::FreeToExpHeap(g_HeapHandle, pDevices);
+                return false;
+            }
+
+            std::copy_n(g_pInterfaces, g_NumInterfaces, pInterfaces);
+            std::copy_n(g_pDevices, g_NumInterfaces, pDevices);
+            lmem::FreeToExpHeap(g_HeapHandle, g_pInterfaces);
+            lmem::FreeToExpHeap(g_HeapHandle, g_pDevices);
+
+            g_pInterfaces = pInterfaces;
+            g_pDevices = pDevices;
+            g_Capacity = Capacity;
+            return true;
+        }
+
+        /* Rebuilds the cache from usb:hs. Must be called with g_Mutex held */
+        void Refresh()
+        {
+            g_NumInterfaces = 0;
+            for (size_t device = 0; device < ::usb::devices::GetDeviceCount(); device++)
+            {
+                const ::usb::devices::DeviceEntry& Device = ::usb::devices::GetDevice(device);
+                if (!::usb::devices::IsDrivenByAdapterDriver(Device))
+                    continue;
+
+                const UsbHsInterfaceFilter Filter = MakeDeviceFilter(Device);
+                s32 NumOut;
+                while (true)
+                {
+                    const size_t Remaining = g_Capacity - g_NumInterfaces;
+                    if (R_FAILED(usbHsQueryAvailableInterfacesFwd(g_pUsbService, &Filter, g_pInterfaces + g_NumInterfaces, Remaining, &NumOut)))
+                    {
+                        DEBUG("[InterfaceCache] Failed to query the available interfaces of %04x:%04x\n", Device.mVendorId, Device.mProductId);
+                        NumOut = 0;
+                        break;
+                    }
+
+                    /* A full buffer may have cut the results short, query again with more room. Without room the interfaces that */
+                    /* didn't fit stay uncached, and AcquireUsbIf forwards them */
+                    if (static_cast<size_t>(NumOut) < Remaining)
+                        break;
+                    if (!Grow())
+                    {
+                        DEBUG("[InterfaceCache] Out of heap for more than %zu interfaces\n", g_Capacity);
+                        break;
+                    }
+                }
+
+                for (s32 i = 0; i < NumOut; i++)
+                {
+                    g_pDevices[g_NumInterfaces++] = &Device;
+                }
+            }
+        }
+
+        const ::usb::devices::DeviceEntry* Lookup(u32 interfaceId, UsbHsInterface* pOut)
+        {
+            for (size_t i = 0; i < g_NumInterfaces; i++)
+            {
+                if (g_pInterfaces[i].inf.ID == static_cast<s32>(interfaceId))
+                {
+                    *pOut = g_pInterfaces[i];
+                    return g_pDevices[i];
+                }
+            }
+            return nullptr;
+        }
+
+        /* Clears a pending state change, returning whether there was one. ResetSignal fails on an event that isn't signaled, */
+        /* so only one caller ever sees a given change. Must be called with g_Mutex held */
+        bool TakeStateChange()
+        {
+            return R_SUCCEEDED(ams::svc::ResetSignal(g_StateChangeEvent));
+        }
+
+        void RefresherThreadFunction(void*)
+        {
+            while (true)
+            {
+                s32 DummyIndex;
+                R_ABORT_UNLESS(ams::svc::WaitSynchronization(&DummyIndex, &g_StateChangeEvent, 1, UINT64_MAX));
+
+                /* A lookup may have taken the change in the meantime, in which case the cache is already up to date */
+                ams::os::LockMutex(&g_Mutex);
+                if (TakeStateChange())
+                {
+                    Refresh();
+                    DEBUG("[InterfaceCache] Interface state changed, %zu adapter interface(s) available\n", g_NumInterfaces);
+                }
+                ams::os::UnlockMutex(&g_Mutex);
+            }
+        }
+    }
+
+    void Initialize(::Service* pService, lmem::HeapHandle Heap)
+    {
+        g_pUsbService = pService;
+        g_HeapHandle = Heap;
+        ams::os::InitializeMutex(&g_Mutex, false, 1);
+
+        /* Fetch the event before the first refresh, so no change can slip in between the two */
+        R_ABORT_UNLESS(usbHsGetInterfaceStateChangeEventFwd(g_pUsbService, &g_StateChangeEvent));
+
+        g_Capacity = g_InitialCapacity;
+        g_pInterfaces = static_cast<UsbHsInterface*>(lmem::AllocateFromExpHeap(g_HeapHandle, sizeof(UsbHsInterface) * g_Capacity));
+        g_pDevices = static_cast<const ::usb::devices::DeviceEntry**>(lmem::AllocateFromExpHeap(g_HeapHandle, sizeof(*g_pDevices) * g_Capacity));
+        AMS_ABORT_UNLESS(g_pInterfaces != nullptr && g_pDevices != nullptr);
+        Refresh();
+
+        R_ABORT_UNLESS(ams::os::CreateThread(
+            &g_RefresherThread,
+            RefresherThreadFunction,
+            nullptr,
+            g_RefresherStack,
+            g_RefresherStackSize,
+            g_RefresherPriority
+        ));
+
+        ams::os::SetThreadNamePointer(&g_RefresherThread, "usb::mitm::InterfaceCacheRefresher");
+        ams::os::StartThread(&g_RefresherThread);
+    }
+
+    const ::usb::devices::DeviceEntry* Find(u32 interfaceId, UsbHsInterface* pOut)
+    {
+        ams::os::LockMutex(&g_Mutex);
+        ON_SCOPE_EXIT { ams::os::UnlockMutex(&g_Mutex); };
+
+        if (const ::usb::devices::DeviceEntry* pDevice = Lookup(interfaceId, pOut); pDevice != nullptr)
+            return pDevice;
+
+        /* HID is signaled about an attach at the same time as we are, so it can get here before the refresher does. The */
+        /* queries are only made then, a miss with no change pending is settled from the cache */
+        if (!TakeStateChange())
+            return nullptr;
+
+        Refresh();
+        return Lookup(interfaceId, pOut);
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <switch.h>
+#include <stratosphere.hpp>
+#include "device_table.hpp"
+
+/* Available interfaces of every device the adapter driver handles, so that AcquireUsbIf can tell whether it's being asked */
+/* for an adapter without querying usb:hs every time */
+/* The cache is refreshed in the background whenever usb:hs signals an interface state change, i.e. a device got attached */
+/* or detached, and grows with the number of interfaces found */
+namespace ams::mitm::usb::interface_cache
+{
+    /* Starts the refresher, pService is the usb:hs session used for the queries and Heap what the cache is allocated from */
+    /* Needs the device table to be loaded */
+    void Initialize(::Service* pService, lmem::HeapHandle Heap);
+
+    /* Looks up an available interface of a device driven by the adapter driver. On a miss with a state change still */
+    /* pending, i.e. one the refresher hasn't got to yet, the cache is refreshed right away before giving up. Otherwise */
+    /* usb:hs isn't queried at all */
+    /* Returns the device table entry and copies the interface to pOut if found, nullptr otherwise */
+    const ::usb::devices::DeviceEntry* Find(u32 interfaceId, UsbHsInterface* pOut);
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "aarch64_emitter.hpp"
+
+/* Generator for the code injected into the usb sysmodule to force the bInterval of the endpoints of some devices */
+/* The usb sysmodule gets hooked right after it fetches an endpoint descriptor: the hooked instruction is replaced by a bl */
+/* to the generated code, which compares the vendor and product id of the device the descriptor belongs to against every */
+/* patched device, overwrites bInterval on a match and then executes the displaced instruction before returning */
+/* This only depends on the standard library so host-side tooling can use it as is */
+namespace usb::patch
+{
+    /* Where and how the usb sysmodule gets hooked */
+    struct HookSite
+    {
+        /* Offset of the hooked instruction from the start of .text */
+        uint32_t mOffset;
+        /* The hooked instruction, it gets executed at the end of the generated code. It mustn't be pc-relative or use x0/x1 */
+        uint32_t mDisplacedInstruction;
+        /* Register holding the device the endpoint belongs to at the hook, and the offset of its (unaligned) vendor and product id */
+        a64::Register mDeviceRegister;
+        uint32_t mDeviceIdsOffset;
+        /* Register pointing at the endpoint descriptor at the hook */
+        a64::Register mDescriptorRegister;
+    };
+
+    /* Hook site in the builds of the usb sysmodule we know of. Other builds get left alone, see tools/hook_locator for */
+    /* deriving a signature that would find the site on them */
+    static constexpr HookSite g_EndpointDescriptorHook = {
+        .mOffset = 0x3EA04,
+        .mDisplacedInstruction = a64::encode::LdrW_Immediate(a64::R14, a64::R13, 0),
+        .mDeviceRegister = a64::R20,
+        .mDeviceIdsOffset = 0x1E65,
+        .mDescriptorRegister = a64::R13,
+    };
+
+    /* Offset of bInterval in a usb endpoint descriptor */
+    static constexpr uint32_t EndpointIntervalOffset = 6;
+
+    struct PatchDevice
+    {
+        uint16_t mVendorId;
+        uint16_t mProductId;
+        uint8_t mInterval;
+    };
+
+    static constexpr size_t MaxPatchDevices = 8;
+
+    /* Prologue and epilogue take 3 instructions each, every device 7 */
+    static constexpr size_t MaxPatchInstructions = 6 + 7 * MaxPatchDevices;
+
+    using PatchAssembler = a64::Assembler<MaxPatchInstructions>;
+
+    /* Emits the code the hook branches to, returns false if the hook site or devices can't be handled */
+    constexpr bool GeneratePatch(PatchAssembler& Asm, const HookSite& Site, const PatchDevice* pDevices, size_t NumDevices)
+    {
+        using namespace a64;
+
+        /* x0 and x1 are used as scratch registers */
+        if (NumDevices > MaxPatchDevices || Site.mDeviceRegister <= R1 || Site.mDescriptorRegister <= R1
+            || Site.mDeviceRegister == Sp || Site.mDescriptorRegister == Sp || Site.mDeviceIdsOffset > UINT16_MAX)
+            return false;
+
+        const Label Done = Asm.CreateLabel();
+
+        Asm.Emit(encode::StpX_PreIndex(R0, R1, Sp, -16));
+        Asm.Emit(encode::MovzX(R1, static_cast<uint16_t>(Site.mDeviceIdsOffset)));
+        /* Vendor id in the low half, product id in the high half */
+        Asm.Emit(encode::LdrW_Register(R0, Site.mDeviceRegister, R1));
+
+        for (size_t i = 0; i < NumDevices; i++)
+        {
+            const Label Next = Asm.CreateLabel();
+
+            Asm.Emit(encode::MovzW(R1, pDevices[i].mVendorId));
+            Asm.Emit(encode::MovkW(R1, pDevices[i].mProductId, 16));
+            Asm.Emit(encode::CmpW_Register(R0, R1));
+            Asm.BCond(Ne, Next);
+            Asm.Emit(encode::MovzW(R1, pDevices[i].mInterval));
+            Asm.Emit(encode::Strb_Immediate(R1, Site.mDescriptorRegister, EndpointIntervalOffset));
+            Asm.B(Done);
+            Asm.Bind(Next);
+        }
+
+        Asm.Bind(Done);
+        Asm.Emit(encode::LdpX_PostIndex(R0, R1, Sp, 16));
+        Asm.Emit(Site.mDisplacedInstruction);
+        Asm.Emit(encode::Ret());
+
+        return Asm.Finalize();
+    }
+
+    /* Instruction written over the hooked one, both offsets being from the start of .text */
+    constexpr uint32_t GenerateHook(uint32_t HookOffset, uint32_t PatchOffset)
+    {
+        return a64::encode::Bl(static_cast<int32_t>(PatchOffset) - static_cast<int32_t>(HookOffset));
+    }
+
+    namespace impl
+    {
+        /* Checks the generator against the hand-written patch it replaced, as assembled for the GameCube adapter at 1ms */
+        constexpr bool CheckGameCubeAdapterPatch()
+        {
+            constexpr PatchDevice Device = { .mVendorId = 0x057E, .mProductId = 0x0337, .mInterval = 1 };
+            constexpr uint32_t Expected[] = {
+                0xA9BF07E0, /* stp x0, x1, [sp, #-16]! */
+                0xD283CCA1, /* mov x1, #0x1e65 */
+                0xB8616A80, /* ldr w0, [x20, x1] */
+                0x5280AFC1, /* mov w1, #0x057e */
+                0x72A066E1, /* movk w1, #0x0337, lsl #16 */
+                0x6B01001F, /* cmp w0, w1 */
+                0x54000081, /* b.ne +0x10 */
+                0x52800021, /* mov w1, #1 */
+                0x390019A1, /* strb w1, [x13, #6] */
+                0x14000001, /* b +0x4 */
+                0xA8C107E0, /* ldp x0, x1, [sp], #16 */
+                0xB94001AE, /* ldr w14, [x13] */
+                0xD65F03C0, /* ret */
+            };
+
+            PatchAssembler Asm;
+            if (!GeneratePatch(Asm, g_EndpointDescriptorHook, &Device, 1) || Asm.GetCount() != std::size(Expected))
+                return false;
+
+            for (size_t i = 0; i < std::size(Expected); i++)
+            {
+                if (Asm.GetCode()[i] != Expected[i])
+                    return false;
+            }
+
+            /* The patch used to sit at the very start of .text */
+            return GenerateHook(g_EndpointDescriptorHook.mOffset, 0) == 0x97FF057F;
+        }
+
+        /* A full table has to fit, and branches past every device to the shared epilogue */
+        constexpr bool CheckFullPatch()
+        {
+            PatchDevice Devices[MaxPatchDevices] = {};
+            PatchAssembler Asm;
+            if (!GeneratePatch(Asm, g_EndpointDescriptorHook, Devices, MaxPatchDevices) || Asm.GetCount() != MaxPatchInstructions)
+                return false;
+
+            /* The first device's b to the epilogue skips the 7 instructions of each remaining device */
+            return Asm.GetCode()[9] == a64::encode::B(4 * (1 + 7 * (MaxPatchDevices - 1)));
+        }
+    }
+
+    static_assert(impl::CheckGameCubeAdapterPatch());
+    static_assert(impl::CheckFullPatch());
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+
+/* Latency histograms for the packet path */
+/* These only depend on the standard library so that they can be reused by host-side tooling */
+namespace usb::gc::stats
+{
+    /* Condensed view of a histogram, this is also the layout handed out to usb:gc clients so it must stay stable */
+    struct LatencySummary
+    {
+        uint64_t mCount;
+        /* Percentiles are rounded up to the end of the bucket they fall in, so they are never reported lower than they were */
+        uint64_t mP50Ns;
+        uint64_t mP99Ns;
+        uint64_t mMaxNs;
+    };
+
+    static_assert(sizeof(LatencySummary) == 32);
+
+    /* Fixed-bucket histogram of durations that any number of threads can record into without taking a lock */
+    /* Recording is a couple of relaxed atomic adds, which is cheap enough to leave on in release builds */
+    class LatencyHistogram
+    {
+    public:
+        /* 20us buckets covering 0-8ms, HID polls far more often than that. Anything longer goes in an overflow bucket, */
+        /* the max is tracked separately so it stays exact */
+        static constexpr uint64_t BucketWidthNs = 20'000;
+        static constexpr size_t BucketCount = 400;
+
+    private:
+        std::atomic<uint32_t> mBuckets[BucketCount + 1];
+        std::atomic<uint64_t> mMaxNs;
+
+    public:
+        /* Clears every bucket. Samples recorded while this runs may or may not survive it */
+        void Reset()
+        {
+            for (size_t i = 0; i <= BucketCount; i++)
+            {
+                mBuckets[i].store(0, std::memory_order_relaxed);
+            }
+            mMaxNs.store(0, std::memory_order_relaxed);
+        }
+
+        void Record(uint64_t Ns)
+        {
+            const size_t Bucket = static_cast<size_t>(std::min<uint64_t>(Ns / BucketWidthNs, BucketCount));
+            mBuckets[Bucket].fetch_add(1, std::memory_order_relaxed);
+
+            uint64_t Max = mMaxNs.load(std::memory_order_relaxed);
+            while (Ns > Max && !mMaxNs.compare_exchange_weak(Max, Ns, std::memory_order_relaxed)) {}
+        }
+
+        void Summarize(LatencySummary* pOut) const
+        {
+            uint32_t Counts[BucketCount + 1];
+            uint64_t Total = 0;
+            for (size_t i = 0; i <= BucketCount; i++)
+            {
+                Counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+                Total += Counts[i];
+            }
+
+            const uint64_t Max = mMaxNs.load(std::memory_order_relaxed);
+
+            /* Smallest bucket end that at least Rank samples fall at or below */
+            const auto Percentile = [&](uint64_t Rank) -> uint64_t {
+                uint64_t Seen = 0;
+                for (size_t i = 0; i < BucketCount; i++)
+                {
+                    Seen += Counts[i];
+                    if (Seen >= Rank)
+                        return std::min<uint64_t>((i + 1) * BucketWidthNs, Max);
+                }
+                return Max;
+            };
+
+            *pOut = (LatencySummary){
+                .mCount = Total,
+                .mP50Ns = Total != 0 ? Percentile((Total + 1) / 2) : 0,
+                .mP99Ns = Total != 0 ? Percentile((Total * 99 + 99) / 100) : 0,
+                .mMaxNs = Max,
+            };
+        }
+    };
+}
@@ -1,12 +1,15 @@
 #include "logger.hpp"
+#include <algorithm>
+#include <cstring>
 
 namespace usb::util
 {
+    using namespace ams::literals;
 
     static constinit char s_SdCardMount[] = "sd";
     static constinit char s_LogFilePath[] = "sd:/log.txt";
 
-    static long s_LogFilePosition = 0;
+    static s64 s_LogFilePosition = 0;
     static ams::fs::FileHandle s_LogFileHandle;
 
     static constexpr bool s_Enabled = true;
@@ -17,27 +20,152 @@ namespace usb::util
         return;               \
     }
 
+    /* Lines waiting to be written. This is a bounded multi-producer queue: producers race for a ticket with a CAS, */
+    /* and each slot's sequence number tells both sides whether the slot is theirs to touch */
+    static constexpr size_t s_LogSlotCount = 128;
+    static_assert((s_LogSlotCount & (s_LogSlotCount - 1)) == 0, "Log slot count must be a power of two");
+    static impl::LogSlot s_LogSlots[s_LogSlotCount];
+    static std::atomic<u64> s_LogWriteTicket;
+    /* Only touched by the flusher thread */
+    static u64 s_LogReadTicket;
+
+    static std::atomic<u64> s_LogDroppedBytes;
+
+    /* Flusher Thread */
+    /* Writes are batched up so the file only gets touched a few times a second, even when every thread is logging */
+    static constexpr size_t s_FlusherStackSize = 8_KB;
+    static constexpr s32 s_FlusherPriority = ams::os::LowestThreadPriority;
+    static constexpr ams::TimeSpan s_FlusherIdleSleep = ams::TimeSpan::FromMilliSeconds(10);
+    alignas(ams::os::MemoryPageSize) static u8 s_FlusherStack[s_FlusherStackSize];
+    static ams::os::ThreadType s_FlusherThread;
+    static std::atomic<bool> s_FlusherStopRequested;
+    static char s_FlushBuffer[16_KB];
+
     namespace impl
     {
-        ams::os::Mutex s_LogMutex(false);
-        char s_FormatBuffer[500];
+        LogSlot* ClaimSlot()
+        {
+            if constexpr (!s_Enabled)
+            {
+                return nullptr;
+            }
+
+            u64 Ticket = s_LogWriteTicket.load(std::memory_order_relaxed);
+            while (true)
+            {
+                LogSlot* pSlot = &s_LogSlots[Ticket % s_LogSlotCount];
+                const u64 Sequence = pSlot->mSequence.load(std::memory_order_acquire);
+
+                if (Sequence == Ticket)
+                {
+                    if (s_LogWriteTicket.compare_exchange_weak(Ticket, Ticket + 1, std::memory_order_relaxed))
+                    {
+                        pSlot->mTicket = Ticket;
+                        return pSlot;
+                    }
+                }
+                else if (Sequence < Ticket)
+                {
+                    /* The flusher hasn't emptied this slot since the last lap, the ring is full */
+                    return nullptr;
+                }
+                else
+                {
+                    /* Another producer got this ticket first */
+                    Ticket = s_LogWriteTicket.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void CommitSlot(LogSlot* pSlot, int Length)
+        {
+            pSlot->mLength = static_cast<u32>(std::clamp<int>(Length, 0, sizeof(pSlot->mText) - 1));
+            pSlot->mSequence.store(pSlot->mTicket + 1, std::memory_order_release);
+        }
 
-        void Log(const char *text, size_t length)
+        void CountDropped(int Length)
         {
-            CHECK_ENABLED();
-            R_ABORT_UNLESS(ams::fs::OpenFile(std::addressof(s_LogFileHandle), s_LogFilePath, ams::fs::OpenMode_All));
+            if constexpr (!s_Enabled)
+            {
+                return;
+            }
+
+            s_LogDroppedBytes.fetch_add(std::max(Length, 0), std::memory_order_relaxed);
+        }
+    }
+
+    /* Copies as many committed lines as fit into the flush buffer, handing their slots back to the producers */
+    static size_t DrainSlots()
+    {
+        size_t Size = 0;
+        while (true)
+        {
+            impl::LogSlot* pSlot = &s_LogSlots[s_LogReadTicket % s_LogSlotCount];
+            if (pSlot->mSequence.load(std::memory_order_acquire) != s_LogReadTicket + 1)
+                break;
+
+            if (Size + pSlot->mLength > sizeof(s_FlushBuffer))
+                break;
+
+            std::memcpy(s_FlushBuffer + Size, pSlot->mText, pSlot->mLength);
+            Size += pSlot->mLength;
+
+            pSlot->mSequence.store(s_LogReadTicket + s_LogSlotCount, std::memory_order_release);
+            s_LogReadTicket++;
+        }
+        return Size;
+    }
 
-            /* Write text to file. */
-            R_ABORT_UNLESS(ams::fs::WriteFile(s_LogFileHandle, s_LogFilePosition, text, length, ams::fs::WriteOption::Flush));
+    static void WriteToFile(const char* pText, size_t Size)
+    {
+        R_ABORT_UNLESS(ams::fs::WriteFile(s_LogFileHandle, s_LogFilePosition, pText, Size, ams::fs::WriteOption::None));
+        s_LogFilePosition += Size;
+    }
 
-            R_ABORT_UNLESS(ams::fs::FlushFile(s_LogFileHandle));
+    static void FlusherThreadFunction(void*)
+    {
+        u64 ReportedDroppedBytes = 0;
+        bool NeedsFlush = false;
 
-            ams::fs::CloseFile(s_LogFileHandle);
-            /* Move forward position. */
-            s_LogFilePosition += length;
+        while (true)
+        {
+            const size_t Size = DrainSlots();
+            if (Size != 0)
+            {
+                WriteToFile(s_FlushBuffer, Size);
+                NeedsFlush = true;
+                continue;
+            }
+
+            /* Leave a note in the log wherever lines went missing */
+            const u64 DroppedBytes = s_LogDroppedBytes.load(std::memory_order_relaxed);
+            if (DroppedBytes != ReportedDroppedBytes)
+            {
+                const int Length = std::snprintf(s_FlushBuffer, sizeof(s_FlushBuffer), "[Logger] Dropped %llu bytes of log output\n", static_cast<unsigned long long>(DroppedBytes - ReportedDroppedBytes));
+                WriteToFile(s_FlushBuffer, Length);
+                ReportedDroppedBytes = DroppedBytes;
+                NeedsFlush = true;
+            }
+
+            /* The ring has been emptied, so this is a good point to make sure everything has hit the SD card */
+            if (NeedsFlush)
+            {
+                R_ABORT_UNLESS(ams::fs::FlushFile(s_LogFileHandle));
+                NeedsFlush = false;
+            }
+
+            if (s_FlusherStopRequested.load(std::memory_order_acquire))
+                break;
+
+            ams::os::SleepThread(s_FlusherIdleSleep);
         }
     }
 
+    u64 GetDroppedBytes()
+    {
+        return s_LogDroppedBytes.load(std::memory_order_relaxed);
+    }
+
     void Initialize()
     {
         CHECK_ENABLED();
@@ -51,20 +179,44 @@ namespace usb::util
         }
         R_END_TRY_CATCH_WITH_ABORT_UNLESS;
 
-        /* Open log file. */
+        /* Open log file, it stays open until Finalize. */
         R_ABORT_UNLESS(ams::fs::OpenFile(std::addressof(s_LogFileHandle), s_LogFilePath, ams::fs::OpenMode_All));
 
         /* Get size of log file, so we can set our position to the end of it. */
         R_ABORT_UNLESS(ams::fs::GetFileSize(std::addressof(s_LogFilePosition), s_LogFileHandle));
 
-        ams::fs::CloseFile(s_LogFileHandle);
+        for (size_t i = 0; i < s_LogSlotCount; i++)
+        {
+            s_LogSlots[i].mSequence.store(i, std::memory_order_relaxed);
+        }
+        s_LogReadTicket = 0;
+        s_LogWriteTicket.store(0, std::memory_order_release);
+
+        R_ABORT_UNLESS(ams::os::CreateThread(
+            &s_FlusherThread,
+            FlusherThreadFunction,
+            nullptr,
+            s_FlusherStack,
+            s_FlusherStackSize,
+            s_FlusherPriority
+        ));
+
+        ams::os::SetThreadNamePointer(&s_FlusherThread, "usb::util::LogFlusher");
+        ams::os::StartThread(&s_FlusherThread);
     }
 
     void Finalize()
     {
         CHECK_ENABLED();
 
+        /* Let the flusher write out whatever is left before closing the file */
+        s_FlusherStopRequested.store(true, std::memory_order_release);
+        ams::os::WaitThread(&s_FlusherThread);
+        ams::os::DestroyThread(&s_FlusherThread);
+
+        ams::fs::CloseFile(s_LogFileHandle);
+
         /* Unmount SD card. */
         ams::fs::Unmount(s_SdCardMount);
     }
-}
\ No newline at end of file
+}
@@ -2,8 +2,9 @@
 
 #include <stratosphere.hpp>
 #include <cstdio>
+#include <cstdarg>
 #include <utility>
-#include <mutex>
+#include <atomic>
 #include <source_location>
 
 #ifdef RELEASE
@@ -17,57 +18,66 @@ namespace usb::util
 
     namespace impl
     {
-        extern ams::os::Mutex s_LogMutex;
-        extern char s_FormatBuffer[500];
+        /* Longest line that can be logged, anything past this gets cut off */
+        static constexpr size_t LogLineSize = 500;
 
-        void Log(const char *text, size_t length);
+        /* One line of the log ring. Producers format straight into a slot, the flusher thread copies it out */
+        struct LogSlot
+        {
+            /* Slot is free for the producer whose ticket equals this, and holds a line for the flusher when it is one more */
+            std::atomic<u64> mSequence;
+            u64 mTicket;
+            u32 mLength;
+            char mText[LogLineSize];
+        };
+
+        /* Claims the next slot of the ring, or returns nullptr if the flusher has fallen too far behind */
+        /* Never blocks, so it is safe to call from the driver and IPC threads */
+        LogSlot* ClaimSlot();
+
+        /* Hands a claimed slot holding a line of Length bytes (as returned by snprintf) over to the flusher thread */
+        void CommitSlot(LogSlot* pSlot, int Length);
+
+        /* Counts a line that was thrown away because the ring was full */
+        void CountDropped(int Length);
     }
 
     void Initialize();
     void Finalize();
 
-    template <typename... Args>
-    void LogUnsafe(const char *fmt, Args &&...args)
-    {
-        /* Format string, passing the templated arguments. */
-        auto length = std::snprintf(impl::s_FormatBuffer, sizeof(impl::s_FormatBuffer), fmt, std::forward<Args>(args)...);
-        /* Call underlying implementation. */
-        impl::Log(impl::s_FormatBuffer, length);
-    }
-
-    inline void VLogUnsafe(const char *fmt, va_list args)
-    {
-        /* Format string, passing va list. */
-        auto length = std::vsnprintf(impl::s_FormatBuffer, sizeof(impl::s_FormatBuffer), fmt, args);
-        /* Call underlying implementation. */
-        impl::Log(impl::s_FormatBuffer, length);
-    }
+    /* Bytes of log output thrown away because the flusher thread couldn't keep up */
+    u64 GetDroppedBytes();
 
     template <typename... Args>
     void Log(const char *fmt, Args &&...args)
     {
-        /* Acquire lock to ensure thread safety. */
-        std::scoped_lock lk(impl::s_LogMutex);
-        LogUnsafe(fmt, std::forward<Args>(args)...);
+        impl::LogSlot *pSlot = impl::ClaimSlot();
+        if (pSlot == nullptr)
+        {
+            /* Only measure the line once we know we're dropping it */
+            impl::CountDropped(std::snprintf(nullptr, 0, fmt, args...));
+            return;
+        }
+
+        /* Format string straight into the slot, passing the templated arguments. */
+        impl::CommitSlot(pSlot, std::snprintf(pSlot->mText, sizeof(pSlot->mText), fmt, std::forward<Args>(args)...));
     }
 
     inline void VLog(const char *fmt, va_list args)
     {
-        /* Acquire lock to ensure thread safety. */
-        std::scoped_lock lk(impl::s_LogMutex);
-        VLogUnsafe(fmt, args);
+        impl::LogSlot *pSlot = impl::ClaimSlot();
+        if (pSlot == nullptr)
+        {
+            impl::CountDropped(std::vsnprintf(nullptr, 0, fmt, args));
+            return;
+        }
+
+        /* Format string straight into the slot, passing va list. */
+        impl::CommitSlot(pSlot, std::vsnprintf(pSlot->mText, sizeof(pSlot->mText), fmt, args));
     }
 
     ALWAYS_INLINE void Checkpoint(const std::source_location &loc = std::source_location::current())
     {
         Log("%s:%d\t | %s\n", loc.file_name(), loc.line(), loc.function_name());
     }
-
-    // template<typename... Args>
-    // ALWAYS_INLINE void Checkpoint(const char* fmt, Args &&... args, const std::source_location& loc = std::source_location::current()) {
-    //     std::scoped_lock lk(impl::s_LogMutex);
-    //     LogUnsafe("%s:%d\t | %s \t| ", loc.file_name(), loc.line(), loc.function_name());
-    //     LogUnsafe(fmt, std::forward<Args>(args)...);
-    //     LogUnsafe("\n");
-    // }
 }
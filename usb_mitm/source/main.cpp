@@ -5,6 +5,9 @@
 #include "usbmitm_module.hpp"
 #include "usb_gc_service.hpp"
 #include "usb_sysmodule_patch.hpp"
+#include "trace.hpp"
+#include "capture.hpp"
+#include "device_table.hpp"
 
 namespace ams::init
 {
@@ -38,6 +41,9 @@ namespace ams
     {
         R_ABORT_UNLESS(smInitialize());
         ::usb::util::Log("Hello World\n");
+        ::usb::trace::Initialize();
+        ::usb::capture::Initialize();
+        ::usb::devices::Initialize();
         mitm::usb::sysmodule_patch::PatchUsbService();
 
         mitm::usb::Initialize();
@@ -0,0 +1,155 @@
+#include "packet_processing.hpp"
+
+/* The kernels below work on all AnalogLaneCount lanes at once with fixed trip counts and no data-dependent branches, */
+/* which is the shape the compiler needs to turn them into NEON min/max/add instructions */
+namespace usb::gc::packet
+{
+    namespace
+    {
+        using AnalogLanes = uint8_t[AnalogLaneCount];
+
+        void GatherAnalog(const uint8_t* pPacket, AnalogLanes& Out)
+        {
+            for (size_t port = 0; port < PortCount; port++)
+            {
+                std::memcpy(Out + port * PortAnalogSize, pPacket + PortOffset(port) + PortAnalogOffset, PortAnalogSize);
+            }
+        }
+
+        void ComputeMean(const AnalogFilterState* pState, AnalogLanes& Out)
+        {
+            uint16_t Sums[AnalogLaneCount] = {};
+            for (size_t sample = 0; sample < AnalogWindowSize; sample++)
+            {
+                for (size_t lane = 0; lane < AnalogLaneCount; lane++)
+                {
+                    Sums[lane] += pState->mWindow[sample][lane];
+                }
+            }
+
+            static_assert(AnalogWindowSize == 8, "Mean uses a shift for the division");
+            for (size_t lane = 0; lane < AnalogLaneCount; lane++)
+            {
+                Out[lane] = static_cast<uint8_t>((Sums[lane] + AnalogWindowSize / 2) >> 3);
+            }
+        }
+
+        inline void CompareExchange(AnalogLanes& A, AnalogLanes& B)
+        {
+            AnalogLanes Low;
+            AnalogLanes High;
+            for (size_t lane = 0; lane < AnalogLaneCount; lane++)
+            {
+                Low[lane] = std::min(A[lane], B[lane]);
+                High[lane] = std::max(A[lane], B[lane]);
+            }
+            std::memcpy(A, Low, sizeof(Low));
+            std::memcpy(B, High, sizeof(High));
+        }
+
+        void ComputeMedian(const AnalogFilterState* pState, AnalogLanes& Out)
+        {
+            AnalogLanes Sorted[AnalogWindowSize];
+            std::memcpy(Sorted, pState->mWindow, sizeof(Sorted));
+
+            /* Batcher's odd-even merge sorting network for 8 inputs, sorting every lane at the same time */
+            static_assert(AnalogWindowSize == 8, "Median uses a fixed sorting network");
+            static constexpr uint8_t Network[][2] = {
+                { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+                { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+                { 1, 2 }, { 5, 6 }, { 0, 4 }, { 3, 7 },
+                { 1, 5 }, { 2, 6 },
+                { 1, 4 }, { 3, 6 },
+                { 2, 4 }, { 3, 5 },
+                { 3, 4 },
+            };
+
+            for (const auto& Pair : Network)
+            {
+                CompareExchange(Sorted[Pair[0]], Sorted[Pair[1]]);
+            }
+
+            /* Even window, so the median is the rounded average of the two middle samples */
+            for (size_t lane = 0; lane < AnalogLaneCount; lane++)
+            {
+                Out[lane] = static_cast<uint8_t>((Sorted[3][lane] + Sorted[4][lane] + 1) >> 1);
+            }
+        }
+
+        void ComputeExponential(const AnalogFilterState* pState, AnalogLanes& Out)
+        {
+            for (size_t lane = 0; lane < AnalogLaneCount; lane++)
+            {
+                Out[lane] = static_cast<uint8_t>((pState->mAverage[lane] + 0x80) >> 8);
+            }
+        }
+    }
+
+    void ResetAnalogFilter(AnalogFilterState* pState)
+    {
+        pState->mNext = 0;
+        pState->mIsPrimed = false;
+    }
+
+    void PushAnalogSample(AnalogFilterState* pState, const uint8_t* pPacket)
+    {
+        AnalogLanes Sample;
+        GatherAnalog(pPacket, Sample);
+
+        /* Fill the whole window with the first sample, so the filters never see uninitialized history */
+        if (!pState->mIsPrimed)
+        {
+            for (size_t sample = 0; sample < AnalogWindowSize; sample++)
+            {
+                std::memcpy(pState->mWindow[sample], Sample, sizeof(Sample));
+            }
+            for (size_t lane = 0; lane < AnalogLaneCount; lane++)
+            {
+                pState->mAverage[lane] = static_cast<uint16_t>(Sample[lane] << 8);
+            }
+            pState->mNext = 0;
+            pState->mIsPrimed = true;
+            return;
+        }
+
+        std::memcpy(pState->mWindow[pState->mNext], Sample, sizeof(Sample));
+        pState->mNext = (pState->mNext + 1) % AnalogWindowSize;
+
+        /* average += (sample - average) / 4, in 8.8 fixed point */
+        for (size_t lane = 0; lane < AnalogLaneCount; lane++)
+        {
+            const int32_t Average = pState->mAverage[lane];
+            pState->mAverage[lane] = static_cast<uint16_t>(Average + (((static_cast<int32_t>(Sample[lane]) << 8) - Average) >> 2));
+        }
+    }
+
+    void ApplyAnalogFilter(const AnalogFilterState* pState, const AnalogFilterMode (&Modes)[PortCount], uint8_t* pPacket)
+    {
+        if (!pState->mIsPrimed)
+            return;
+
+        /* Only run the kernels that at least one port is using */
+        bool IsUsed[static_cast<size_t>(AnalogFilterMode::Count)] = {};
+        for (size_t port = 0; port < PortCount; port++)
+        {
+            if (Modes[port] < AnalogFilterMode::Count)
+                IsUsed[static_cast<size_t>(Modes[port])] = true;
+        }
+
+        AnalogLanes Filtered[static_cast<size_t>(AnalogFilterMode::Count)];
+        if (IsUsed[static_cast<size_t>(AnalogFilterMode::Mean)])
+            ComputeMean(pState, Filtered[static_cast<size_t>(AnalogFilterMode::Mean)]);
+        if (IsUsed[static_cast<size_t>(AnalogFilterMode::Median)])
+            ComputeMedian(pState, Filtered[static_cast<size_t>(AnalogFilterMode::Median)]);
+        if (IsUsed[static_cast<size_t>(AnalogFilterMode::Exponential)])
+            ComputeExponential(pState, Filtered[static_cast<size_t>(AnalogFilterMode::Exponential)]);
+
+        for (size_t port = 0; port < PortCount; port++)
+        {
+            if (Modes[port] == AnalogFilterMode::None || Modes[port] >= AnalogFilterMode::Count)
+                continue;
+
+            std::memcpy(pPacket + PortOffset(port) + PortAnalogOffset, Filtered[static_cast<size_t>(Modes[port])] + port * PortAnalogSize, PortAnalogSize);
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+/* Packet processing kernels for the GameCube adapter input packet */
+/* These only depend on the standard library so that they can be reused by host-side tooling */
+namespace usb::gc::packet
+{
+    /* Layout of the 37 byte adapter packet: a report id byte followed by 4 port blocks of 9 bytes */
+    /* Each port block is [status, buttons0, buttons1, stick x, stick y, c-stick x, c-stick y, trigger l, trigger r] */
+    static constexpr size_t PacketSize = 37;
+    static constexpr size_t PortCount = 4;
+    static constexpr size_t PortStride = 9;
+    static constexpr size_t PortsOffset = 1;
+
+    static constexpr size_t PortStatusOffset = 0;
+    static constexpr size_t PortButtonsOffset = 1;
+    static constexpr size_t PortButtonsSize = 2;
+    static constexpr size_t PortAnalogOffset = 3;
+    static constexpr size_t PortAnalogSize = 6;
+
+    static_assert(PortsOffset + PortCount * PortStride == PacketSize);
+    static_assert(PortAnalogOffset + PortAnalogSize == PortStride);
+
+    constexpr size_t PortOffset(size_t port)
+    {
+        return PortsOffset + port * PortStride;
+    }
+
+    /* Packs the digital button bytes of all four ports into a single word, 16 bits per port */
+    /* With the buttons in one word, merging them across samples is a single OR for every port and button at once */
+    inline uint64_t GatherButtons(const uint8_t* pPacket)
+    {
+        uint64_t Buttons = 0;
+        for (size_t port = 0; port < PortCount; port++)
+        {
+            uint16_t PortButtons;
+            std::memcpy(&PortButtons, pPacket + PortOffset(port) + PortButtonsOffset, PortButtonsSize);
+            Buttons |= static_cast<uint64_t>(PortButtons) << (16 * port);
+        }
+        return Buttons;
+    }
+
+    /* Inverse of GatherButtons */
+    inline void ScatterButtons(uint8_t* pPacket, uint64_t Buttons)
+    {
+        for (size_t port = 0; port < PortCount; port++)
+        {
+            const uint16_t PortButtons = static_cast<uint16_t>(Buttons >> (16 * port));
+            std::memcpy(pPacket + PortOffset(port) + PortButtonsOffset, &PortButtons, PortButtonsSize);
+        }
+    }
+
+    /* ORs the latched button bits into a packet, so every press seen since the last delivery shows up in it */
+    inline void ApplyLatchedButtons(uint8_t* pPacket, uint64_t Latched)
+    {
+        ScatterButtons(pPacket, GatherButtons(pPacket) | Latched);
+    }
+
+    /* Button bits seen across every read since the packet was last delivered, for DeliveryMode::LatchPresses */
+    /* The driver thread accumulates into it while HID's IPC thread takes from it, both without a lock. A bit set by */
+    /* Accumulate ends up in exactly one Take, so a press that starts and ends between two fetches is delivered once */
+    class ButtonLatch
+    {
+        std::atomic<uint64_t> mButtons;
+
+    public:
+        void Clear()
+        {
+            mButtons.store(0, std::memory_order_relaxed);
+        }
+
+        void Accumulate(const uint8_t* pPacket)
+        {
+            mButtons.fetch_or(GatherButtons(pPacket), std::memory_order_relaxed);
+        }
+
+        /* Returns every bit accumulated since the last Take and starts over from nothing */
+        uint64_t Take()
+        {
+            return mButtons.exchange(0, std::memory_order_relaxed);
+        }
+    };
+
+    /* Per-port smoothing applied to the stick and trigger axes before packets are handed to HID */
+    enum class AnalogFilterMode : uint8_t
+    {
+        None = 0,
+        /* Average of the last AnalogWindowSize samples */
+        Mean = 1,
+        /* Median of the last AnalogWindowSize samples, rejects single-sample spikes */
+        Median = 2,
+        /* Exponential moving average with a weight of 1/4 on the newest sample */
+        Exponential = 3,
+
+        Count
+    };
+
+    /* Number of samples the mean and median filters look at, about one HID poll worth at 1000hz */
+    static constexpr size_t AnalogWindowSize = 8;
+    /* Every analog byte of every port, laid out port by port */
+    static constexpr size_t AnalogLaneCount = PortCount * PortAnalogSize;
+
+    /* Running state of the analog filters for one adapter. Every filter is updated on every sample regardless of which */
+    /* one is selected, so switching modes never starts from a cold window */
+    struct AnalogFilterState
+    {
+        uint8_t mWindow[AnalogWindowSize][AnalogLaneCount];
+        /* 8.8 fixed point */
+        uint16_t mAverage[AnalogLaneCount];
+        size_t mNext;
+        bool mIsPrimed;
+    };
+
+    /* Clears the filter state, the next sample will fill the whole window */
+    void ResetAnalogFilter(AnalogFilterState* pState);
+
+    /* Feeds the analog axes of a freshly read packet into the filter state */
+    void PushAnalogSample(AnalogFilterState* pState, const uint8_t* pPacket);
+
+    /* Overwrites the analog axes of pPacket with the filtered values, using the mode selected for each port */
+    void ApplyAnalogFilter(const AnalogFilterState* pState, const AnalogFilterMode (&Modes)[PortCount], uint8_t* pPacket);
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+
+/* Layout of the read-only shared memory handed out by usb:gc GetSharedAdapterState */
+/* Clients map it once and then read the latest packet of every adapter without any IPC. Other tools depend on this layout, */
+/* so it only ever grows: new fields go at the end of a struct (bumping SharedStateVersion), existing ones never move */
+/* This only depends on the standard library so that clients can include it as is */
+namespace usb::gc::shared
+{
+    static constexpr uint32_t SharedStateMagic = 0x53434755; /* 'UGCS' */
+    static constexpr uint32_t SharedStateVersion = 1;
+
+    static constexpr size_t CacheLineSize = 64;
+    static constexpr size_t SharedPacketSize = 37;
+
+    enum SlotFlag : uint32_t
+    {
+        /* An adapter is plugged into this slot and being driven */
+        SlotFlag_Connected = (1 << 0),
+    };
+
+    /* State of one adapter slot. Every slot sits on its own cache line so publishing one adapter never disturbs readers of another */
+    /* mSequence is odd while the driver thread is writing the slot. To read it: load mSequence (acquire), retry if it is odd, copy */
+    /* the fields, then load it again (after an acquire fence) and retry if it changed. The write only covers these few bytes, so */
+    /* readers practically never retry */
+    struct alignas(CacheLineSize) SharedAdapterSlot
+    {
+        std::atomic<uint32_t> mSequence;
+        uint32_t mFlags;
+        /* Number of packets published into this slot since the adapter was plugged in */
+        uint64_t mPacketCount;
+        /* System tick at which the driver thread woke up for the read that produced this packet */
+        uint64_t mTick;
+        uint8_t mData[SharedPacketSize];
+    };
+
+    static_assert(sizeof(SharedAdapterSlot) == CacheLineSize);
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    struct alignas(CacheLineSize) SharedStateHeader
+    {
+        uint32_t mMagic;
+        uint32_t mVersion;
+        /* Number of entries in mSlots, and the size of each one. Readers should go by these rather than their own constants */
+        uint32_t mSlotCount;
+        uint32_t mSlotSize;
+        /* Frequency of the ticks in SharedAdapterSlot::mTick */
+        uint64_t mTickFrequency;
+    };
+
+    static_assert(sizeof(SharedStateHeader) == CacheLineSize);
+
+    /* The whole region, the slots directly follow the header */
+    template<size_t SlotCount>
+    struct SharedState
+    {
+        SharedStateHeader mHeader;
+        SharedAdapterSlot mSlots[SlotCount];
+    };
+}
@@ -0,0 +1,60 @@
+#include "signature_scan.hpp"
+#include <cstring>
+
+namespace usb::patch
+{
+    namespace
+    {
+        inline uint32_t LoadWord(const uint8_t* pCode)
+        {
+            uint32_t Word;
+            std::memcpy(&Word, pCode, sizeof(Word));
+            return Word;
+        }
+    }
+
+    size_t FindSignature(const uint8_t* pCode, size_t Size, uint32_t BaseOffset, const Signature& signature, uint32_t* pMatches, size_t MaxMatches)
+    {
+        const size_t NumWords = Size / sizeof(uint32_t);
+        if (signature.mNumWords == 0 || NumWords < signature.mNumWords)
+            return 0;
+
+        /* The first word is checked on its own before the rest, nearly every position gets rejected there */
+        const SignatureWord First = signature.mWords[0];
+        size_t NumMatches = 0;
+        for (size_t i = 0; i <= NumWords - signature.mNumWords; i++)
+        {
+            const uint8_t* pWindow = pCode + i * sizeof(uint32_t);
+            if ((LoadWord(pWindow) & First.mMask) != First.mValue)
+                continue;
+
+            bool IsMatch = true;
+            for (size_t word = 1; word < signature.mNumWords && IsMatch; word++)
+            {
+                IsMatch = (LoadWord(pWindow + word * sizeof(uint32_t)) & signature.mWords[word].mMask) == signature.mWords[word].mValue;
+            }
+
+            if (!IsMatch)
+                continue;
+
+            if (NumMatches < MaxMatches)
+            {
+                pMatches[NumMatches] = BaseOffset + static_cast<uint32_t>((i + signature.mTargetIndex) * sizeof(uint32_t));
+            }
+            NumMatches++;
+        }
+
+        return NumMatches;
+    }
+
+    size_t GetTrailingPadding(const uint8_t* pCode, size_t Size)
+    {
+        size_t NumWords = Size / sizeof(uint32_t);
+        size_t Padding = 0;
+        while (NumWords != 0 && LoadWord(pCode + --NumWords * sizeof(uint32_t)) == 0)
+        {
+            Padding += sizeof(uint32_t);
+        }
+        return Padding;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* Locates code in another process' .text by matching a run of instructions, each under a mask so that registers or */
+/* offsets that differ between builds can be ignored */
+/* This only depends on the standard library so that it can be run on host against dumped binaries (see tools/hook_locator) */
+namespace usb::patch
+{
+    struct SignatureWord
+    {
+        uint32_t mValue;
+        uint32_t mMask;
+    };
+
+    struct Signature
+    {
+        const SignatureWord* mWords;
+        size_t mNumWords;
+        /* Index of the instruction of interest within the signature, match offsets point at it */
+        size_t mTargetIndex;
+    };
+
+    /* Scans Size bytes of code starting at pCode, which sits at BaseOffset in .text */
+    /* Up to MaxMatches .text offsets of the target instruction get written to pMatches, the total number of matches is returned */
+    /* Code is scanned in 4 byte steps, a trailing partial instruction is ignored. When scanning in chunks, consecutive chunks */
+    /* have to overlap by (mNumWords - 1) instructions, no match is ever reported twice that way */
+    size_t FindSignature(const uint8_t* pCode, size_t Size, uint32_t BaseOffset, const Signature& signature, uint32_t* pMatches, size_t MaxMatches);
+
+    /* Number of zero bytes at the end of the Size bytes at pCode, in whole instructions */
+    /* .text segments get mapped rounded up to a page with the remainder zero filled, and zero isn't a valid instruction */
+    /* (udf #0), so a trailing run of zeroes is padding that no code runs through */
+    size_t GetTrailingPadding(const uint8_t* pCode, size_t Size);
+}
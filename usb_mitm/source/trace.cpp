@@ -0,0 +1,146 @@
+#include "trace.hpp"
+#include <atomic>
+#include <cstring>
+
+namespace usb::trace
+{
+    namespace
+    {
+        /* At 1000hz the driver thread records a few events per ms, so this keeps roughly the last half second of activity */
+        static constexpr size_t g_RecordsPerThread = 2048;
+        static_assert((g_RecordsPerThread & (g_RecordsPerThread - 1)) == 0, "Records per thread must be a power of two");
+
+        /* Single-producer ring of records. Only the owning thread writes to it, and the oldest records get overwritten */
+        struct ThreadBuffer
+        {
+            std::atomic<ams::os::ThreadType*> mOwner;
+            /* Number of records ever written, the newest record is at (mHead - 1) % g_RecordsPerThread */
+            std::atomic<u64> mHead;
+            Record mRecords[g_RecordsPerThread];
+        };
+
+        static ThreadBuffer g_Buffers[static_cast<size_t>(ThreadId::Count)];
+
+        /* Records get copied here before being written out, so a dump never holds up the threads being traced */
+        static Record g_DumpRecords[g_RecordsPerThread];
+
+        static constinit char g_DumpPath[] = "sd:/usb_mitm_trace.bin";
+
+        ThreadBuffer* GetCurrentBuffer()
+        {
+            ams::os::ThreadType* pThread = ams::os::GetCurrentThread();
+            for (ThreadBuffer& Buffer : g_Buffers)
+            {
+                if (Buffer.mOwner.load(std::memory_order_relaxed) == pThread)
+                    return &Buffer;
+            }
+            return nullptr;
+        }
+
+        void Push(EventId event, u8 adapter, u64 Tick, u32 DurationTicks, u32 arg0, u32 arg1, u32 arg2, u32 arg3)
+        {
+            ThreadBuffer* pBuffer = GetCurrentBuffer();
+            if (pBuffer == nullptr)
+                return;
+
+            const u64 Head = pBuffer->mHead.load(std::memory_order_relaxed);
+            pBuffer->mRecords[Head % g_RecordsPerThread] = (Record){
+                .mTick = Tick,
+                .mEvent = static_cast<u16>(event),
+                .mAdapter = adapter,
+                .mThread = static_cast<u8>(pBuffer - g_Buffers),
+                .mDurationTicks = DurationTicks,
+                .mArgs = { arg0, arg1, arg2, arg3 }
+            };
+            pBuffer->mHead.store(Head + 1, std::memory_order_release);
+        }
+    }
+
+    void Initialize()
+    {
+        for (ThreadBuffer& Buffer : g_Buffers)
+        {
+            Buffer.mOwner.store(nullptr, std::memory_order_relaxed);
+            Buffer.mHead.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void RegisterCurrentThread(ThreadId thread)
+    {
+        AMS_ABORT_UNLESS(thread < ThreadId::Count, "Invalid trace thread id");
+        g_Buffers[static_cast<size_t>(thread)].mOwner.store(ams::os::GetCurrentThread(), std::memory_order_relaxed);
+    }
+
+    void RecordEvent(EventId event, u8 adapter, u32 arg0, u32 arg1, u32 arg2, u32 arg3)
+    {
+        Push(event, adapter, ams::os::GetSystemTick().GetInt64Value(), 0, arg0, arg1, arg2, arg3);
+    }
+
+    void RecordSpan(EventId event, u8 adapter, u64 StartTick, u32 arg0, u32 arg1, u32 arg2, u32 arg3)
+    {
+        const u64 Duration = ams::os::GetSystemTick().GetInt64Value() - StartTick;
+        Push(event, adapter, StartTick, static_cast<u32>(std::min<u64>(Duration, UINT32_MAX)), arg0, arg1, arg2, arg3);
+    }
+
+    ams::Result Dump()
+    {
+        /* Start from a fresh file every time */
+        R_TRY_CATCH(ams::fs::DeleteFile(g_DumpPath))
+        {
+            R_CATCH(ams::fs::ResultPathNotFound) {}
+        }
+        R_END_TRY_CATCH;
+        R_TRY(ams::fs::CreateFile(g_DumpPath, 0));
+
+        ams::fs::FileHandle File;
+        R_TRY(ams::fs::OpenFile(std::addressof(File), g_DumpPath, ams::fs::OpenMode_All));
+        ON_SCOPE_EXIT { ams::fs::CloseFile(File); };
+
+        DumpHeader Header = {
+            .mVersion = DumpVersion,
+            .mRecordSize = sizeof(Record),
+            .mTickFrequency = static_cast<u64>(ams::os::GetSystemTickFrequency()),
+            .mRecordCount = 0,
+            .mLostCount = 0,
+        };
+        std::memcpy(Header.mMagic, DumpMagic, sizeof(Header.mMagic));
+
+        s64 Position = sizeof(DumpHeader);
+        for (ThreadBuffer& Buffer : g_Buffers)
+        {
+            /* The owner keeps recording while we copy, so any slot it could have written to in the meantime (including */
+            /* the one it may be halfway through) gets thrown away */
+            const u64 First = Buffer.mHead.load(std::memory_order_acquire);
+            std::memcpy(g_DumpRecords, Buffer.mRecords, sizeof(g_DumpRecords));
+            const u64 Last = Buffer.mHead.load(std::memory_order_acquire);
+
+            const u64 Oldest = std::max(
+                First > g_RecordsPerThread ? First - g_RecordsPerThread : 0,
+                Last + 1 > g_RecordsPerThread ? Last + 1 - g_RecordsPerThread : 0
+            );
+            if (Oldest >= First)
+            {
+                Header.mLostCount += static_cast<u32>(First);
+                continue;
+            }
+
+            const size_t Count = First - Oldest;
+            const size_t Start = Oldest % g_RecordsPerThread;
+            const size_t FirstChunk = std::min(Count, g_RecordsPerThread - Start);
+
+            R_TRY(ams::fs::WriteFile(File, Position, &g_DumpRecords[Start], FirstChunk * sizeof(Record), ams::fs::WriteOption::None));
+            Position += FirstChunk * sizeof(Record);
+            if (Count > FirstChunk)
+            {
+                R_TRY(ams::fs::WriteFile(File, Position, &g_DumpRecords[0], (Count - FirstChunk) * sizeof(Record), ams::fs::WriteOption::None));
+                Position += (Count - FirstChunk) * sizeof(Record);
+            }
+
+            Header.mRecordCount += static_cast<u32>(Count);
+            Header.mLostCount += static_cast<u32>(Oldest);
+        }
+
+        R_TRY(ams::fs::WriteFile(File, 0, &Header, sizeof(Header), ams::fs::WriteOption::Flush));
+        R_SUCCEED();
+    }
+}
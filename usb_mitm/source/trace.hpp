@@ -0,0 +1,42 @@
+#pragma once
+#include <stratosphere.hpp>
+#include "trace_format.hpp"
+
+/* Binary event trace, cheap enough to record from the packet path */
+/* Every traced thread writes into its own ring of fixed-size records, the rings get written to the SD card on request */
+namespace usb::trace
+{
+    /* Must be called once before any thread gets registered */
+    void Initialize();
+
+    /* Gives the calling thread a trace buffer. Events recorded from threads that never registered are ignored */
+    void RegisterCurrentThread(ThreadId thread);
+
+    /* Records an event at the current tick */
+    void RecordEvent(EventId event, u8 adapter, u32 arg0 = 0, u32 arg1 = 0, u32 arg2 = 0, u32 arg3 = 0);
+
+    /* Records an event that started at StartTick and ends now */
+    void RecordSpan(EventId event, u8 adapter, u64 StartTick, u32 arg0 = 0, u32 arg1 = 0, u32 arg2 = 0, u32 arg3 = 0);
+
+    /* Writes every buffered record to sd:/usb_mitm_trace.bin, see DumpHeader for the layout */
+    ams::Result Dump();
+
+    /* Records a span covering the lifetime of the object */
+    class ScopedSpan
+    {
+    private:
+        EventId mEvent;
+        u8 mAdapter;
+        u64 mStartTick;
+
+    public:
+        u32 mArgs[RecordArgCount];
+
+        ScopedSpan(EventId event, u8 adapter) : mEvent(event), mAdapter(adapter), mStartTick(ams::os::GetSystemTick().GetInt64Value()), mArgs() {}
+
+        ~ScopedSpan()
+        {
+            RecordSpan(mEvent, mAdapter, mStartTick, mArgs[0], mArgs[1], mArgs[2], mArgs[3]);
+        }
+    };
+}
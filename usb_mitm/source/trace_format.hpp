@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* On-disk format of the binary event trace */
+/* This only depends on the standard library so that the host-side decoder (tools/trace_decoder) can use it as is */
+namespace usb::trace
+{
+    /* Threads that get their own trace buffer */
+    enum class ThreadId : uint8_t
+    {
+        Driver = 0,
+        UsbHsMitm = 1,
+        UsbGc = 2,
+
+        Count
+    };
+
+    enum class EventId : uint16_t
+    {
+        None = 0,
+        /* Driver thread woke up. Args: [wait holder kind] */
+        DriverWake = 1,
+        /* Driver thread updated its wait list. Spans the update */
+        WaiterSync = 2,
+        /* Read completions drained from an adapter. Args: [reports drained, successful reads] */
+        ReadsDrained = 3,
+        /* Write put on the wire. Args: [size] */
+        WriteSubmitted = 4,
+        /* Write acknowledged by the adapter. Args: [result] */
+        WriteCompleted = 5,
+        /* HID fetched the latest packet. Args: [size] */
+        IpcReadPacket = 6,
+        /* HID handed us a packet to write. Args: [size] */
+        IpcWritePacket = 7,
+        /* Batched read request. Args: [urb count, urb size] */
+        IpcBatchRead = 8,
+        /* Control transfer requested on an interface. Args: [bmRequestType, bRequest, wValue] */
+        IpcCtrlXfer = 9,
+        /* Copy from a client buffer through the transfer window. Spans the copy. Args: [size] */
+        TransferRead = 10,
+        /* Copy to a client buffer through the transfer window. Spans the copy. Args: [size] */
+        TransferWrite = 11,
+        /* Batched write request. Args: [urb count, urb size] */
+        IpcBatchWrite = 12,
+
+        Count
+    };
+
+    /* Adapter id used by events that aren't tied to an adapter */
+    static constexpr uint8_t NoAdapter = 0xFF;
+
+    static constexpr size_t RecordArgCount = 4;
+
+    /* A single trace event */
+    struct Record
+    {
+        /* System tick at which the event happened (or started, for spans) */
+        uint64_t mTick;
+        uint16_t mEvent;
+        uint8_t mAdapter;
+        uint8_t mThread;
+        /* Length of the span in system ticks, 0 for instant events */
+        uint32_t mDurationTicks;
+        uint32_t mArgs[RecordArgCount];
+    };
+
+    static_assert(sizeof(Record) == 32);
+
+    static constexpr char DumpMagic[8] = { 'G', 'C', 'T', 'R', 'A', 'C', 'E', '\0' };
+    static constexpr uint32_t DumpVersion = 1;
+
+    /* A dump is this header followed by mRecordCount records, grouped by thread and oldest first within each thread */
+    struct DumpHeader
+    {
+        char mMagic[8];
+        uint32_t mVersion;
+        uint32_t mRecordSize;
+        uint64_t mTickFrequency;
+        uint32_t mRecordCount;
+        /* Records that had already been overwritten by newer ones when the dump was taken, summed over every thread */
+        uint32_t mLostCount;
+    };
+
+    static_assert(sizeof(DumpHeader) == 32);
+
+    constexpr const char* GetThreadName(uint8_t thread)
+    {
+        switch (static_cast<ThreadId>(thread))
+        {
+            case ThreadId::Driver: return "DriverThread";
+            case ThreadId::UsbHsMitm: return "UsbHsMitm";
+            case ThreadId::UsbGc: return "UsbGc";
+            default: return "Unknown";
+        }
+    }
+
+    constexpr const char* GetEventName(uint16_t event)
+    {
+        switch (static_cast<EventId>(event))
+        {
+            case EventId::DriverWake: return "DriverWake";
+            case EventId::WaiterSync: return "WaiterSync";
+            case EventId::ReadsDrained: return "ReadsDrained";
+            case EventId::WriteSubmitted: return "WriteSubmitted";
+            case EventId::WriteCompleted: return "WriteCompleted";
+            case EventId::IpcReadPacket: return "IpcReadPacket";
+            case EventId::IpcWritePacket: return "IpcWritePacket";
+            case EventId::IpcBatchRead: return "IpcBatchRead";
+            case EventId::IpcCtrlXfer: return "IpcCtrlXfer";
+            case EventId::TransferRead: return "TransferRead";
+            case EventId::TransferWrite: return "TransferWrite";
+            case EventId::IpcBatchWrite: return "IpcBatchWrite";
+            default: return "Unknown";
+        }
+    }
+}
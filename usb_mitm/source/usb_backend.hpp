@@ -0,0 +1,105 @@
+#pragma once
+#include <stratosphere.hpp>
+#include <switch.h>
+#include "latency_stats.hpp"
+
+/* USB host operations the driver thread performs on the endpoints of an adapter */
+/* The driver never talks to the endpoints directly, so which implementation backs them is picked at build time: */
+/*   - usb_backend_horizon.cpp forwards everything to usb:hs (the default) */
+/*   - usb_backend_simulated.cpp (USB_MITM_SIMULATED_ADAPTER) generates the packets of a 1000hz adapter in process, */
+/*     which makes it possible to measure the driver's wake up latency and throughput without an adapter's own timing in the way */
+/* Both backends hand out kernel events, so the driver waits on them the same way */
+namespace usb::gc::backend
+{
+    enum EndpointId : u32
+    {
+        Read = 0,
+        Write = 1,
+
+        Count = 2
+    };
+
+#ifdef USB_MITM_SIMULATED_ADAPTER
+    /* A transfer posted to a simulated endpoint, completed by the generator thread (reads) or right away (writes) */
+    struct SimulatedUrb
+    {
+        void* mpBuffer;
+        u32 mSize;
+        u64 mId;
+        u32 mXferId;
+    };
+
+    static constexpr size_t SimulatedMaxUrbs = 4;
+
+    struct SimulatedEndpoint
+    {
+        Event mCompletionEvent;
+        SimulatedUrb mPosted[SimulatedMaxUrbs];
+        u32 mNumPosted;
+        UsbHsXferReport mReports[SimulatedMaxUrbs];
+        /* Tick each report was completed at */
+        u64 mCompletionTicks[SimulatedMaxUrbs];
+        u32 mNumReports;
+    };
+
+    /* A packet written to a simulated adapter, kept so that host tests can see what went out on the wire */
+    struct SimulatedWrite
+    {
+        u8 mData[16];
+        u32 mSize;
+    };
+
+    static constexpr size_t SimulatedWriteLogLength = 64;
+
+    struct AdapterEndpoints
+    {
+        u32 mAdapterId;
+        u32 mNextXferId;
+        SimulatedEndpoint mEndpoints[EndpointId::Count];
+        /* Writes not taken yet, oldest first. Once full, the oldest ones get dropped */
+        SimulatedWrite mWrites[SimulatedWriteLogLength];
+        u32 mNumWrites;
+    };
+
+    /* What the generator produced, to hold the driver's own counters against */
+    struct SimulatedStats
+    {
+        /* Polls of every open adapter, and the ones that found no read queued */
+        u64 mPolls;
+        u64 mMissedPolls;
+        /* A read completing to the driver fetching its report, the part of the latency usb:hs doesn't let us see on hardware */
+        stats::LatencySummary mCompleteToFetch;
+    };
+
+    void GetSimulatedStats(SimulatedStats* pOut);
+
+    /* Moves the packets written to the adapter with the given id since the last call out to pWrites, oldest first */
+    u32 TakeSimulatedWrites(u32 AdapterId, SimulatedWrite* pWrites, u32 MaxWrites);
+#else
+    struct AdapterEndpoints
+    {
+        Service mSessions[EndpointId::Count];
+        Handle mCompletionEvents[EndpointId::Count];
+
+        /* These go unused aside for a sanity check while opening */
+        struct usb_endpoint_descriptor mDescriptors[EndpointId::Count];
+    };
+#endif
+
+    /* Must be called once before any adapter gets opened */
+    void Initialize();
+
+    /* Opens the read and write endpoints of an adapter interface acquired through usb:hs, with room for ReadUrbDepth reads in flight */
+    void OpenEndpoints(AdapterEndpoints* pEndpoints, u32 AdapterId, Service* pIfSession, const UsbHsInterface* pInterface, u16 ReadUrbDepth);
+
+    void CloseEndpoints(AdapterEndpoints* pEndpoints);
+
+    /* Event signaled when a transfer on the endpoint completes. It is not autocleared, the driver resets it before fetching the reports */
+    Handle GetCompletionEvent(AdapterEndpoints* pEndpoints, EndpointId endpoint);
+
+    /* Queues a transfer, XferId comes back as the id of its report */
+    void PostBuffer(AdapterEndpoints* pEndpoints, EndpointId endpoint, void* pBuffer, u32 Size, u64 XferId);
+
+    /* Fetches the reports of the transfers that completed since the last call, in completion order. Returns the number fetched */
+    u32 GetXferReports(AdapterEndpoints* pEndpoints, EndpointId endpoint, UsbHsXferReport* pReports, u32 MaxReports);
+}
@@ -0,0 +1,94 @@
+#ifndef USB_MITM_SIMULATED_ADAPTER
+#include "usb_backend.hpp"
+#include "usb_shim.h"
+
+namespace usb::gc::backend
+{
+    namespace
+    {
+        static const struct usb_endpoint_descriptor* FindEndpoint(const struct usb_endpoint_descriptor* pDescriptors)
+        {
+            for (size_t i = 0; i < 15; i++)
+            {
+                if (pDescriptors[i].bLength != 0)
+                    return &pDescriptors[i];
+            }
+            return nullptr;
+        }
+
+        static void OpenEndpoint(Service* pIfSession, Service* pOut, u16 MaxUrbCount, const struct usb_endpoint_descriptor* pEndpoint, struct usb_endpoint_descriptor* pDescriptor)
+        {
+            /* NOTE: We could hardcode the paramters here for these endpoints, but I'd rather showcase what exactly we're passing in like the libnx */
+            /* base implementation of these methods does */
+            R_ABORT_UNLESS(usbHsIfOpenUsbEpFwd(
+                pIfSession, pOut, MaxUrbCount,
+                (pEndpoint->bmAttributes & USB_TRANSFER_TYPE_MASK) + 1,
+                pEndpoint->bEndpointAddress & USB_ENDPOINT_ADDRESS_MASK,
+                (pEndpoint->bEndpointAddress & USB_ENDPOINT_IN) == 0 ? 0x1 : 0x2,
+                pEndpoint->wMaxPacketSize,
+                pDescriptor
+            ));
+
+            /* Done automatically by libnx, must be explicitly done here */
+            R_ABORT_UNLESS(usbHsEpPopulateRingFwd(pOut));
+        }
+    }
+
+    void Initialize()
+    {
+        /* Nothing to set up, everything goes straight to the usb:hs sessions */
+    }
+
+    void OpenEndpoints(AdapterEndpoints* pEndpoints, u32 AdapterId, Service* pIfSession, const UsbHsInterface* pInterface, u16 ReadUrbDepth)
+    {
+        const struct usb_endpoint_descriptor* pReadEndpoint = FindEndpoint(pInterface->inf.input_endpoint_descs);
+        AMS_ABORT_UNLESS(pReadEndpoint != nullptr, "ReadEndpoint not found");
+
+        const struct usb_endpoint_descriptor* pWriteEndpoint = FindEndpoint(pInterface->inf.output_endpoint_descs);
+        AMS_ABORT_UNLESS(pWriteEndpoint != nullptr, "WriteEndpoint not found");
+
+        OpenEndpoint(pIfSession, &pEndpoints->mSessions[EndpointId::Read], ReadUrbDepth, pReadEndpoint, &pEndpoints->mDescriptors[EndpointId::Read]);
+        OpenEndpoint(pIfSession, &pEndpoints->mSessions[EndpointId::Write], 1, pWriteEndpoint, &pEndpoints->mDescriptors[EndpointId::Write]);
+
+        /* Endpoints have been opened, let's get the transfer completion events for both of them */
+        R_ABORT_UNLESS(usbHsEpGetCompletionEventFwd(&pEndpoints->mSessions[EndpointId::Read], &pEndpoints->mCompletionEvents[EndpointId::Read]));
+        R_ABORT_UNLESS(usbHsEpGetCompletionEventFwd(&pEndpoints->mSessions[EndpointId::Write], &pEndpoints->mCompletionEvents[EndpointId::Write]));
+
+        /* Quick Sanity Check */
+        /* Originally, this also did a sanity check on the bInterval values, but since the */
+        /* code for that could be possible to disable in the future, I removed them*/
+        AMS_ABORT_UNLESS(pEndpoints->mDescriptors[EndpointId::Read].bEndpointAddress == 0x81);
+        AMS_ABORT_UNLESS(pEndpoints->mDescriptors[EndpointId::Write].bEndpointAddress == 0x2);
+    }
+
+    void CloseEndpoints(AdapterEndpoints* pEndpoints)
+    {
+        svcCloseHandle(pEndpoints->mCompletionEvents[EndpointId::Write]);
+        svcCloseHandle(pEndpoints->mCompletionEvents[EndpointId::Read]);
+
+        R_ABORT_UNLESS(usbHsEpCloseFwd(&pEndpoints->mSessions[EndpointId::Write]));
+        R_ABORT_UNLESS(usbHsEpCloseFwd(&pEndpoints->mSessions[EndpointId::Read]));
+
+        serviceClose(&pEndpoints->mSessions[EndpointId::Write]);
+        serviceClose(&pEndpoints->mSessions[EndpointId::Read]);
+    }
+
+    Handle GetCompletionEvent(AdapterEndpoints* pEndpoints, EndpointId endpoint)
+    {
+        return pEndpoints->mCompletionEvents[endpoint];
+    }
+
+    void PostBuffer(AdapterEndpoints* pEndpoints, EndpointId endpoint, void* pBuffer, u32 Size, u64 XferId)
+    {
+        u32 dummy;
+        R_ABORT_UNLESS(usbHsEpPostBufferAsyncFwd(&pEndpoints->mSessions[endpoint], pBuffer, Size, XferId, &dummy));
+    }
+
+    u32 GetXferReports(AdapterEndpoints* pEndpoints, EndpointId endpoint, UsbHsXferReport* pReports, u32 MaxReports)
+    {
+        u32 NumReports;
+        R_ABORT_UNLESS(usbHsEpGetXferReportFwd(&pEndpoints->mSessions[endpoint], pReports, MaxReports, &NumReports));
+        return NumReports;
+    }
+}
+#endif
@@ -0,0 +1,271 @@
+#ifdef USB_MITM_SIMULATED_ADAPTER
+#include "usb_backend.hpp"
+#include "packet_processing.hpp"
+#include "logger.hpp"
+#include <cstring>
+
+namespace usb::gc::backend
+{
+    using namespace ams::literals;
+    namespace
+    {
+        /* The generator stands in for the adapter's 1000hz interrupt endpoint */
+        static constexpr ams::TimeSpan g_PollInterval = ams::TimeSpan::FromMilliSeconds(1);
+
+        /* Same as the driver thread, so a completion gets picked up as soon as the generator yields */
+        static constexpr size_t g_GeneratorStackSize = 8_KB;
+        static constexpr s32 g_GeneratorPriority = -11;
+        alignas(ams::os::MemoryPageSize) static u8 g_GeneratorStack[g_GeneratorStackSize];
+        static ams::os::ThreadType g_GeneratorThread;
+        static ams::os::TimerEventType g_PollTimer;
+
+        static constexpr size_t g_MaxOpenAdapters = 8;
+
+        /* Guards every simulated endpoint, the generator and the driver thread both touch them */
+        /* Adapters get opened with the driver's interface mutex held, hence the higher lock level */
+        static ams::os::MutexType g_Mutex;
+        static AdapterEndpoints* g_OpenAdapters[g_MaxOpenAdapters];
+        static bool g_HasStarted;
+
+        static u64 g_Polls;
+        static u64 g_MissedPolls;
+        static stats::LatencyHistogram g_CompleteToFetch;
+
+        /* Report id of the adapter's input packet, and the status of a port with a regular controller plugged in */
+        static constexpr u8 g_InputReportId = 0x21;
+        static constexpr u8 g_PortStatusWired = 0x10;
+
+        /* Port 1 holds A for the first 100ms of every second while the main stick sweeps back and forth, */
+        /* which gives the latching and filtering code something to do. The other ports are empty */
+        static void FillPacket(u8* pPacket, u64 Frame)
+        {
+            std::memset(pPacket, 0, packet::PacketSize);
+            pPacket[0] = g_InputReportId;
+
+            u8* pPort = pPacket + packet::PortOffset(0);
+            pPort[packet::PortStatusOffset] = g_PortStatusWired;
+            pPort[packet::PortButtonsOffset] = (Frame % 1000) < 100 ? 0x01 : 0x00;
+
+            const u8 Sweep = static_cast<u8>(Frame & 0xFF);
+            pPort[packet::PortAnalogOffset + 0] = (Frame & 0x100) != 0 ? static_cast<u8>(0xFF - Sweep) : Sweep;
+            pPort[packet::PortAnalogOffset + 1] = 0x80;
+            pPort[packet::PortAnalogOffset + 2] = 0x80;
+            pPort[packet::PortAnalogOffset + 3] = 0x80;
+        }
+
+        /* Completes the oldest transfer posted to the endpoint. Must be called with g_Mutex held */
+        static void CompleteUrb(AdapterEndpoints* pEndpoints, EndpointId endpoint, u32 TransferredSize)
+        {
+            SimulatedEndpoint* pEndpoint = &pEndpoints->mEndpoints[endpoint];
+            AMS_ABORT_UNLESS(pEndpoint->mNumPosted > 0 && pEndpoint->mNumReports < SimulatedMaxUrbs);
+
+            const SimulatedUrb Urb = pEndpoint->mPosted[0];
+            std::memmove(&pEndpoint->mPosted[0], &pEndpoint->mPosted[1], (--pEndpoint->mNumPosted) * sizeof(SimulatedUrb));
+
+            pEndpoint->mReports[pEndpoint->mNumReports++] = (UsbHsXferReport){
+                .xferId = Urb.mXferId,
+                .res = 0,
+                .requestedSize = Urb.mSize,
+                .transferredSize = std::min(TransferredSize, Urb.mSize),
+                .id = Urb.mId
+            };
+            pEndpoint->mCompletionTicks[pEndpoint->mNumReports - 1] = ams::os::GetSystemTick().GetInt64Value();
+            R_ABORT_UNLESS(eventFire(&pEndpoint->mCompletionEvent));
+        }
+
+        static void GeneratorThreadFunction(void*)
+        {
+            u64 Frame = 0;
+            while (true)
+            {
+                ams::os::WaitTimerEvent(&g_PollTimer);
+                Frame++;
+
+                ams::os::LockMutex(&g_Mutex);
+                for (AdapterEndpoints* pEndpoints : g_OpenAdapters)
+                {
+                    if (pEndpoints == nullptr)
+                        continue;
+
+                    /* Like the real adapter, a poll with no read queued is simply missed */
+                    g_Polls++;
+                    if (pEndpoints->mEndpoints[EndpointId::Read].mNumPosted == 0)
+                    {
+                        g_MissedPolls++;
+                        continue;
+                    }
+
+                    FillPacket(static_cast<u8*>(pEndpoints->mEndpoints[EndpointId::Read].mPosted[0].mpBuffer), Frame);
+                    CompleteUrb(pEndpoints, EndpointId::Read, packet::PacketSize);
+                }
+                ams::os::UnlockMutex(&g_Mutex);
+            }
+        }
+
+        static void StartGenerator()
+        {
+            ams::os::InitializeTimerEvent(&g_PollTimer, ams::os::EventClearMode_AutoClear);
+
+            R_ABORT_UNLESS(ams::os::CreateThread(
+                &g_GeneratorThread,
+                GeneratorThreadFunction,
+                nullptr,
+                g_GeneratorStack,
+                g_GeneratorStackSize,
+                g_GeneratorPriority
+            ));
+
+            ams::os::SetThreadNamePointer(&g_GeneratorThread, "usb::gc::SimulatedAdapter");
+            ams::os::StartThread(&g_GeneratorThread);
+            ams::os::StartPeriodicTimerEvent(&g_PollTimer, g_PollInterval, g_PollInterval);
+        }
+    }
+
+    void Initialize()
+    {
+        ams::os::InitializeMutex(&g_Mutex, false, 2);
+    }
+
+    void OpenEndpoints(AdapterEndpoints* pEndpoints, u32 AdapterId, Service* pIfSession, const UsbHsInterface* pInterface, u16 ReadUrbDepth)
+    {
+        AMS_ABORT_UNLESS(ReadUrbDepth <= SimulatedMaxUrbs);
+
+        pEndpoints->mAdapterId = AdapterId;
+        pEndpoints->mNextXferId = 0;
+        for (SimulatedEndpoint& Endpoint : pEndpoints->mEndpoints)
+        {
+            R_ABORT_UNLESS(eventCreate(&Endpoint.mCompletionEvent, false));
+            Endpoint.mNumPosted = 0;
+            Endpoint.mNumReports = 0;
+        }
+        pEndpoints->mNumWrites = 0;
+
+        ams::os::LockMutex(&g_Mutex);
+        size_t i;
+        for (i = 0; i < g_MaxOpenAdapters; i++)
+        {
+            if (g_OpenAdapters[i] == nullptr)
+                break;
+        }
+        AMS_ABORT_UNLESS(i < g_MaxOpenAdapters, "Too many simulated adapters");
+        g_OpenAdapters[i] = pEndpoints;
+
+        if (!g_HasStarted)
+        {
+            StartGenerator();
+            g_HasStarted = true;
+        }
+        ams::os::UnlockMutex(&g_Mutex);
+
+        DEBUG("[Backend::Simulated] Adapter %u is now driven by the packet generator\n", AdapterId);
+    }
+
+    void CloseEndpoints(AdapterEndpoints* pEndpoints)
+    {
+        ams::os::LockMutex(&g_Mutex);
+        for (AdapterEndpoints*& pOpen : g_OpenAdapters)
+        {
+            if (pOpen == pEndpoints)
+                pOpen = nullptr;
+        }
+        ams::os::UnlockMutex(&g_Mutex);
+
+        for (SimulatedEndpoint& Endpoint : pEndpoints->mEndpoints)
+        {
+            eventClose(&Endpoint.mCompletionEvent);
+        }
+    }
+
+    Handle GetCompletionEvent(AdapterEndpoints* pEndpoints, EndpointId endpoint)
+    {
+        return pEndpoints->mEndpoints[endpoint].mCompletionEvent.revent;
+    }
+
+    void PostBuffer(AdapterEndpoints* pEndpoints, EndpointId endpoint, void* pBuffer, u32 Size, u64 XferId)
+    {
+        ams::os::LockMutex(&g_Mutex);
+
+        SimulatedEndpoint* pEndpoint = &pEndpoints->mEndpoints[endpoint];
+        AMS_ABORT_UNLESS(pEndpoint->mNumPosted < SimulatedMaxUrbs, "Too many transfers posted to a simulated endpoint");
+        pEndpoint->mPosted[pEndpoint->mNumPosted++] = (SimulatedUrb){
+            .mpBuffer = pBuffer,
+            .mSize = Size,
+            .mId = XferId,
+            .mXferId = pEndpoints->mNextXferId++
+        };
+
+        /* Nothing listens on the other end, so writes land immediately */
+        if (endpoint == EndpointId::Write)
+        {
+            if (pEndpoints->mNumWrites == SimulatedWriteLogLength)
+            {
+                std::memmove(&pEndpoints->mWrites[0], &pEndpoints->mWrites[1], (--pEndpoints->mNumWrites) * sizeof(SimulatedWrite));
+            }
+
+            SimulatedWrite* pWrite = &pEndpoints->mWrites[pEndpoints->mNumWrites++];
+            pWrite->mSize = std::min<u32>(Size, sizeof(pWrite->mData));
+            std::memcpy(pWrite->mData, pBuffer, pWrite->mSize);
+
+            CompleteUrb(pEndpoints, endpoint, Size);
+        }
+
+        ams::os::UnlockMutex(&g_Mutex);
+    }
+
+    u32 GetXferReports(AdapterEndpoints* pEndpoints, EndpointId endpoint, UsbHsXferReport* pReports, u32 MaxReports)
+    {
+        ams::os::LockMutex(&g_Mutex);
+
+        SimulatedEndpoint* pEndpoint = &pEndpoints->mEndpoints[endpoint];
+        const u32 NumReports = std::min(MaxReports, pEndpoint->mNumReports);
+        std::memcpy(pReports, pEndpoint->mReports, NumReports * sizeof(UsbHsXferReport));
+
+        if (endpoint == EndpointId::Read)
+        {
+            const u64 Now = ams::os::GetSystemTick().GetInt64Value();
+            for (u32 i = 0; i < NumReports; i++)
+            {
+                g_CompleteToFetch.Record(ams::os::ConvertToTimeSpan(ams::os::Tick(Now - pEndpoint->mCompletionTicks[i])).GetNanoSeconds());
+            }
+        }
+
+        pEndpoint->mNumReports -= NumReports;
+        std::memmove(&pEndpoint->mReports[0], &pEndpoint->mReports[NumReports], pEndpoint->mNumReports * sizeof(UsbHsXferReport));
+        std::memmove(&pEndpoint->mCompletionTicks[0], &pEndpoint->mCompletionTicks[NumReports], pEndpoint->mNumReports * sizeof(u64));
+
+        ams::os::UnlockMutex(&g_Mutex);
+        return NumReports;
+    }
+
+    void GetSimulatedStats(SimulatedStats* pOut)
+    {
+        ams::os::LockMutex(&g_Mutex);
+        pOut->mPolls = g_Polls;
+        pOut->mMissedPolls = g_MissedPolls;
+        ams::os::UnlockMutex(&g_Mutex);
+
+        g_CompleteToFetch.Summarize(&pOut->mCompleteToFetch);
+    }
+
+    u32 TakeSimulatedWrites(u32 AdapterId, SimulatedWrite* pWrites, u32 MaxWrites)
+    {
+        u32 NumWrites = 0;
+
+        ams::os::LockMutex(&g_Mutex);
+        for (AdapterEndpoints* pEndpoints : g_OpenAdapters)
+        {
+            if (pEndpoints == nullptr || pEndpoints->mAdapterId != AdapterId)
+                continue;
+
+            NumWrites = std::min(MaxWrites, pEndpoints->mNumWrites);
+            std::memcpy(pWrites, pEndpoints->mWrites, NumWrites * sizeof(SimulatedWrite));
+            pEndpoints->mNumWrites -= NumWrites;
+            std::memmove(&pEndpoints->mWrites[0], &pEndpoints->mWrites[NumWrites], pEndpoints->mNumWrites * sizeof(SimulatedWrite));
+            break;
+        }
+        ams::os::UnlockMutex(&g_Mutex);
+
+        return NumWrites;
+    }
+}
+#endif
@@ -1,5 +1,7 @@
 #include "usb_gc_service.hpp"
 #include "driver_thread.hpp"
+#include "trace.hpp"
+#include "capture.hpp"
 
 namespace ams::usb::gc
 {
@@ -44,6 +46,7 @@ namespace ams::usb::gc
 
         void UsbGcInterfaceThreadFunction(void*)
         {
+            ::usb::trace::RegisterCurrentThread(::usb::trace::ThreadId::UsbGc);
             R_ABORT_UNLESS(g_ServerManager.RegisterServer(0, ams::sm::ServiceName::Encode("usb:gc"), 1));
             g_ServerManager.LoopProcess();
             ams::os::YieldThread();
@@ -56,6 +59,157 @@ namespace ams::usb::gc
         R_SUCCEED();
     }
 
+    ams::Result UsbGcInterfaceImpl::GetAdapterPacketHistory(const ams::sf::OutBuffer& out, ams::sf::Out<u32> num_entries, ams::sf::Out<u64> next_cursor, u32 adapter, u64 cursor)
+    {
+        u64 NextCursor;
+        size_t Count = ::usb::gc::GetAdapterPacketHistoryForUsbGc(
+            adapter,
+            cursor,
+            reinterpret_cast<::usb::gc::AdapterPacketHistoryEntry*>(out.GetPointer()),
+            out.GetSize() / sizeof(::usb::gc::AdapterPacketHistoryEntry),
+            &NextCursor
+        );
+
+        num_entries.SetValue((u32)Count);
+        next_cursor.SetValue(NextCursor);
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::SetAdapterDeliveryMode(u32 adapter, u32 mode)
+    {
+        R_UNLESS(::usb::gc::SetAdapterDeliveryMode(adapter, static_cast<::usb::gc::DeliveryMode>(mode)), ams::svc::ResultInvalidEnumValue());
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::SetAdapterAnalogFilter(u32 adapter, u32 port, u32 mode)
+    {
+        R_UNLESS(mode <= UINT8_MAX, ams::svc::ResultInvalidEnumValue());
+        R_UNLESS(::usb::gc::SetAdapterAnalogFilter(adapter, port, static_cast<::usb::gc::packet::AnalogFilterMode>(mode)), ams::svc::ResultInvalidEnumValue());
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::GetAdapterDriverStats(const ams::sf::OutBuffer& out, u32 adapter)
+    {
+        ::usb::gc::AdapterDriverStats Stats;
+        R_UNLESS(::usb::gc::GetAdapterDriverStats(adapter, &Stats), ams::svc::ResultNotFound());
+
+        /* Clients built against an older, smaller version of the struct just get the fields they know about */
+        std::memcpy(out.GetPointer(), &Stats, std::min(out.GetSize(), sizeof(Stats)));
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::GetDriverStats(const ams::sf::OutBuffer& out)
+    {
+        ::usb::gc::DriverStats Stats;
+        ::usb::gc::GetDriverStats(&Stats);
+
+        std::memcpy(out.GetPointer(), &Stats, std::min(out.GetSize(), sizeof(Stats)));
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::GetAdapterLatencyStats(const ams::sf::OutBuffer& out, u32 adapter)
+    {
+        ::usb::gc::AdapterLatencyStats Stats;
+        R_UNLESS(::usb::gc::GetAdapterLatencyStats(adapter, &Stats), ams::svc::ResultNotFound());
+
+        std::memcpy(out.GetPointer(), &Stats, std::min(out.GetSize(), sizeof(Stats)));
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::ResetAdapterLatencyStats(u32 adapter)
+    {
+        R_UNLESS(::usb::gc::ResetAdapterLatencyStats(adapter), ams::svc::ResultNotFound());
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::GetAdapterPollingStats(const ams::sf::OutBuffer& out, u32 adapter)
+    {
+        ::usb::gc::AdapterPollingStats Stats;
+        R_UNLESS(::usb::gc::GetAdapterPollingStats(adapter, &Stats), ams::svc::ResultNotFound());
+
+        std::memcpy(out.GetPointer(), &Stats, std::min(out.GetSize(), sizeof(Stats)));
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::ResetAdapterPollingStats(u32 adapter)
+    {
+        R_UNLESS(::usb::gc::ResetAdapterPollingStats(adapter), ams::svc::ResultNotFound());
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::DumpTrace()
+    {
+        return ::usb::trace::Dump();
+    }
+
+    static_assert(::usb::gc::g_MaxSubscriptions <= 32, "Subscriptions are tracked per session in a 32-bit mask");
+
+    ams::Result UsbGcInterfaceImpl::SubscribeAdapterPackets(ams::sf::OutCopyHandle out_event, ams::sf::Out<u32> out_id, u32 adapter, u32 flags)
+    {
+        Handle Event;
+        u32 Id;
+        R_UNLESS(::usb::gc::SubscribeAdapterPackets(adapter, flags, &Event, &Id), ams::svc::ResultLimitReached());
+
+        mSubscriptions |= (1u << Id);
+        out_event.SetValue(Event, false);
+        out_id.SetValue(Id);
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::UnsubscribeAdapterPackets(u32 id)
+    {
+        /* Only let sessions drop their own subscriptions */
+        R_UNLESS(id < ::usb::gc::g_MaxSubscriptions && (mSubscriptions & (1u << id)) != 0, ams::svc::ResultNotFound());
+
+        ::usb::gc::UnsubscribeAdapterPackets(id);
+        mSubscriptions &= ~(1u << id);
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::GetSharedAdapterState(ams::sf::OutCopyHandle out_shmem, ams::sf::Out<u64> out_size)
+    {
+        size_t Size;
+        out_shmem.SetValue(::usb::gc::GetSharedAdapterState(&Size), false);
+        out_size.SetValue(Size);
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::StartCapture()
+    {
+        R_UNLESS(!::usb::capture::IsCapturing(), ams::svc::ResultInvalidState());
+        return ::usb::capture::Start();
+    }
+
+    ams::Result UsbGcInterfaceImpl::StopCapture(ams::sf::Out<u64> out_records, ams::sf::Out<u64> out_dropped)
+    {
+        R_UNLESS(::usb::capture::IsCapturing(), ams::svc::ResultInvalidState());
+
+        u64 RecordCount, DroppedCount;
+        ::usb::capture::Stop(&RecordCount, &DroppedCount);
+        out_records.SetValue(RecordCount);
+        out_dropped.SetValue(DroppedCount);
+        R_SUCCEED();
+    }
+
+    ams::Result UsbGcInterfaceImpl::GetAdapterControllerStates(const ams::sf::OutBuffer& out, ams::sf::Out<u32> num_adapters)
+    {
+        num_adapters.SetValue(::usb::gc::GetAdapterControllerStatesForUsbGc(
+            reinterpret_cast<::usb::gc::packet::ControllerState*>(out.GetPointer()),
+            out.GetSize() / sizeof(::usb::gc::packet::ControllerState)
+        ));
+        R_SUCCEED();
+    }
+
+    UsbGcInterfaceImpl::~UsbGcInterfaceImpl()
+    {
+        /* Don't leave events behind for clients that went away without unsubscribing */
+        for (u32 id = 0; id < ::usb::gc::g_MaxSubscriptions; id++)
+        {
+            if ((mSubscriptions & (1u << id)) != 0)
+                ::usb::gc::UnsubscribeAdapterPackets(id);
+        }
+    }
+
     void Launch()
     {
         R_ABORT_UNLESS(ams::os::CreateThread(
@@ -2,7 +2,23 @@
 #include <stratosphere.hpp>
 
 #define USB_GC_INTERFACE_INFO(C, H) \
-    AMS_SF_METHOD_INFO(C, H, 0, ams::Result, GetAdapterPacketState, (const ::ams::sf::OutBuffer &out, ::ams::sf::Out<u32> num_adapters), (out, num_adapters))
+    AMS_SF_METHOD_INFO(C, H, 0, ams::Result, GetAdapterPacketState, (const ::ams::sf::OutBuffer &out, ::ams::sf::Out<u32> num_adapters), (out, num_adapters)) \
+    AMS_SF_METHOD_INFO(C, H, 1, ams::Result, GetAdapterPacketHistory, (const ::ams::sf::OutBuffer &out, ::ams::sf::Out<u32> num_entries, ::ams::sf::Out<u64> next_cursor, u32 adapter, u64 cursor), (out, num_entries, next_cursor, adapter, cursor)) \
+    AMS_SF_METHOD_INFO(C, H, 2, ams::Result, SetAdapterDeliveryMode, (u32 adapter, u32 mode), (adapter, mode)) \
+    AMS_SF_METHOD_INFO(C, H, 3, ams::Result, SetAdapterAnalogFilter, (u32 adapter, u32 port, u32 mode), (adapter, port, mode)) \
+    AMS_SF_METHOD_INFO(C, H, 4, ams::Result, GetAdapterDriverStats, (const ::ams::sf::OutBuffer &out, u32 adapter), (out, adapter)) \
+    AMS_SF_METHOD_INFO(C, H, 5, ams::Result, GetDriverStats, (const ::ams::sf::OutBuffer &out), (out)) \
+    AMS_SF_METHOD_INFO(C, H, 6, ams::Result, GetAdapterLatencyStats, (const ::ams::sf::OutBuffer &out, u32 adapter), (out, adapter)) \
+    AMS_SF_METHOD_INFO(C, H, 7, ams::Result, ResetAdapterLatencyStats, (u32 adapter), (adapter)) \
+    AMS_SF_METHOD_INFO(C, H, 8, ams::Result, GetAdapterPollingStats, (const ::ams::sf::OutBuffer &out, u32 adapter), (out, adapter)) \
+    AMS_SF_METHOD_INFO(C, H, 9, ams::Result, ResetAdapterPollingStats, (u32 adapter), (adapter)) \
+    AMS_SF_METHOD_INFO(C, H, 10, ams::Result, DumpTrace, (), ()) \
+    AMS_SF_METHOD_INFO(C, H, 11, ams::Result, SubscribeAdapterPackets, (::ams::sf::OutCopyHandle out_event, ::ams::sf::Out<u32> out_id, u32 adapter, u32 flags), (out_event, out_id, adapter, flags)) \
+    AMS_SF_METHOD_INFO(C, H, 12, ams::Result, UnsubscribeAdapterPackets, (u32 id), (id)) \
+    AMS_SF_METHOD_INFO(C, H, 13, ams::Result, GetSharedAdapterState, (::ams::sf::OutCopyHandle out_shmem, ::ams::sf::Out<u64> out_size), (out_shmem, out_size)) \
+    AMS_SF_METHOD_INFO(C, H, 14, ams::Result, StartCapture, (), ()) \
+    AMS_SF_METHOD_INFO(C, H, 15, ams::Result, StopCapture, (::ams::sf::Out<u64> out_records, ::ams::sf::Out<u64> out_dropped), (out_records, out_dropped)) \
+    AMS_SF_METHOD_INFO(C, H, 16, ams::Result, GetAdapterControllerStates, (const ::ams::sf::OutBuffer &out, ::ams::sf::Out<u32> num_adapters), (out, num_adapters))
 
 AMS_SF_DEFINE_INTERFACE(ams::usb::gc, IUsbGcInterface, USB_GC_INTERFACE_INFO, 0xC79F8BC)
 
@@ -10,8 +26,31 @@ namespace ams::usb::gc
 {
     class UsbGcInterfaceImpl 
     {
+    private:
+        /* Subscriptions created through this session, one bit per subscription id */
+        u32 mSubscriptions;
+
     public:
+        UsbGcInterfaceImpl() : mSubscriptions(0) {}
+        ~UsbGcInterfaceImpl();
+
         ams::Result GetAdapterPacketState(const ams::sf::OutBuffer& out, ams::sf::Out<u32> num_adapters);
+        ams::Result GetAdapterPacketHistory(const ams::sf::OutBuffer& out, ams::sf::Out<u32> num_entries, ams::sf::Out<u64> next_cursor, u32 adapter, u64 cursor);
+        ams::Result SetAdapterDeliveryMode(u32 adapter, u32 mode);
+        ams::Result SetAdapterAnalogFilter(u32 adapter, u32 port, u32 mode);
+        ams::Result GetAdapterDriverStats(const ams::sf::OutBuffer& out, u32 adapter);
+        ams::Result GetDriverStats(const ams::sf::OutBuffer& out);
+        ams::Result GetAdapterLatencyStats(const ams::sf::OutBuffer& out, u32 adapter);
+        ams::Result ResetAdapterLatencyStats(u32 adapter);
+        ams::Result GetAdapterPollingStats(const ams::sf::OutBuffer& out, u32 adapter);
+        ams::Result ResetAdapterPollingStats(u32 adapter);
+        ams::Result DumpTrace();
+        ams::Result SubscribeAdapterPackets(ams::sf::OutCopyHandle out_event, ams::sf::Out<u32> out_id, u32 adapter, u32 flags);
+        ams::Result UnsubscribeAdapterPackets(u32 id);
+        ams::Result GetSharedAdapterState(ams::sf::OutCopyHandle out_shmem, ams::sf::Out<u64> out_size);
+        ams::Result StartCapture();
+        ams::Result StopCapture(ams::sf::Out<u64> out_records, ams::sf::Out<u64> out_dropped);
+        ams::Result GetAdapterControllerStates(const ams::sf::OutBuffer& out, ams::sf::Out<u32> num_adapters);
     };
 
     static_assert(IsIUsbGcInterface<UsbGcInterfaceImpl>);
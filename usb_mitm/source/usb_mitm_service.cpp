@@ -1,6 +1,8 @@
 #include "usb_mitm_service.hpp"
 #include "logger.hpp"
 #include "usb_shim.h"
+#include "device_table.hpp"
+#include "interface_cache.hpp"
 
 #define STUB_LOG() ::usb::util::Log("%s (stubbed)\n", __func__)
 #define R_FUNCTION_LOG(res) ::usb::util::Log("%s = %x\n", __func__, res.GetValue())
@@ -27,6 +29,18 @@ namespace ams::mitm::usb
         STUB_LOG();
     }
 
+    void UsbMitmEpSession::QueueReport(const UsbHsXferReport& report)
+    {
+        /* The client is expected to fetch reports as transfers complete, if it doesn't we drop the oldest one */
+        if (mNumReports == ::usb::gc::g_MaxBatchUrbs)
+        {
+            std::memmove(&mReports[0], &mReports[1], sizeof(UsbHsXferReport) * (mNumReports - 1));
+            mNumReports--;
+        }
+
+        mReports[mNumReports++] = report;
+    }
+
     Result UsbMitmEpSession::ReOpen()
     {
         STUB_LOG();
@@ -53,41 +67,69 @@ namespace ams::mitm::usb
 
     Result UsbMitmEpSession::PostBufferAsync(sf::Out<u32> xferId, u32 size, u64 buffer, u64 id)
     {
-        AMS_UNUSED(id);
-
-        xferId.SetValue(0);
+        UsbHsXferReport Report;
         if (this->mIsWriteEndpoint) 
         {
-            ::usb::gc::WritePacket(mIntfId, buffer, size, &mReport);
+            R_UNLESS(::usb::gc::WritePacket(mIntfId, buffer, size, &Report), ams::svc::ResultInvalidSize());
         }
         else
         {
-            ::usb::gc::ReadPacket(mIntfId, buffer, size, &mReport);
+            ::usb::gc::ReadPacket(mIntfId, buffer, size, &Report);
         }
 
+        /* Report the transfer back under the ids the client knows it by */
+        Report.xferId = mNextXferId++;
+        Report.id = id;
+        QueueReport(Report);
+
+        xferId.SetValue(Report.xferId);
         R_SUCCEED();
     }
 
     Result UsbMitmEpSession::GetXferReport(const sf::OutAutoSelectBuffer &out, sf::Out<u32> count, u32 max)
     {
-        if (max == 0)
+        const u32 Count = std::min<u32>({ max, mNumReports, static_cast<u32>(out.GetSize() / sizeof(UsbHsXferReport)) });
+
+        std::memcpy(out.GetPointer(), mReports, sizeof(UsbHsXferReport) * Count);
+        std::memmove(&mReports[0], &mReports[Count], sizeof(UsbHsXferReport) * (mNumReports - Count));
+        mNumReports -= Count;
+
+        count.SetValue(Count);
+        R_SUCCEED();
+    }
+
+    Result UsbMitmEpSession::BatchBufferAsync(sf::Out<u32> xferId, u32 urbCount, u32 unk1, u32 unk2, u64 buffer, u64 id)
+    {
+        /* NOTE: unk1 is treated as the size of each URB in the batch, with the URBs laid out back to back in the buffer */
+        /* That is a guess, so the driver checks it against the endpoint's limits and the client's memory and we refuse the */
+        /* batch if it doesn't hold up. There is no usb:hs endpoint behind this session that the request could go to instead */
+        /* unk2 has no meaning to us, since our transfers complete immediately */
+        AMS_UNUSED(unk2);
+        DEBUG("UsbMitmEpSession[%u]::BatchBufferAsync(%x, %x, %x, %llx, %llx)\n", mIntfId, urbCount, unk1, unk2, buffer, id);
+
+        const u32 UrbSize = unk1;
+        UsbHsXferReport Reports[::usb::gc::g_MaxBatchUrbs];
+
+        if (this->mIsWriteEndpoint)
         {
-            count.SetValue(0);
+            R_UNLESS(::usb::gc::WritePacketBatch(mIntfId, mLimits, buffer, urbCount, UrbSize, Reports), ams::svc::ResultInvalidSize());
         }
         else
         {
-            *reinterpret_cast<UsbHsXferReport*>(out.GetPointer()) = mReport;
+            R_UNLESS(::usb::gc::ReadPacketBatch(mIntfId, mLimits, buffer, urbCount, UrbSize, &mHistoryCursor, Reports), ams::svc::ResultInvalidSize());
         }
 
-        AMS_UNUSED(out, max);
-        count.SetValue(1);
-        R_SUCCEED();
-    }
+        /* Every URB of the batch shares the transfer id that we hand back */
+        const u32 Id = mNextXferId++;
+        for (u32 i = 0; i < urbCount; i++)
+        {
+            Reports[i].xferId = Id;
+            Reports[i].id = id;
+            QueueReport(Reports[i]);
+        }
 
-    Result UsbMitmEpSession::BatchBufferAsync(sf::Out<u32> xferId, u32 urbCount, u32 unk1, u32 unk2, u64 buffer, u64 id)
-    {
-        AMS_UNUSED(xferId, urbCount, unk1, unk2, buffer, id);
-        UNEXPECTED_CALL();
+        xferId.SetValue(Id);
+        R_SUCCEED();
     }
 
     Result UsbMitmEpSession::CreateSmmuSpace(u32 size, u64 buffer)
@@ -180,7 +222,7 @@ namespace ams::mitm::usb
     Result UsbMitmIfSession::OpenUsbEp(sf::Out<sf::SharedPointer<::ams::usb::IClientEpSession>> out_session, sf::Out<usb_endpoint_descriptor> out_desc, u16 maxUrbCount, u32 epType, u32 epNumber, u32 epDirection, u32 maxXferSize)
     {
         DEBUG("UsbMitmIfSession[%u]::OpenUsb(%x, %x, %x, %x, %x):\n", mProxy.mId, maxUrbCount, epType, epNumber, epDirection, maxXferSize);
-        AMS_UNUSED(out_desc, maxUrbCount, epType, epNumber, epDirection, maxXferSize);
+        AMS_UNUSED(out_desc, epType, epNumber);
         bool IsWriteEndpoint = epDirection == 1;
         if (IsWriteEndpoint)
         {
@@ -193,7 +235,8 @@ namespace ams::mitm::usb
 
         out_session.SetValue(sf::ObjectFactory<sf::ExpHeapAllocator::Policy>::CreateSharedEmplaced<ams::usb::IClientEpSession, UsbMitmEpSession>(
             std::addressof(g_SfAllocator),
-            mClientProcess, mProxy.mId, IsWriteEndpoint ? mProxy.mWritePostBufferCompletionEvent : mProxy.mReadPostBufferCompletionEvent, IsWriteEndpoint
+            mClientProcess, mProxy.mId, IsWriteEndpoint ? mProxy.mWritePostBufferCompletionEvent : mProxy.mReadPostBufferCompletionEvent, IsWriteEndpoint,
+            (::usb::gc::EndpointLimits){ .mMaxUrbCount = maxUrbCount, .mMaxXferSize = maxXferSize }
         ));
         R_SUCCEED();
     }
@@ -203,22 +246,21 @@ namespace ams::mitm::usb
 {
     namespace
     {
-        constexpr uint16_t GameCubeAdapterVendor = 0x057E;
-        constexpr uint16_t GameCubeAdapterProduct = 0x0337;
-
-        const UsbHsInterfaceFilter GameCubeFilter = {
-            .Flags = 0x03,
-            .idVendor = GameCubeAdapterVendor,
-            .idProduct = GameCubeAdapterProduct,
-            .bcdDevice_Min = 0,
-            .bcdDevice_Max = 0,
-            .bDeviceClass = 0,
-            .bDeviceSubClass = 0,
-            .bDeviceProtocol = 0,
-            .bInterfaceClass = 0x03,
-            .bInterfaceSubClass = 0,
-            .bInterfaceProtocol = 0,
-        };
+        /* The driver thread assumes the packet sizes listed in the table, make sure the endpoints can actually carry them */
+        bool HasExpectedEndpoints(const ::usb::devices::DeviceEntry& Device, const UsbHsInterface& Interface)
+        {
+            const auto FirstMaxPacketSize = [](const struct usb_endpoint_descriptor* pDescriptors) -> u16 {
+                for (size_t i = 0; i < 15; i++)
+                {
+                    if (pDescriptors[i].bLength != 0)
+                        return pDescriptors[i].wMaxPacketSize;
+                }
+                return 0;
+            };
+
+            return FirstMaxPacketSize(Interface.inf.input_endpoint_descs) >= Device.mInputPacketSize
+                && FirstMaxPacketSize(Interface.inf.output_endpoint_descs) >= Device.mOutputPacketSize;
+        }
     }
 
     UsbMitmService::UsbMitmService(std::shared_ptr<::Service> &&s, const sm::MitmProcessInfo &c)
@@ -239,36 +281,18 @@ namespace ams::mitm::usb
     Result UsbMitmService::AcquireUsbIf(const sf::OutMapAliasBuffer &out1, const sf::OutMapAliasBuffer &out2, sf::Out<sf::SharedPointer<::ams::usb::IClientIfSession>> out_session, u32 interfaceId)
     {
         DEBUG("UsbMitmService::AcquireUsbIf()\n");
-        UsbHsInterface QueryInterfaces[4];
-
-        s32 NumOut;
+        UsbHsInterface Interface;
 
-        Result res = usbHsQueryAvailableInterfacesFwd(
-            m_forward_service.get(),
-            &GameCubeFilter,
-            QueryInterfaces,
-            4,
-            &NumOut
-        );
-
-        if (AMS_UNLIKELY(R_FAILED(res)))
+        const ::usb::devices::DeviceEntry* pDevice = interface_cache::Find(interfaceId, &Interface);
+        if (pDevice == nullptr)
         {
-            DEBUG("\tFailed to acquire available interfaces to compare GameCube adapter to, forwarding request to usb:hs\n");
+            DEBUG("\tClient did not attempt to acquire GameCube Adapter, forwarding request to usb:hs service\n");
             return sm::mitm::ResultShouldForwardToSession();
         }
 
-        bool IsAcquiringGameCubeAdapter = false;
-        s32 i = 0;
-        for (; i < NumOut; i++) {
-            if (QueryInterfaces[i].inf.ID == (s32)interfaceId) {
-                IsAcquiringGameCubeAdapter = true;
-                break;
-            }
-        }
-
-        if (!IsAcquiringGameCubeAdapter)
+        if (!HasExpectedEndpoints(*pDevice, Interface))
         {
-            DEBUG("\tClient did not attempt to acquire GameCube Adapter, forwarding request to usb:hs service\n");
+            DEBUG("\tEndpoints of %04x:%04x are too small for the packet sizes in the device table, forwarding request to usb:hs service\n", pDevice->mVendorId, pDevice->mProductId);
             return sm::mitm::ResultShouldForwardToSession();
         }
 
@@ -276,7 +300,7 @@ namespace ams::mitm::usb
 
         /* We need to trick the process into thinking that we are the session driver for a very brief moment */
         Service IfSession;
-        res = usbHsAcquireUsbIfFwd(
+        Result res = usbHsAcquireUsbIfFwd(
             &g_ProxyUsbService, &IfSession,
             out1.GetPointer(), out1.GetSize(),
             out2.GetPointer(), out2.GetSize(),
@@ -286,7 +310,13 @@ namespace ams::mitm::usb
         if (R_SUCCEEDED(res))
         {
             DEBUG("\tSuccessfully acquired the GameCube Adapter via usb:hs:a service, sending device to driver thread\n");
-            ::usb::gc::ProxyInterface proxy = ::usb::gc::OpenInterface(mClientProcess, IfSession, &QueryInterfaces[i]);
+            ::usb::gc::ProxyInterface proxy;
+            if (!::usb::gc::OpenInterface(mClientProcess, IfSession, &Interface, &proxy))
+            {
+                DEBUG("\tNo adapter slot available, releasing the GameCube Adapter and forwarding to usb:hs session\n");
+                serviceClose(&IfSession);
+                return sm::mitm::ResultShouldForwardToSession();
+            }
             out_session.SetValue(sf::ObjectFactory<sf::ExpHeapAllocator::Policy>::CreateSharedEmplaced<ams::usb::IClientIfSession, UsbMitmIfSession>(std::addressof(g_SfAllocator), mClientProcess, proxy));
             R_SUCCEED();
         }
@@ -321,5 +351,8 @@ namespace ams::mitm::usb
         g_SfAllocator.Attach(g_HeapHandle);
 
         DEBUG("\tCreated heap for service objects\n");
+
+        interface_cache::Initialize(&g_ProxyUsbService, g_HeapHandle);
+        DEBUG("\tStarted the interface cache\n");
     }
 }
\ No newline at end of file
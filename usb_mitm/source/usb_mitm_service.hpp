@@ -43,12 +43,21 @@ namespace ams::mitm::usb
     private: 
         ams::os::NativeHandle mClientProcess;
         ::usb::gc::InterfaceId mIntfId;
-        UsbHsXferReport mReport;
+        /* Reports of finished transfers that the client hasn't fetched through GetXferReport yet, oldest first */
+        UsbHsXferReport mReports[::usb::gc::g_MaxBatchUrbs];
+        u32 mNumReports;
+        u32 mNextXferId;
+        /* Last packet history sample handed out through BatchBufferAsync */
+        u64 mHistoryCursor;
         Handle mCompletionEvent;
         bool mIsWriteEndpoint;
+        /* What the client opened the endpoint with, batches are checked against it */
+        ::usb::gc::EndpointLimits mLimits;
+
+        void QueueReport(const UsbHsXferReport& report);
     public:
-        UsbMitmEpSession(ams::os::NativeHandle client, ::usb::gc::InterfaceId id, Handle completion, bool is_write)
-            : mClientProcess(client), mIntfId(id), mCompletionEvent(completion), mIsWriteEndpoint(is_write)
+        UsbMitmEpSession(ams::os::NativeHandle client, ::usb::gc::InterfaceId id, Handle completion, bool is_write, ::usb::gc::EndpointLimits limits)
+            : mClientProcess(client), mIntfId(id), mNumReports(0), mNextXferId(0), mHistoryCursor(0), mCompletionEvent(completion), mIsWriteEndpoint(is_write), mLimits(limits)
         {}
 
         ~UsbMitmEpSession();
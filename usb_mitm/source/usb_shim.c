@@ -227,6 +227,11 @@ Result usbHsQueryAvailableInterfacesFwd(Service *s, const UsbHsInterfaceFilter *
     return rc;
 }
 
+Result usbHsGetInterfaceStateChangeEventFwd(Service *s, Handle* handle)
+{
+    return _usbHsGetHandle(s, handle, 6);
+}
+
 Result usbHsAcquireUsbIfFwd(Service *s, Service* outService, void* out1, size_t count1, void* out2, size_t count2, u32 interfaceId) {
     return serviceDispatchIn(s, 7, interfaceId,
             .buffer_attrs = {SfBufferAttr_HipcMapAlias | SfBufferAttr_Out, SfBufferAttr_HipcMapAlias | SfBufferAttr_Out},
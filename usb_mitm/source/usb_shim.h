@@ -36,6 +36,7 @@ extern "C"
     /* USB Service API */
     Result usbHsQueryAllInterfacesFwd(Service *s, const UsbHsInterfaceFilter *filter, UsbHsInterface *out, size_t count, s32 *total_out);
     Result usbHsQueryAvailableInterfacesFwd(Service *s, const UsbHsInterfaceFilter *filter, UsbHsInterface *out, size_t count, s32 *total_out);
+    Result usbHsGetInterfaceStateChangeEventFwd(Service *s, Handle* handle);
     Result usbHsAcquireUsbIfFwd(Service *s, Service* outService, void* out1, size_t count1, void* out2, size_t count2, u32 interfaceId);
 
 #ifdef __cplusplus
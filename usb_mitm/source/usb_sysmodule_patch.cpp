@@ -1,12 +1,10 @@
 #include <stratosphere.hpp>
 #include "logger.hpp"
+#include "device_table.hpp"
+#include "interval_patch.hpp"
+#include "signature_scan.hpp"
 #include "usb_sysmodule_patch.hpp"
-
-extern "C" {
-    /* The UsbServicePatch subroutine is defined in the gamecube_patch.s file */
-    void UsbServicePatchBegin();
-    void UsbServicePatchEnd();
-}
+#include <cstring>
 
 namespace ams::mitm::usb::sysmodule_patch
 {
@@ -14,18 +12,75 @@ namespace ams::mitm::usb::sysmodule_patch
     {
         static constexpr ams::ncm::ProgramId g_UsbProgramId = ams::ncm::SystemProgramId::Usb;
 
-        /* NOTE: The below values are unused in C++ code, they are hardcoded into the assembly patch */
-        /* These might be useful in future versions where we generate the assembly patch(es) at runtime */
-        static constexpr uintptr_t PatchUsbEndpointDescriptor_offset = 0x3EA04;
+        static constexpr const ::usb::patch::HookSite& g_HookSite = ::usb::patch::g_EndpointDescriptorHook;
+
+        static_assert(::usb::devices::MaxDevices <= ::usb::patch::MaxPatchDevices);
+
+        /* The code the hook branches to, generated from the device table */
+        static constinit ::usb::patch::PatchAssembler g_Patch;
+
+        void BuildPatch()
+        {
+            ::usb::patch::PatchDevice Devices[::usb::patch::MaxPatchDevices];
+            size_t NumDevices = 0;
+            for (size_t i = 0; i < ::usb::devices::GetDeviceCount(); i++)
+            {
+                const ::usb::devices::DeviceEntry& Device = ::usb::devices::GetDevice(i);
+                if (Device.mTargetInterval == 0)
+                    continue;
+
+                Devices[NumDevices++] = (::usb::patch::PatchDevice){
+                    .mVendorId = Device.mVendorId,
+                    .mProductId = Device.mProductId,
+                    .mInterval = Device.mTargetInterval
+                };
+                ::usb::util::Log("Forcing bInterval %u on %04x:%04x\n", Device.mTargetInterval, Device.mVendorId, Device.mProductId);
+            }
+
+            AMS_ABORT_UNLESS(::usb::patch::GeneratePatch(g_Patch, g_HookSite, Devices, NumDevices), "Failed to generate the usb sysmodule patch");
+        }
+
+        /* Holds the end of .text while looking for the code cave, and whatever gets read back after a verified write */
+        alignas(uint32_t) static uint8_t g_ScanBuffer[16_KB];
+
+        /* Zeroes left between the last instruction of .text and the patch, so that nothing that runs off the end of the real */
+        /* code (or disassembles it) mistakes the patch for part of it */
+        static constexpr size_t CaveGuardSize = 16;
+        static constexpr size_t CaveAlignment = 16;
+        static_assert(::usb::patch::MaxPatchInstructions * sizeof(uint32_t) + CaveGuardSize + CaveAlignment <= sizeof(g_ScanBuffer));
+
+        /* Finds room for the patch in the zero padding at the end of .text. The space needed is that of the largest possible */
+        /* patch, so the patch can grow with the device table without the cave moving */
+        /* Returns false if there isn't enough padding, the patch never goes over live code */
+        bool FindCodeCave(ams::os::NativeHandle hDebugProcess, const ams::svc::MemoryInfo& Text, uint32_t* pOffset)
+        {
+            const size_t CaveSize = ::usb::patch::MaxPatchInstructions * sizeof(uint32_t);
+            const size_t TailSize = std::min(sizeof(g_ScanBuffer), static_cast<size_t>(Text.size));
+            R_ABORT_UNLESS(ams::svc::ReadDebugProcessMemory(reinterpret_cast<uintptr_t>(g_ScanBuffer), hDebugProcess, Text.base_address + Text.size - TailSize, TailSize));
+
+            const size_t Padding = ::usb::patch::GetTrailingPadding(g_ScanBuffer, TailSize);
+            const size_t PaddingStart = Text.size - Padding;
+            const size_t CaveOffset = ams::util::AlignUp(PaddingStart + CaveGuardSize, CaveAlignment);
+            if (Padding == 0 || CaveOffset + CaveSize > Text.size)
+            {
+                ::usb::util::Log("Only %zx bytes of padding at the end of USB .text, no room for the patch\n", Padding);
+                return false;
+            }
+
+            ::usb::util::Log("Placing the patch at %zx, in %zx bytes of padding at the end of USB .text\n", CaveOffset, Padding);
+            *pOffset = static_cast<uint32_t>(CaveOffset);
+            return true;
+        }
 
-        static constexpr uint16_t VendorId_GameCubeAdapter = 0x057E;
-        static constexpr uint16_t ProductId_GameCubeAdapter = 0x0337;
-        static constexpr uint8_t  PatchedInterval = 1;
+        /* Writes to the debugged process and reads the data back to make sure it landed */
+        bool WriteVerified(ams::os::NativeHandle hDebugProcess, uintptr_t Address, const void* pData, size_t Size)
+        {
+            AMS_ABORT_UNLESS(Size <= sizeof(g_ScanBuffer), "Verified write too large");
 
-        struct VendorAndDeviceId {
-            uint16_t VendorId;
-            uint16_t ProductId;
-        }; // PACKED: This is unaligned in the USB service
+            R_ABORT_UNLESS(ams::svc::WriteDebugProcessMemory(hDebugProcess, reinterpret_cast<uintptr_t>(pData), Address, Size));
+            R_ABORT_UNLESS(ams::svc::ReadDebugProcessMemory(reinterpret_cast<uintptr_t>(g_ScanBuffer), hDebugProcess, Address, Size));
+            return std::memcmp(g_ScanBuffer, pData, Size) == 0;
+        }
     }
 
     void PatchUsbService() {
@@ -87,25 +142,47 @@ namespace ams::mitm::usb::sysmodule_patch
         }
 
         /* Step 6: Patch the process memory */
-        /* NOTE: This is an extremely unsafe implementation that patches the region of .text used for the entrypoint */
-        /* If, for some reason, the USB service were to crash at any point, this has very undefined behavior */
-        /* I Would much rather us have a better code-cave carved out, but for now this one will do. */
-        R_ABORT_UNLESS(ams::svc::WriteDebugProcessMemory(
-            hUsbDebugProcess,
-            reinterpret_cast<uintptr_t>(UsbServicePatchBegin),
-            UsbMemInfo.base_address,
-            reinterpret_cast<size_t>(reinterpret_cast<uintptr_t>(UsbServicePatchEnd) - reinterpret_cast<uintptr_t>(UsbServicePatchBegin)))
-        );
-
-        const uint32_t JumpToPatchInstr = 0x97FF057F; // bl -0x3EA04
-
-        R_ABORT_UNLESS(ams::svc::WriteDebugProcessMemory(
+        /* The patch goes into the padding at the end of .text, the hooked instruction only gets replaced by a branch to it */
+        /* once the patch has been read back intact */
+        const uint32_t HookOffset = g_HookSite.mOffset;
+
+        /* Make sure the hook site holds the instruction the patch displaces, on any other build the offset points elsewhere */
+        uint32_t HookedInstr;
+        R_ABORT_UNLESS(ams::svc::ReadDebugProcessMemory(
+            reinterpret_cast<uintptr_t>(&HookedInstr),
             hUsbDebugProcess,
-            reinterpret_cast<uintptr_t>(&JumpToPatchInstr),
-            UsbMemInfo.base_address + PatchUsbEndpointDescriptor_offset,
+            UsbMemInfo.base_address + HookOffset,
             sizeof(uint32_t)
         ));
 
+        uint32_t PatchOffset;
+        if (HookedInstr != g_HookSite.mDisplacedInstruction)
+        {
+            ::usb::util::Log("Unexpected instruction %08x at hook offset %x, leaving the USB process unpatched\n", HookedInstr, HookOffset);
+        }
+        else if (!FindCodeCave(hUsbDebugProcess, UsbMemInfo, &PatchOffset))
+        {
+            ::usb::util::Log("No code cave in the USB process, leaving it unpatched\n");
+        }
+        else
+        {
+            BuildPatch();
+            const uint32_t JumpToPatchInstr = ::usb::patch::GenerateHook(HookOffset, PatchOffset);
+
+            if (!WriteVerified(hUsbDebugProcess, UsbMemInfo.base_address + PatchOffset, g_Patch.GetCode(), g_Patch.GetSize()))
+            {
+                ::usb::util::Log("Patch didn't read back intact at %x, leaving the hook site alone\n", PatchOffset);
+            }
+            else if (!WriteVerified(hUsbDebugProcess, UsbMemInfo.base_address + HookOffset, &JumpToPatchInstr, sizeof(JumpToPatchInstr)))
+            {
+                ::usb::util::Log("Hook didn't read back intact at %x\n", HookOffset);
+            }
+            else
+            {
+                ::usb::util::Log("Hooked %x to the patch at %x\n", HookOffset, PatchOffset);
+            }
+        }
+
         /* Step 7: Continue the debugged process */
         u64 ThreadIds[] = { 0 };
 
@@ -1,6 +1,7 @@
 #include "usbmitm_module.hpp"
 #include "usb_mitm_service.hpp"
 #include "logger.hpp"
+#include "trace.hpp"
 
 namespace ams::mitm::usb
 {
@@ -52,6 +53,7 @@ namespace ams::mitm::usb
 
         void UsbHsMitmThreadFunction(void *)
         {
+            ::usb::trace::RegisterCurrentThread(::usb::trace::ThreadId::UsbHsMitm);
             R_ABORT_UNLESS((g_ServerManager.RegisterMitmServer<UsbMitmService>(0, sm::ServiceName::Encode("usb:hs"))));
             ::usb::util::Log("Registered usb:hs MITM Server\n");
             g_ServerManager.LoopProcess();
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+/* Only depends on the standard library so that it can be stress tested on a host, see tools/versioned_buffer_stress */
+namespace usb::gc
+{
+    /* Single-writer, multi-reader buffer that always hands readers a complete copy of the latest value without taking a lock */
+    /* The writer rotates through several slots and only ever touches the slot after the one readers are pointed at, so a reader */
+    /* never has to wait on a write in progress. A reader only retries if the writer has lapped every slot while it was copying. */
+    /* NOTE: Everything in this sysmodule runs on the same core, so a classic seqlock (where readers spin on an in-progress write) */
+    /* could spin for an entire timeslice if the writer got preempted mid-copy. That is why this isn't one. */
+    template<typename T, size_t SlotCount = 4>
+    class VersionedBuffer
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        static_assert(SlotCount >= 2);
+
+    private:
+        struct Slot
+        {
+            /* 0 while the slot is being written, otherwise the version of the value it holds */
+            std::atomic<uint64_t> mVersion;
+            T mValue;
+        };
+
+        std::atomic<uint64_t> mLatest;
+        Slot mSlots[SlotCount];
+
+    public:
+        /* Forgets every published value. Must not race with Publish */
+        void Reset()
+        {
+            for (size_t i = 0; i < SlotCount; i++)
+            {
+                mSlots[i].mVersion.store(0, std::memory_order_relaxed);
+            }
+            mLatest.store(0, std::memory_order_release);
+        }
+
+        /* Publishes a new value, only one thread may call this */
+        void Publish(const T& value)
+        {
+            const uint64_t Version = mLatest.load(std::memory_order_relaxed) + 1;
+            Slot* pSlot = &mSlots[Version % SlotCount];
+
+            pSlot->mVersion.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(&pSlot->mValue, &value, sizeof(T));
+            pSlot->mVersion.store(Version, std::memory_order_release);
+
+            mLatest.store(Version, std::memory_order_release);
+        }
+
+        /* Copies the latest value out, returning its version, or 0 (leaving pOut untouched) if nothing has been published yet */
+        uint64_t Read(T* pOut) const
+        {
+            while (true)
+            {
+                const uint64_t Version = mLatest.load(std::memory_order_acquire);
+                if (Version == 0)
+                    return 0;
+
+                const Slot* pSlot = &mSlots[Version % SlotCount];
+                if (pSlot->mVersion.load(std::memory_order_acquire) != Version)
+                    continue;
+
+                T Copy;
+                std::memcpy(&Copy, &pSlot->mValue, sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (pSlot->mVersion.load(std::memory_order_relaxed) == Version)
+                {
+                    *pOut = Copy;
+                    return Version;
+                }
+            }
+        }
+
+        /* Version of the latest published value, 0 if there is none */
+        uint64_t GetVersion() const
+        {
+            return mLatest.load(std::memory_order_acquire);
+        }
+    };
+}